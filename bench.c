@@ -0,0 +1,1173 @@
+// all of the named character references, not just the xml ones
+#define HTMLSTREAM_ENTITIES
+#include "htmlstream.h"
+#include "htmlstream_names.h"
+#include "htmlstream_parallel.h"
+#include "htmlstream_select.h"
+#include "htmlstream_file.h"
+#include "htmlstream_write.h"
+#include "htmlstream_tree.h"
+#include "htmlstream_links.h"
+#include <stdio.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+static unsigned long long bench_seed;
+static unsigned bench_rand(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 7;
+    bench_seed ^= bench_seed << 17;
+    return (unsigned)bench_seed;
+}
+
+static const char *bench_words[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "Lorem", "ipsum",
+};
+static const char *bench_tags[] = {
+    "div", "span", "a", "p", "li", "td", "section", "img", "Article", "b",
+};
+static const char *bench_word(void) { return bench_words[bench_rand() % 10]; }
+static const char *bench_tag(void)  { return bench_tags[bench_rand() % 10]; }
+
+// roughly what comes out of a crawler
+static int bench_gen_mixed(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 512) {
+        const char *tag = bench_tag();
+        at += sprintf(out + at, "<%s class=\"c%u\" id=c%u data-x='%s'>",
+                tag, bench_rand() % 100, bench_rand() % 100, bench_word());
+        int words = bench_rand() % 20;
+        for (int i = 0; i < words; i++) {
+            at += sprintf(out + at, "%s ", bench_word());
+        }
+        if (bench_rand() % 16 == 0) {
+            at += sprintf(out + at, "<!-- %s -->", bench_word());
+        }
+        at += sprintf(out + at, "</%s>\n", tag);
+    }
+    return at;
+}
+
+static int bench_gen_tags(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 512) {
+        const char *a = bench_tag();
+        const char *b = bench_tag();
+        at += sprintf(out + at, "<%s><%s><br/>%s</%s></%s>", a, b, bench_word(), b, a);
+    }
+    return at;
+}
+
+static int bench_gen_text(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 4096) {
+        at += sprintf(out + at, "<p>\n    ");
+        int words = 100 + bench_rand() % 400;
+        for (int i = 0; i < words; i++) {
+            at += sprintf(out + at, i % 12 == 11 ? "%s,\n    " : "%s ", bench_word());
+        }
+        at += sprintf(out + at, "\n</p>\n");
+    }
+    return at;
+}
+
+static int bench_gen_attrs(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 2048) {
+        at += sprintf(out + at, "<%s", bench_tag());
+        int attrs = 1 + bench_rand() % 8;
+        for (int i = 0; i < attrs; i++) {
+            switch (bench_rand() % 4) {
+                case 0:
+                    at += sprintf(out + at, " href=\"https://example.com/%s/%s?q=%u\"",
+                            bench_word(), bench_word(), bench_rand());
+                    break;
+                case 1:
+                    at += sprintf(out + at, " data-%s='%s %s'", bench_word(), bench_word(), bench_word());
+                    break;
+                case 2:
+                    at += sprintf(out + at, " width=%u", bench_rand() % 1000);
+                    break;
+                case 3:
+                    at += sprintf(out + at, " hidden");
+                    break;
+            }
+        }
+        at += sprintf(out + at, ">\n");
+    }
+    return at;
+}
+
+static int bench_gen_comments(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 2048) {
+        at += sprintf(out + at, "<!-- %s - %s -- %s ", bench_word(), bench_word(), bench_word());
+        int words = bench_rand() % 50;
+        for (int i = 0; i < words; i++) {
+            at += sprintf(out + at, "%s ", bench_word());
+        }
+        at += sprintf(out + at, "--><%s>%s</%s><!---->", "b", bench_word(), "b");
+    }
+    return at;
+}
+
+// inline javascript, full of < and quotes
+static int bench_gen_scripts(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 4096) {
+        at += sprintf(out + at, "<script type=\"text/javascript\">\n");
+        int lines = bench_rand() % 40;
+        for (int i = 0; i < lines; i++) {
+            at += sprintf(out + at, "  if (%s.length < %u && x[i] > 0) { s += '<%s class=\"%s\">' + %s + '</%s>'; }\n",
+                    bench_word(), bench_rand() % 100, bench_tag(), bench_word(), bench_word(), bench_tag());
+        }
+        at += sprintf(out + at, "</script>\n<p>%s %s</p>\n", bench_word(), bench_word());
+    }
+    return at;
+}
+
+// escaped text and attribute values, as cms output tends to be
+static const char *bench_refs[] = {
+    "&amp;", "&lt;", "&gt;", "&quot;", "&#39;", "&eacute;", "&nbsp;", "&#x2014;", "&copy", "&rarr;",
+};
+static int bench_gen_entities(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 2048) {
+        at += sprintf(out + at, "<a href=\"/search?q=%s&amp;page=%u\" title='%s %s %s'>",
+                bench_word(), bench_rand() % 100, bench_word(), bench_refs[bench_rand() % 10], bench_word());
+        int words = bench_rand() % 30;
+        for (int i = 0; i < words; i++) {
+            at += sprintf(out + at, "%s%s ", bench_word(), bench_rand() % 3 ? "" : bench_refs[bench_rand() % 10]);
+        }
+        at += sprintf(out + at, "</a>\n");
+    }
+    return at;
+}
+
+// non-english text, 2 to 4 byte utf-8 sequences
+static const char *bench_utf8_words[] = {
+    "Gr\xc3\xbc\xc3\x9f" "e", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xe4\xbd\xa0\xe5\xa5\xbd",
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "caf\xc3\xa9", "\xf0\x9f\x98\x80", "\xce\xb1\xce\xb2\xce\xb3",
+    "na\xc3\xafve", "\xd8\xb3\xd9\x84\xd8\xa7\xd9\x85", "the",
+};
+static int bench_gen_utf8(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 4096) {
+        at += sprintf(out + at, "<p lang=\"%s\" title='%s %s'>", bench_word(), bench_utf8_words[bench_rand() % 10],
+                bench_word());
+        int words = 20 + bench_rand() % 200;
+        for (int i = 0; i < words; i++) {
+            at += sprintf(out + at, "%s ", bench_utf8_words[bench_rand() % 10]);
+        }
+        at += sprintf(out + at, "</p>\n");
+    }
+    return at;
+}
+
+static int bench_gen_malformed(char *out, int len)
+{
+    const char *alphabet = "<<>>//  \t\n\"\"''==\\!!--abcdefXYZ&;";
+    int alen = strlen(alphabet);
+    for (int i = 0; i < len; i++) {
+        out[i] = bench_rand() % 4 ? alphabet[bench_rand() % alen] : (char)bench_rand();
+    }
+    return len;
+}
+
+// what a crawler sees: a head with metadata, paragraphs with links, and some layout around them
+static int bench_gen_page(char *out, int len)
+{
+    int at = 0;
+    while (at < len - 8192) {
+        at += sprintf(out + at, "<html><head><title>%s %s</title><meta charset=\"utf-8\">\n"
+                "<meta name=\"description\" content=\"%s %s %s\"><link rel=\"stylesheet\" href=\"/css/%s.css\">\n"
+                "<script src=\"/js/%s.js\"></script></head><body>\n",
+                bench_word(), bench_word(), bench_word(), bench_word(), bench_word(), bench_word(), bench_word());
+        int paragraphs = 5 + bench_rand() % 20;
+        for (int p = 0; p < paragraphs; p++) {
+            at += sprintf(out + at, "<div class=\"row c%u\"><p class=\"text\">", bench_rand() % 100);
+            int words = 20 + bench_rand() % 60;
+            for (int i = 0; i < words; i++) {
+                if (bench_rand() % 16 == 0) {
+                    at += sprintf(out + at, "<a href=\"../%s/%s?id=%u&amp;p=1\" class=\"link\">%s</a> ",
+                            bench_word(), bench_word(), bench_rand() % 10000, bench_word());
+                } else {
+                    at += sprintf(out + at, "%s ", bench_word());
+                }
+            }
+            at += sprintf(out + at, "</p><img src=\"/img/%u.png\" alt=\"%s\"></div>\n", bench_rand() % 1000, bench_word());
+        }
+        at += sprintf(out + at, "</body></html>\n");
+    }
+    return at;
+}
+
+static struct {
+    const char *name;
+    int (*gen)(char *out, int len);
+} bench_workloads[] = {
+    {"mixed",     bench_gen_mixed},
+    {"tag",       bench_gen_tags},
+    {"text",      bench_gen_text},
+    {"attr",      bench_gen_attrs},
+    {"comment",   bench_gen_comments},
+    {"script",    bench_gen_scripts},
+    {"entity",    bench_gen_entities},
+    {"utf8",      bench_gen_utf8},
+    {"malformed", bench_gen_malformed},
+    {"page",      bench_gen_page},
+};
+
+static long bench_tokens    = 0;
+static long bench_callbacks = 0;
+
+// -D: what a consumer that gets encoded text has to do
+static bool bench_decode_after = false;
+static char bench_decoded[1 << 16];
+static void bench_decode(const char *text, int len)
+{
+    if (bench_decode_after) {
+        int most = (sizeof(bench_decoded) - 1) * 4 / 5;
+        htmlstream_decode(bench_decoded, text, len < most ? len : most);
+    }
+}
+
+static void bench_open_cb(void *parg, const char *tag, int len)
+{
+    bench_tokens++;
+    bench_callbacks++;
+}
+static void bench_close_cb(void *parg, const char *tag, int len)
+{
+    bench_tokens++;
+    bench_callbacks++;
+}
+static void bench_text_cb(void *parg, const char *text, int len)
+{
+    bench_decode(text, len);
+    bench_tokens++;
+    bench_callbacks++;
+}
+static void bench_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
+{
+    bench_decode(val, val_l);
+    bench_callbacks++;
+}
+
+// the same handlers, called directly
+HTMLSTREAM_SPECIALIZE(bench_feed_spec, bench_open_cb, bench_close_cb, bench_attr_cb, bench_text_cb)
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long bench_cycles(void)
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+typedef struct
+{
+    double seconds;
+    unsigned long long cycles;
+    long tokens;
+    long callbacks;
+} bench_result_t;
+
+static int bench_runs    = 5;
+static int bench_flags   = 0;
+static int bench_threads = 1;
+static bool bench_use_tape = false;
+static bool bench_use_spec = false;
+
+// what the callbacks would have counted, from the records of one feed
+static void bench_scan_tape(htmlstream_tape_t *tape)
+{
+    if (tape->overflow) {
+        fprintf(stderr, "tape overflow\n");
+        exit(1);
+    }
+    for (int i = 0; i < tape->count; i++) {
+        int type = tape->events[i].type;
+        bench_tokens    += type != HTMLSTREAM_EVENT_ATTR && type != HTMLSTREAM_EVENT_VALUE;
+        bench_callbacks += type != HTMLSTREAM_EVENT_VALUE;
+    }
+    htmlstream_tape_clear(tape);
+}
+
+// best of bench_runs, feeding each document in chunk sized pieces
+static bench_result_t bench_parse(char **docs, int *lens, int ndocs, int chunk)
+{
+    bench_result_t best = {0};
+    htmlstream_tape_t tape = {0};
+    if (bench_use_tape) {
+        int most = chunk;
+        for (int d = 0; d < ndocs; d++) {
+            if (!chunk && lens[d] > most) {
+                most = lens[d];
+            }
+        }
+        // generous for the workloads here: no token is shorter than two bytes
+        tape.events_size  = most / 2 + 64;
+        tape.strings_size = most + 4 * HTMLSTREAM_TAG_BUFFER_SIZE;
+        tape.events  = malloc(tape.events_size * sizeof(htmlstream_event_t));
+        tape.strings = malloc(tape.strings_size);
+    }
+    for (int run = 0; run < bench_runs; run++) {
+        bench_tokens    = 0;
+        bench_callbacks = 0;
+        double start = bench_now();
+        unsigned long long cstart = bench_cycles();
+        for (int d = 0; d < ndocs; d++) {
+            htmlstream_t t;
+            htmlstream_init(&t);
+            t.open_cb  = bench_open_cb;
+            t.close_cb = bench_close_cb;
+            t.text_cb  = bench_text_cb;
+            t.attr_cb  = bench_attr_cb;
+            t.flags    = bench_flags;
+            t.tape     = bench_use_tape ? &tape : 0;
+            if (!chunk && bench_threads > 1) {
+                htmlstream_feed_parallel(&t, docs[d], lens[d], bench_threads);
+                continue;
+            }
+            int step = chunk ? chunk : lens[d];
+            for (int at = 0; at < lens[d]; at += step) {
+                int n = lens[d] - at < step ? lens[d] - at : step;
+                if (bench_use_spec) {
+                    bench_feed_spec(&t, docs[d] + at, n);
+                } else {
+                    htmlstream_feed(&t, docs[d] + at, n);
+                }
+                if (bench_use_tape) {
+                    bench_scan_tape(&tape);
+                }
+            }
+        }
+        bench_result_t r;
+        r.cycles    = bench_cycles() - cstart;
+        r.seconds   = bench_now() - start;
+        r.tokens    = bench_tokens;
+        r.callbacks = bench_callbacks;
+        if (run == 0 || r.seconds < best.seconds) {
+            best = r;
+        }
+    }
+    free(tape.events);
+    free(tape.strings);
+    return best;
+}
+
+// -g: whole document MB/s of every workload against a baseline file of "name MB/s" lines,
+// written by the first run. a workload more than bench_gate_slack percent slower fails
+#define BENCH_GATE_MAX 64
+static const char *bench_gate_path = 0;
+static double bench_gate_slack = 10;
+static int bench_gate_count = 0;
+static char bench_gate_names[BENCH_GATE_MAX][32];
+static double bench_gate_mbs[BENCH_GATE_MAX];
+
+static void bench_gate_add(const char *name, double mbs)
+{
+    if (bench_gate_count < BENCH_GATE_MAX) {
+        snprintf(bench_gate_names[bench_gate_count], sizeof(bench_gate_names[0]), "%s", name);
+        bench_gate_mbs[bench_gate_count++] = mbs;
+    }
+}
+
+// returns the exit status: 3 if a workload got slower than the baseline allows
+static int bench_gate(void)
+{
+    if (!bench_gate_count) {
+        fprintf(stderr, "gate: nothing to compare, -g only goes with plain parsing\n");
+        return 1;
+    }
+    FILE *f = fopen(bench_gate_path, "r");
+    if (!f) {
+        f = fopen(bench_gate_path, "w");
+        if (!f) {
+            perror(bench_gate_path);
+            return 1;
+        }
+        for (int i = 0; i < bench_gate_count; i++) {
+            fprintf(f, "%s %.1f\n", bench_gate_names[i], bench_gate_mbs[i]);
+        }
+        fclose(f);
+        printf("gate: baseline of %d workloads written to %s\n", bench_gate_count, bench_gate_path);
+        return 0;
+    }
+    int failed = 0;
+    char name[32];
+    double base;
+    while (fscanf(f, "%31s %lf", name, &base) == 2) {
+        for (int i = 0; i < bench_gate_count; i++) {
+            if (strcmp(name, bench_gate_names[i]) != 0) {
+                continue;
+            }
+            double change = (bench_gate_mbs[i] / base - 1) * 100;
+            bool slow = change < -bench_gate_slack;
+            printf("gate: %-12s %10.1f MB/s, baseline %10.1f %+6.1f%%%s\n",
+                    name, bench_gate_mbs[i], base, change, slow ? " REGRESSION" : "");
+            failed += slow;
+        }
+    }
+    fclose(f);
+    if (failed) {
+        printf("gate: %d workloads more than %.0f%% slower than %s\n", failed, bench_gate_slack, bench_gate_path);
+        return 3;
+    }
+    return 0;
+}
+
+static void bench_report(const char *name, int chunk, long bytes, bench_result_t r)
+{
+    char chunkname[32];
+    if (chunk) {
+        snprintf(chunkname, sizeof(chunkname), "%d", chunk);
+    } else {
+        snprintf(chunkname, sizeof(chunkname), "whole");
+    }
+    printf("%-12s %8s %10.1f %10.2f %10.2f", name, chunkname,
+            bytes / r.seconds / 1e6,
+            r.tokens / r.seconds / 1e6,
+            r.callbacks / r.seconds / 1e6);
+    if (r.cycles) {
+        printf(" %8.2f\n", (double)r.cycles / bytes);
+    } else {
+        printf(" %8s\n", "-");
+    }
+    if (bench_gate_path && !chunk) {
+        bench_gate_add(name, bytes / r.seconds / 1e6);
+    }
+}
+
+static void bench_header(void)
+{
+    printf("%-12s %8s %10s %10s %10s %8s\n",
+            "workload", "chunk", "MB/s", "Mtok/s", "Mcb/s", "cyc/B");
+}
+
+static const int bench_chunks[] = {16, 256, 4096, 65536, 0};
+
+
+// batch mode counts per worker, a cache line apart
+static long bench_batch_callbacks[HTMLSTREAM_PARALLEL_MAX_THREADS * 8];
+static void bench_batch_cb(void *parg, const char *tag, int len)
+{
+    bench_batch_callbacks[((htmlstream_batch_arg_t *)parg)->worker * 8]++;
+}
+static void bench_batch_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
+{
+    bench_batch_callbacks[((htmlstream_batch_arg_t *)parg)->worker * 8]++;
+}
+
+// cut doc into documents of about size bytes and parse them with
+// htmlstream_feed_batch on 1, 2, 4 ... bench_threads threads
+static void bench_batch(const char *name, const char *doc, int len, int size)
+{
+    int count = (len + size - 1) / size;
+    htmlstream_doc_t *docs = malloc(count * sizeof(htmlstream_doc_t));
+    for (int i = 0; i < count; i++) {
+        docs[i].data = doc + i * size;
+        docs[i].len  = len - i * size < size ? len - i * size : size;
+    }
+    htmlstream_t proto;
+    htmlstream_init(&proto);
+    proto.open_cb  = bench_batch_cb;
+    proto.close_cb = bench_batch_cb;
+    proto.text_cb  = bench_batch_cb;
+    proto.attr_cb  = bench_batch_attr_cb;
+    proto.flags    = bench_flags;
+
+    double single = 0;
+    for (int threads = 1; threads <= bench_threads; threads *= 2) {
+        double best = 0;
+        long callbacks = 0;
+        for (int run = 0; run < bench_runs; run++) {
+            memset(bench_batch_callbacks, 0, sizeof(bench_batch_callbacks));
+            double start = bench_now();
+            htmlstream_feed_batch(&proto, docs, count, threads);
+            double took = bench_now() - start;
+            if (run == 0 || took < best) {
+                best = took;
+            }
+        }
+        for (int w = 0; w < threads; w++) {
+            callbacks += bench_batch_callbacks[w * 8];
+        }
+        if (threads == 1) {
+            single = best;
+        }
+        printf("%-12s %8d %8d %10.1f %10.2f %8.2fx\n", name, count, threads,
+                len / best / 1e6, callbacks / best / 1e6, single / best);
+    }
+    free(docs);
+}
+
+static const char *bench_selectors[] = {
+    "a[href]", "div.c1", "section p", "span > b", "[data-x^=l]", "#c42", "li a", "article[id]",
+};
+static long bench_selected = 0;
+static void bench_select_cb(void *parg, int selector, const htmlstream_element_t *e)
+{
+    bench_selected++;
+}
+
+// all bench_selectors in one pass over doc, against one pass per selector
+static void bench_select(const char *name, const char *doc, int len)
+{
+    int count = sizeof(bench_selectors) / sizeof(bench_selectors[0]);
+    htmlstream_select_t *s = malloc(sizeof(htmlstream_select_t));
+    for (int per = count; per > 0; per = per == 1 ? 0 : 1) {
+        int passes = count / per;
+        double best = 0;
+        for (int run = 0; run < bench_runs; run++) {
+            bench_selected = 0;
+            double start = bench_now();
+            for (int pass = 0; pass < passes; pass++) {
+                htmlstream_select_init(s);
+                s->match_cb = bench_select_cb;
+                s->t.flags  = bench_flags;
+                for (int i = 0; i < per; i++) {
+                    htmlstream_select_add(s, bench_selectors[pass * per + i]);
+                }
+                for (int at = 0; at < len; at += 65536) {
+                    htmlstream_select_feed(s, doc + at, len - at < 65536 ? len - at : 65536);
+                }
+            }
+            double took = bench_now() - start;
+            if (run == 0 || took < best) {
+                best = took;
+            }
+        }
+        printf("%-12s %9d %8d %10.1f %10ld\n", name, per, passes, len / best / 1e6, bench_selected);
+    }
+    free(s);
+}
+
+// what pretty did before htmlstream_write.h: printf per event. indentation is capped like
+// htmlstream_write.h does, pretty indented documents that never close their tags without end
+#define BENCH_INDENT(n) ((n) < HTMLSTREAM_WRITE_DEPTH ? (n) : HTMLSTREAM_WRITE_DEPTH)
+static FILE *bench_out;
+static int bench_indent;
+static bool bench_was_open;
+static void bench_printf_open_cb(void *parg, const char *tag, int len)
+{
+    if (bench_was_open) {
+        fprintf(bench_out, ">\n");
+    }
+    ++bench_indent;
+    fprintf(bench_out, "%*s<%.*s", BENCH_INDENT(bench_indent), " ", len, tag);
+    bench_was_open = true;
+}
+static void bench_printf_close_cb(void *parg, const char *tag, int len)
+{
+    if (bench_was_open) {
+        bench_was_open = false;
+        fprintf(bench_out, ">\n");
+    }
+    --bench_indent;
+    fprintf(bench_out, "%*s</%.*s>\n", BENCH_INDENT(bench_indent), " ", len, tag);
+}
+static void bench_printf_text_cb(void *parg, const char *text, int len)
+{
+    if (bench_was_open) {
+        bench_was_open = false;
+        fprintf(bench_out, ">\n");
+    }
+    fprintf(bench_out, "%*s%.*s\n", BENCH_INDENT(bench_indent), " ", len, text);
+}
+static void bench_printf_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
+{
+    fprintf(bench_out, " %.*s='%.*s'", key_l, key, val_l, val);
+}
+
+// parse doc and write it to /dev/null: with printf callbacks, and with htmlstream_write.h
+// pretty printing and minifying
+static void bench_serialize(const char *name, const char *doc, int len)
+{
+    static const char *ways[] = {"printf", "pretty", "minify"};
+    htmlstream_writer_t *w = malloc(sizeof(htmlstream_writer_t));
+    bench_out = fopen("/dev/null", "w");
+    for (int way = 0; way < 3; way++) {
+        double best = 0;
+        for (int run = 0; run < bench_runs; run++) {
+            double start = bench_now();
+            htmlstream_write_init(w, fileno(bench_out), way == 2 ? HTMLSTREAM_WRITE_MINIFY : HTMLSTREAM_WRITE_PRETTY);
+            w->t.flags = bench_flags;
+            if (way == 0) {
+                w->t.open_cb  = bench_printf_open_cb;
+                w->t.close_cb = bench_printf_close_cb;
+                w->t.text_cb  = bench_printf_text_cb;
+                w->t.attr_cb  = bench_printf_attr_cb;
+                bench_indent   = 0;
+                bench_was_open = false;
+            }
+            for (int at = 0; at < len; at += 65536) {
+                htmlstream_write_feed(w, doc + at, len - at < 65536 ? len - at : 65536);
+            }
+            if (way == 0) {
+                fflush(bench_out);
+            } else {
+                htmlstream_write_finish(w);
+            }
+            double took = bench_now() - start;
+            if (run == 0 || took < best) {
+                best = took;
+            }
+        }
+        printf("%-12s %8s %10.1f\n", name, ways[way], len / best / 1e6);
+    }
+    fclose(bench_out);
+    free(w);
+}
+
+// the usual way to build a tree, for htmlstream_tree.h to beat: a malloc for every node,
+// attribute and string, linked by pointers
+typedef struct bench_attr
+{
+    char *key;
+    char *val;
+    struct bench_attr *next;
+} bench_attr_t;
+
+typedef struct bench_node
+{
+    char *name;
+    int len;
+    struct bench_node *parent;
+    struct bench_node *first_child;
+    struct bench_node *last_child;
+    struct bench_node *next_sibling;
+    bench_attr_t *attrs;
+    bool open;
+} bench_node_t;
+
+static bench_node_t *bench_node_at;
+static size_t bench_node_memory;
+
+// size plus a guess at what malloc keeps per block
+static void *bench_node_alloc(size_t size)
+{
+    bench_node_memory += (size + 8 + 15) & ~(size_t)15;
+    return calloc(1, size);
+}
+
+static char *bench_node_string(const char *s, int len)
+{
+    char *copy = bench_node_alloc(len + 1);
+    memcpy(copy, s, len);
+    return copy;
+}
+
+static bench_node_t *bench_node_add(const char *name, int len)
+{
+    bench_node_t *n = bench_node_alloc(sizeof(bench_node_t));
+    n->name   = bench_node_string(name, len);
+    n->len    = len;
+    n->parent = bench_node_at;
+    if (bench_node_at->last_child) {
+        bench_node_at->last_child->next_sibling = n;
+    } else {
+        bench_node_at->first_child = n;
+    }
+    bench_node_at->last_child = n;
+    return n;
+}
+
+static void bench_node_open_cb(void *parg, const char *tag, int len)
+{
+    bench_node_t *n = bench_node_add(tag, len);
+    n->open = true;
+    if (!(htmlstream_tag_flags[htmlstream_tag_id(tag, len)] & HTMLSTREAM_TAG_VOID) && tag[len - 1] != '/') {
+        bench_node_at = n;
+    }
+}
+
+static void bench_node_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
+{
+    bench_node_t *n = bench_node_at->last_child;
+    if (!n || !n->open) {
+        n = bench_node_at;
+    }
+    bench_attr_t *a = bench_node_alloc(sizeof(bench_attr_t));
+    a->key   = bench_node_string(key, key_l);
+    a->val   = bench_node_string(val, val_l);
+    a->next  = n->attrs;
+    n->attrs = a;
+}
+
+static void bench_node_close_cb(void *parg, const char *tag, int len)
+{
+    // like htmlstream_tree.h but without its name counts, so only a few levels up
+    bench_node_t *n = bench_node_at;
+    for (int up = 0; up < 256 && n->parent; up++, n = n->parent) {
+        if (n->len == len && memcmp(n->name, tag, len) == 0) {
+            bench_node_at = n->parent;
+            return;
+        }
+    }
+}
+
+static void bench_node_text_cb(void *parg, const char *text, int len)
+{
+    bench_node_add(text, len);
+}
+
+static void bench_node_free(bench_node_t *root)
+{
+    // children first, without recursing: a deep document would overflow the stack
+    bench_node_t *n = root;
+    while (n) {
+        if (n->first_child) {
+            bench_node_t *child = n->first_child;
+            n->first_child = 0;
+            n = child;
+            continue;
+        }
+        bench_node_t *next = n->next_sibling ? n->next_sibling : n->parent;
+        while (n->attrs) {
+            bench_attr_t *a = n->attrs;
+            n->attrs = a->next;
+            free(a->key);
+            free(a->val);
+            free(a);
+        }
+        free(n->name);
+        free(n);
+        n = n == root ? 0 : next;
+    }
+}
+
+// build a tree of doc: with htmlstream_tree_parse, htmlstream_tree_feed in 64KB chunks,
+// and a malloc per node. MB/s to build it, ms to free it and memory per MB of html
+static void bench_tree(const char *name, const char *doc, int len)
+{
+    static const char *ways[] = {"parse", "feed", "malloc"};
+    htmlstream_tree_t *tree = malloc(sizeof(htmlstream_tree_t));
+    for (int way = 0; way < 3; way++) {
+        double best = 0;
+        double best_free = 0;
+        size_t memory = 0;
+        int nodes = 0;
+        htmlstream_tree_init(tree);
+        tree->t.flags = bench_flags;
+        for (int run = 0; run < bench_runs; run++) {
+            htmlstream_t t;
+            bench_node_t *root = 0;
+            double start = bench_now();
+            if (way == 0) {
+                htmlstream_tree_parse(tree, doc, len);
+            } else if (way == 1) {
+                for (int at = 0; at < len; at += 65536) {
+                    htmlstream_tree_feed(tree, doc + at, len - at < 65536 ? len - at : 65536);
+                }
+            } else {
+                htmlstream_init(&t);
+                t.flags    = bench_flags;
+                t.open_cb  = bench_node_open_cb;
+                t.close_cb = bench_node_close_cb;
+                t.attr_cb  = bench_node_attr_cb;
+                t.text_cb  = bench_node_text_cb;
+                bench_node_memory = 0;
+                root = bench_node_at = bench_node_alloc(sizeof(bench_node_t));
+                htmlstream_feed(&t, doc, len);
+            }
+            double took = bench_now() - start;
+            memory = way < 2 ? htmlstream_tree_memory(tree) : bench_node_memory;
+            nodes  = way < 2 ? tree->nodes_count : 0;
+            start = bench_now();
+            if (way < 2) {
+                htmlstream_tree_clear(tree);
+            } else {
+                bench_node_free(root);
+            }
+            double took_free = bench_now() - start;
+            if (run == 0 || took < best) {
+                best = took;
+            }
+            if (run == 0 || took_free < best_free) {
+                best_free = took_free;
+            }
+        }
+        htmlstream_tree_free(tree);
+        printf("%-12s %8s %10.1f %10.3f %10.0f %10d\n", name, ways[way], len / best / 1e6,
+                best_free * 1e3, memory / (len / 1048576.0) / 1024, nodes);
+    }
+    free(tree);
+}
+
+// htmlstream_links.h callbacks on htmlstream_feed: they stop the parser to switch to
+// another one, which here just goes on
+static void bench_links_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_links_open_cb(parg, tag, len);
+    ((htmlstream_links_t *)parg)->t.skip = 0;
+}
+static void bench_links_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
+{
+    htmlstream_links_attr_cb(parg, key, key_l, val, val_l);
+}
+static void bench_links_text_cb(void *parg, const char *text, int len)
+{
+    htmlstream_links_text_cb(parg, text, len);
+    ((htmlstream_links_t *)parg)->t.skip = 0;
+}
+
+// links and metadata of doc: with the same callbacks on htmlstream_feed, and with
+// htmlstream_links_feed
+static void bench_links(const char *name, const char *doc, int len)
+{
+    static const char *ways[] = {"feed", "links"};
+    htmlstream_links_t *l = malloc(sizeof(htmlstream_links_t));
+    htmlstream_links_init(l, "https://example.com/a/b.html");
+    for (int way = 0; way < 2; way++) {
+        double best = 0;
+        for (int run = 0; run < bench_runs; run++) {
+            htmlstream_links_reset(l, "https://example.com/a/b.html");
+            l->t.open_cb = way == 0 ? bench_links_open_cb : 0;
+            l->t.attr_cb = way == 0 ? bench_links_attr_cb : 0;
+            l->t.text_cb = way == 0 ? bench_links_text_cb : 0;
+            double start = bench_now();
+            for (int at = 0; at < len; at += 65536) {
+                int n = len - at < 65536 ? len - at : 65536;
+                if (way == 0) {
+                    htmlstream_feed(&l->t, doc + at, n);
+                } else {
+                    htmlstream_links_feed(l, doc + at, n);
+                }
+            }
+            htmlstream_links_finish(l);
+            double took = bench_now() - start;
+            if (run == 0 || took < best) {
+                best = took;
+            }
+        }
+        printf("%-12s %8s %10.1f %10d\n", name, ways[way], len / best / 1e6, l->links_count);
+    }
+    htmlstream_links_free(l);
+    free(l);
+}
+
+// every regular file in dir is one document
+static int bench_corpus(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return 1;
+    }
+    int ndocs = 0;
+    int cap   = 64;
+    char **docs = malloc(cap * sizeof(char *));
+    int   *lens = malloc(cap * sizeof(int));
+    long bytes  = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            continue;
+        }
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            continue;
+        }
+        if (ndocs == cap) {
+            cap *= 2;
+            docs = realloc(docs, cap * sizeof(char *));
+            lens = realloc(lens, cap * sizeof(int));
+        }
+        docs[ndocs] = malloc(st.st_size);
+        lens[ndocs] = fread(docs[ndocs], 1, st.st_size, f);
+        bytes += lens[ndocs];
+        ndocs++;
+        fclose(f);
+    }
+    closedir(d);
+    if (!ndocs) {
+        fprintf(stderr, "%s: no documents\n", dir);
+        return 1;
+    }
+    printf("%s: %d documents, %ld bytes\n", dir, ndocs, bytes);
+    bench_header();
+    for (int c = 0; c < sizeof(bench_chunks) / sizeof(bench_chunks[0]); c++) {
+        bench_report("corpus", bench_chunks[c], bytes,
+                bench_parse(docs, lens, ndocs, bench_chunks[c]));
+    }
+    for (int i = 0; i < ndocs; i++) {
+        free(docs[i]);
+    }
+    free(docs);
+    free(lens);
+    return bench_gate_path ? bench_gate() : 0;
+}
+
+// the read sizes a read loop of one's own might use, then htmlstream_feed_file
+static const int bench_file_chunks[] = {1024, 65536, 1 << 20, 0};
+
+// parse the file at path from read loops and mapped
+static int bench_file(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return 1;
+    }
+    printf("%s: %lld bytes\n", path, (long long)st.st_size);
+    bench_header();
+    char *buf = malloc(1 << 20);
+    for (int c = 0; c < sizeof(bench_file_chunks) / sizeof(bench_file_chunks[0]); c++) {
+        int chunk = bench_file_chunks[c];
+        bench_result_t best = {0};
+        for (int run = 0; run < bench_runs; run++) {
+            bench_tokens    = 0;
+            bench_callbacks = 0;
+            htmlstream_t t;
+            htmlstream_init(&t);
+            t.open_cb  = bench_open_cb;
+            t.close_cb = bench_close_cb;
+            t.text_cb  = bench_text_cb;
+            t.attr_cb  = bench_attr_cb;
+            t.flags    = bench_flags;
+            double start = bench_now();
+            unsigned long long cstart = bench_cycles();
+            if (chunk) {
+                int fd = open(path, O_RDONLY);
+                ssize_t n;
+                while (fd >= 0 && (n = read(fd, buf, chunk)) > 0) {
+                    htmlstream_feed(&t, buf, n);
+                }
+                close(fd);
+            } else if (htmlstream_feed_file(&t, path) < 0) {
+                perror(path);
+                return 1;
+            }
+            bench_result_t r;
+            r.cycles    = bench_cycles() - cstart;
+            r.seconds   = bench_now() - start;
+            r.tokens    = bench_tokens;
+            r.callbacks = bench_callbacks;
+            if (run == 0 || r.seconds < best.seconds) {
+                best = r;
+            }
+        }
+        bench_report(chunk ? "read" : "mmap", chunk, st.st_size, best);
+    }
+    free(buf);
+    return 0;
+}
+
+// write mb MB of a workload to path, generated 64MB at a time so it can be bigger than memory
+static int bench_write(const char *path, const char *workload, int mb)
+{
+    int w = 0;
+    while (strcmp(bench_workloads[w].name, workload) != 0) {
+        if (++w == sizeof(bench_workloads) / sizeof(bench_workloads[0])) {
+            fprintf(stderr, "%s: no such workload\n", workload);
+            return 1;
+        }
+    }
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    int piece = 64 << 20;
+    char *buf = malloc(piece);
+    bench_seed = 88172645463325252ULL;
+    for (long long left = (long long)mb << 20; left > 0; ) {
+        int len = bench_workloads[w].gen(buf, left < piece ? (left < (1 << 20) ? 1 << 20 : left) : piece);
+        if (fwrite(buf, 1, len, f) != len) {
+            perror(path);
+            return 1;
+        }
+        left -= len;
+    }
+    free(buf);
+    fclose(f);
+    return 0;
+}
+
+static void bench_usage(void)
+{
+    fprintf(stderr,
+            "usage: bench [-m MB] [-r runs] [-w workload] [-z] [-d|-D] [-k] [-u] [-e] [-s] [-q] [-p] [-T] [-l] [-t threads]\n"
+            "             [-g baseline [-x percent]] [corpus dir]\n"
+            "       bench [-w workload] [-m MB] -o file    bench [-r runs] [-z] ... -f file\n"
+            "  without a corpus dir, parses generated documents of every workload\n"
+            "  -z parses with HTMLSTREAM_ZEROCOPY\n"
+            "  -d parses with HTMLSTREAM_DECODE, -D decodes text and values in the callbacks\n"
+            "     with htmlstream_decode instead\n"
+            "  -k parses with HTMLSTREAM_KEEP_CASE, -u with HTMLSTREAM_UTF8\n"
+            "  -e parses onto an event tape and scans it after every chunk\n"
+            "  -s parses with a HTMLSTREAM_SPECIALIZE parser for the same callbacks\n"
+            "  -t parses whole documents with htmlstream_feed_parallel\n"
+            "  -b KB cuts workloads into KB sized documents and parses them with\n"
+            "     htmlstream_feed_batch on 1, 2, 4 ... up to -t threads (default: all cores)\n"
+            "  -q matches a set of css selectors with htmlstream_select, all in one pass\n"
+            "     and in one pass each\n"
+            "  -p writes the parsed document to /dev/null with printf per event, and pretty\n"
+            "     printed and minified with htmlstream_write.h\n"
+            "  -T builds a tree with htmlstream_tree.h, from the whole document and from\n"
+            "     64KB chunks, and with a malloc per node: build MB/s, ms to free it and\n"
+            "     KB of memory per MB of html\n"
+            "  -l extracts links and metadata with htmlstream_links.h, and with the same\n"
+            "     callbacks on htmlstream_feed\n"
+            "  -g compares whole document MB/s of every workload (or of the corpus) with the\n"
+            "     baseline file, and fails if one is more than -x percent (default 10) slower.\n"
+            "     writes the baseline if there is none yet\n"
+            "  -o writes MB of a generated workload (default mixed) to file, for -f\n"
+            "  -f parses file from read loops of several sizes and with htmlstream_feed_file\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int mb = 16;
+    int batch = 0;
+    bool select = false;
+    bool serialize = false;
+    bool tree = false;
+    bool links = false;
+    const char *only = 0;
+    const char *dir  = 0;
+    const char *file = 0;
+    const char *out  = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            bench_runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            file = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            bench_gate_path = argv[++i];
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            bench_gate_slack = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            bench_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batch = atoi(argv[++i]);
+            if (bench_threads == 1) {
+                bench_threads = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        } else if (strcmp(argv[i], "-z") == 0) {
+            bench_flags |= HTMLSTREAM_ZEROCOPY;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            bench_flags |= HTMLSTREAM_DECODE;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            bench_flags |= HTMLSTREAM_KEEP_CASE;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            bench_flags |= HTMLSTREAM_UTF8;
+        } else if (strcmp(argv[i], "-D") == 0) {
+            bench_decode_after = true;
+        } else if (strcmp(argv[i], "-e") == 0) {
+            bench_use_tape = true;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            bench_use_spec = true;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            select = true;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            serialize = true;
+        } else if (strcmp(argv[i], "-T") == 0) {
+            tree = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            links = true;
+        } else if (argv[i][0] == '-') {
+            bench_usage();
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (mb < 1 || bench_runs < 1) {
+        bench_usage();
+    }
+    if (dir) {
+        return bench_corpus(dir);
+    }
+    if (file) {
+        return bench_file(file);
+    }
+    if (out) {
+        return bench_write(out, only ? only : "mixed", mb);
+    }
+
+    int cap = mb << 20;
+    char *doc = malloc(cap);
+    if (batch) {
+        printf("%-12s %8s %8s %10s %10s %9s\n",
+                "workload", "docs", "threads", "MB/s", "Mcb/s", "speedup");
+    } else if (select) {
+        printf("%-12s %9s %8s %10s %10s\n",
+                "workload", "selectors", "passes", "MB/s", "matches");
+    } else if (serialize) {
+        printf("%-12s %8s %10s\n", "workload", "output", "MB/s");
+    } else if (tree) {
+        printf("%-12s %8s %10s %10s %10s %10s\n", "workload", "build", "MB/s", "free ms", "KB/MB", "nodes");
+    } else if (links) {
+        printf("%-12s %8s %10s %10s\n", "workload", "parse", "MB/s", "links");
+    } else {
+        bench_header();
+    }
+    for (int w = 0; w < sizeof(bench_workloads) / sizeof(bench_workloads[0]); w++) {
+        if (only && strcmp(only, bench_workloads[w].name) != 0) {
+            continue;
+        }
+        bench_seed = 88172645463325252ULL;
+        int len = bench_workloads[w].gen(doc, cap);
+        if (batch) {
+            bench_batch(bench_workloads[w].name, doc, len, batch << 10);
+            continue;
+        }
+        if (select) {
+            bench_select(bench_workloads[w].name, doc, len);
+            continue;
+        }
+        if (serialize) {
+            bench_serialize(bench_workloads[w].name, doc, len);
+            continue;
+        }
+        if (tree) {
+            bench_tree(bench_workloads[w].name, doc, len);
+            continue;
+        }
+        if (links) {
+            bench_links(bench_workloads[w].name, doc, len);
+            continue;
+        }
+        for (int c = 0; c < sizeof(bench_chunks) / sizeof(bench_chunks[0]); c++) {
+            bench_report(bench_workloads[w].name, bench_chunks[c], len,
+                    bench_parse(&doc, &len, 1, bench_chunks[c]));
+        }
+    }
+    free(doc);
+    return bench_gate_path ? bench_gate() : 0;
+}
@@ -0,0 +1,806 @@
+// differential fuzzer: the same input, split into the same random chunks, through every
+// way of parsing there is, must give the same events as the reference parser. the
+// reference is htmlstream.h built with HTMLSTREAM_NO_FASTPATH and HTMLSTREAM_NO_SIMD, one
+// step of the state machine per byte, in a translation unit of its own (fuzz.c again,
+// with FUZZ_REFERENCE). see make fuzz
+//
+// that shares everything but the fast paths with what it checks, so documents of plain
+// html (see fuzz_plain) also go through a small tokenizer of its own, which has to agree
+// with the reference
+//
+//   fuzz [-n iterations] [-s seed]   random documents
+//   fuzz file ...                    inputs that failed before, as written to fuzz-failure
+//
+// with FUZZ_LIBFUZZER there is LLVMFuzzerTestOneInput instead of main (make fuzz_libfuzzer).
+// an input is 4 bytes of configuration and then the document
+
+// both translation units have to decode the same references, and keep the same stack
+#define HTMLSTREAM_ENTITIES
+#define HTMLSTREAM_ELEMENT_STACK
+
+#ifdef FUZZ_REFERENCE
+
+#define HTMLSTREAM_NO_FASTPATH
+#define HTMLSTREAM_NO_SIMD
+#include "htmlstream.h"
+
+int fuzz_reference_feed(htmlstream_t *t, const char *data, int len)
+{
+    return htmlstream_feed(t, data, len);
+}
+
+#else
+
+#include "htmlstream.h"
+// small enough for the documents here to have a few segments
+#define HTMLSTREAM_PARALLEL_MIN_SEGMENT 16
+#include "htmlstream_parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int fuzz_reference_feed(htmlstream_t *t, const char *data, int len);
+
+// which callbacks are set, in fuzz_config_t.callbacks
+#define FUZZ_OPEN      1
+#define FUZZ_CLOSE     2
+#define FUZZ_ATTR      4
+#define FUZZ_TEXT      8
+#define FUZZ_TEXT_PART 16
+#define FUZZ_COMMENT   32
+
+#define FUZZ_ENGINE_REFERENCE       0    // whole document in one feed
+#define FUZZ_ENGINE_REFERENCE_SPLIT 1
+#define FUZZ_ENGINE_FEED            2
+#define FUZZ_ENGINE_SPECIALIZE      3
+#define FUZZ_ENGINE_TAPE            4
+#define FUZZ_ENGINE_CHECKPOINT      5    // checkpoint after every chunk, restore into another parser
+#define FUZZ_ENGINE_PARALLEL        6    // every chunk through htmlstream_feed_parallel
+#define FUZZ_ENGINE_BATCH           7    // FUZZ_BATCH copies of the whole document
+#define FUZZ_ENGINES                8
+
+static const char *const fuzz_engines[FUZZ_ENGINES] = {
+    "reference", "reference split", "htmlstream_feed", "HTMLSTREAM_SPECIALIZE", "tape", "checkpoint",
+    "htmlstream_feed_parallel", "htmlstream_feed_batch",
+};
+
+#define FUZZ_BATCH 3
+
+typedef struct
+{
+    int callbacks;
+    int flags;
+    bool alloc;
+    // open_cb skips <nav> and stops at <stop>
+    bool directives;
+    // 0 whole, 1 byte by byte, 2 up to 8, 3 up to 64, else up to the whole rest
+    int split;
+    unsigned seed;
+} fuzz_config_t;
+
+// the events of a parse, one after the other: a type byte, a length and the bytes
+typedef struct
+{
+    char *data;
+    int at;
+    int size;
+} fuzz_bytes_t;
+
+typedef struct
+{
+    fuzz_bytes_t events;
+    // pieces of the text node and the comment going on. they are joined and go in as one
+    // event when the last one comes, so where they were cut does not matter. a text node
+    // or comment the document ends in never ends: how much of it went out depends on the chunks
+    fuzz_bytes_t parts[2];
+    htmlstream_t *t;
+    bool directives;
+    // where the 'u' event with the bytes used and the utf-8 check is, which a batch has not
+    int end;
+} fuzz_log_t;
+
+// htmlstream_feed_batch is running: parg is a htmlstream_batch_arg_t, whose parg
+// is the log of its first document
+static bool fuzz_batching;
+
+static fuzz_log_t *fuzz_log_of(void *parg)
+{
+    if (!fuzz_batching) {
+        return (fuzz_log_t *)parg;
+    }
+    htmlstream_batch_arg_t *arg = (htmlstream_batch_arg_t *)parg;
+    fuzz_log_t *log = (fuzz_log_t *)arg->parg + arg->index;
+    log->t = arg->t;
+    return log;
+}
+
+static void fuzz_put(fuzz_bytes_t *b, const void *data, int len)
+{
+    if (b->at + len > b->size) {
+        b->size = (b->at + len) * 2;
+        b->data = (char *)realloc(b->data, b->size);
+    }
+    if (len) {
+        memcpy(b->data + b->at, data, len);
+    }
+    b->at += len;
+}
+
+static void fuzz_log_event(fuzz_log_t *log, char type, const char *str, int len)
+{
+    fuzz_put(&log->events, &type, 1);
+    fuzz_put(&log->events, &len, sizeof(len));
+    fuzz_put(&log->events, str, len);
+}
+
+static void fuzz_log_part(fuzz_log_t *log, int which, char type, const char *str, int len, bool final)
+{
+    fuzz_bytes_t *part = &log->parts[which];
+    fuzz_put(part, str, len);
+    if (final) {
+        fuzz_log_event(log, type, part->data, part->at);
+        part->at = 0;
+    }
+}
+
+static void fuzz_open_cb(void *parg, const char *tag, int len)
+{
+    fuzz_log_t *log = fuzz_log_of(parg);
+    fuzz_log_event(log, 'o', tag, len);
+    if (log->directives && len == 3 && memcmp(tag, "nav", 3) == 0) {
+        htmlstream_skip(log->t);
+    } else if (log->directives && len == 4 && memcmp(tag, "stop", 4) == 0) {
+        htmlstream_stop(log->t);
+    }
+}
+
+static void fuzz_close_cb(void *parg, const char *tag, int len)
+{
+    fuzz_log_event(fuzz_log_of(parg), 'c', tag, len);
+}
+
+static void fuzz_attr_cb(void *parg, const char *key, int key_len, const char *val, int val_len)
+{
+    fuzz_log_t *log = fuzz_log_of(parg);
+    fuzz_log_event(log, 'k', key, key_len);
+    if (val) {
+        fuzz_log_event(log, 'v', val, val_len);
+    } else {
+        fuzz_log_event(log, 'n', "", 0);
+    }
+}
+
+static void fuzz_text_cb(void *parg, const char *text, int len)
+{
+    fuzz_log_event(fuzz_log_of(parg), 't', text, len);
+}
+
+static void fuzz_text_part_cb(void *parg, const char *text, int len, bool final)
+{
+    fuzz_log_part(fuzz_log_of(parg), 0, 'p', text, len, final);
+}
+
+static void fuzz_comment_cb(void *parg, const char *text, int len, bool final)
+{
+    fuzz_log_part(fuzz_log_of(parg), 1, 'm', text, len, final);
+}
+
+static void *fuzz_alloc(void *parg, void *ptr, int size)
+{
+    if (!size) {
+        free(ptr);
+        return 0;
+    }
+    return malloc(size);
+}
+
+// a specialized parser for every combination of the four callbacks it takes
+#define FUZZ_SPECIALIZE(N) \
+    HTMLSTREAM_SPECIALIZE(fuzz_spec_##N, (N) & FUZZ_OPEN ? fuzz_open_cb : 0, \
+            (N) & FUZZ_CLOSE ? fuzz_close_cb : 0, (N) & FUZZ_ATTR ? fuzz_attr_cb : 0, \
+            (N) & FUZZ_TEXT ? fuzz_text_cb : 0)
+FUZZ_SPECIALIZE(0)  FUZZ_SPECIALIZE(1)  FUZZ_SPECIALIZE(2)  FUZZ_SPECIALIZE(3)
+FUZZ_SPECIALIZE(4)  FUZZ_SPECIALIZE(5)  FUZZ_SPECIALIZE(6)  FUZZ_SPECIALIZE(7)
+FUZZ_SPECIALIZE(8)  FUZZ_SPECIALIZE(9)  FUZZ_SPECIALIZE(10) FUZZ_SPECIALIZE(11)
+FUZZ_SPECIALIZE(12) FUZZ_SPECIALIZE(13) FUZZ_SPECIALIZE(14) FUZZ_SPECIALIZE(15)
+
+typedef int (*fuzz_feed_t)(htmlstream_t *t, const char *data, int len);
+static const fuzz_feed_t fuzz_specs[16] = {
+    fuzz_spec_0, fuzz_spec_1, fuzz_spec_2,  fuzz_spec_3,  fuzz_spec_4,  fuzz_spec_5,  fuzz_spec_6,  fuzz_spec_7,
+    fuzz_spec_8, fuzz_spec_9, fuzz_spec_10, fuzz_spec_11, fuzz_spec_12, fuzz_spec_13, fuzz_spec_14, fuzz_spec_15,
+};
+
+static unsigned fuzz_rand(unsigned *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// how much of the left bytes the next chunk takes
+static int fuzz_chunk(const fuzz_config_t *c, unsigned *state, int left)
+{
+    int most;
+    switch (c->split) {
+        case 0:  return left;
+        case 1:  return 1;
+        case 2:  most = 8; break;
+        case 3:  most = 64; break;
+        default: most = left; break;
+    }
+    int n = 1 + fuzz_rand(state) % most;
+    return n < left ? n : left;
+}
+
+static void fuzz_setup(htmlstream_t *t, fuzz_log_t *log, const fuzz_config_t *c)
+{
+    htmlstream_init(t);
+    t->parg  = log;
+    t->flags = c->flags;
+    t->open_cb      = c->callbacks & FUZZ_OPEN ? fuzz_open_cb : 0;
+    t->close_cb     = c->callbacks & FUZZ_CLOSE ? fuzz_close_cb : 0;
+    t->attr_cb      = c->callbacks & FUZZ_ATTR ? fuzz_attr_cb : 0;
+    t->text_cb      = c->callbacks & FUZZ_TEXT ? fuzz_text_cb : 0;
+    t->text_part_cb = c->callbacks & FUZZ_TEXT_PART ? fuzz_text_part_cb : 0;
+    t->comment_cb   = c->callbacks & FUZZ_COMMENT ? fuzz_comment_cb : 0;
+    t->alloc_cb     = c->alloc ? fuzz_alloc : 0;
+}
+
+static void fuzz_log_reset(fuzz_log_t *log, const fuzz_config_t *c)
+{
+    log->events.at   = 0;
+    log->parts[0].at = 0;
+    log->parts[1].at = 0;
+    log->t   = 0;
+    log->end = 0;
+    log->directives = c->directives && (c->callbacks & FUZZ_OPEN);
+}
+
+// FUZZ_BATCH copies of html and "<end>" in one document each, on two threads, into
+// log and the logs after it. there is no 'u' event, a batch does not tell what it used
+static int fuzz_run_batch(fuzz_log_t *log, const fuzz_config_t *c, const char *html, int len)
+{
+    // htmlstream_close_all is not called at the end of a document
+    if (c->flags & HTMLSTREAM_STACK) {
+        return 0;
+    }
+    char *doc = (char *)malloc(len + 5);
+    memcpy(doc, html, len);
+    memcpy(doc + len, "<end>", 5);
+    htmlstream_doc_t docs[FUZZ_BATCH];
+    for (int i = 0; i < FUZZ_BATCH; i++) {
+        docs[i].data = doc;
+        docs[i].len  = len + 5;
+        fuzz_log_reset(&log[i], c);
+    }
+    htmlstream_t proto;
+    fuzz_setup(&proto, log, c);
+    fuzz_batching = true;
+    htmlstream_feed_batch(&proto, docs, FUZZ_BATCH, 2);
+    fuzz_batching = false;
+    for (int i = 0; i < FUZZ_BATCH; i++) {
+        log[i].end = log[i].events.at;
+    }
+    htmlstream_free(&proto);
+    free(doc);
+    return FUZZ_BATCH;
+}
+
+// parse html (and then "<end>", so that the last text comes out) with engine, into log
+// (and for a batch the logs after it). how many logs that filled, 0 if the engine does
+// not apply to c
+static int fuzz_run(fuzz_log_t *log, const fuzz_config_t *c, int engine, const char *html, int len)
+{
+    if (engine == FUZZ_ENGINE_SPECIALIZE && (c->callbacks & (FUZZ_TEXT_PART | FUZZ_COMMENT))) {
+        return 0;
+    }
+    // replayed callbacks come too late to skip or stop
+    if (engine == FUZZ_ENGINE_TAPE && c->directives) {
+        return 0;
+    }
+    if (engine == FUZZ_ENGINE_BATCH) {
+        return fuzz_run_batch(log, c, html, len);
+    }
+    htmlstream_t p[2];
+    htmlstream_t *t = &p[0];
+    fuzz_setup(&p[0], log, c);
+    fuzz_setup(&p[1], log, c);
+    fuzz_log_reset(log, c);
+    log->t = t;
+
+    htmlstream_tape_t tape;
+    memset(&tape, 0, sizeof(tape));
+    if (engine == FUZZ_ENGINE_TAPE) {
+        // more than any chunk can need: no byte makes more than two events or four bytes
+        tape.events_size  = 2 * len + 64;
+        tape.strings_size = 4 * len + 4 * HTMLSTREAM_TAG_BUFFER_SIZE;
+        tape.events  = (htmlstream_event_t *)malloc(tape.events_size * sizeof(htmlstream_event_t));
+        tape.strings = (char *)malloc(tape.strings_size);
+        p[0].tape = &tape;
+    }
+
+    unsigned state = c->seed;
+    long used = 0;
+    for (int doc = 0; doc < 2; doc++) {
+        const char *data = doc ? "<end>" : html;
+        int data_len = doc ? 5 : len;
+        int at = 0;
+        while (at < data_len) {
+            int n = engine == FUZZ_ENGINE_REFERENCE ? data_len - at : fuzz_chunk(c, &state, data_len - at);
+            if (engine == FUZZ_ENGINE_REFERENCE || engine == FUZZ_ENGINE_REFERENCE_SPLIT) {
+                used += fuzz_reference_feed(t, data + at, n);
+            } else if (engine == FUZZ_ENGINE_SPECIALIZE) {
+                used += fuzz_specs[c->callbacks & 15](t, data + at, n);
+            } else if (engine == FUZZ_ENGINE_PARALLEL) {
+                used += htmlstream_feed_parallel(t, data + at, n, 4);
+            } else {
+                used += htmlstream_feed(t, data + at, n);
+            }
+            at += n;
+            if (engine == FUZZ_ENGINE_TAPE) {
+                if (tape.overflow) {
+                    fprintf(stderr, "fuzz: tape overflow\n");
+                    abort();
+                }
+                htmlstream_tape_replay(&tape, t);
+                htmlstream_tape_clear(&tape);
+            } else if (engine == FUZZ_ENGINE_CHECKPOINT) {
+                char out[2 * HTMLSTREAM_TAG_BUFFER_SIZE + 256];
+                int size = htmlstream_checkpoint(t, 0, 0);
+                char *in = size <= (int)sizeof(out) ? out : (char *)malloc(size);
+                htmlstream_checkpoint(t, in, size);
+                htmlstream_t *next = t == &p[0] ? &p[1] : &p[0];
+                if (!htmlstream_restore(next, in, size)) {
+                    fprintf(stderr, "fuzz: checkpoint does not restore\n");
+                    abort();
+                }
+                if (in != out) {
+                    free(in);
+                }
+                t = next;
+                log->t = t;
+            }
+        }
+    }
+    if (c->flags & HTMLSTREAM_STACK) {
+        htmlstream_close_all(t);
+        if (engine == FUZZ_ENGINE_TAPE) {
+            htmlstream_tape_replay(&tape, t);
+        }
+    }
+    char end[64];
+    int end_len = snprintf(end, sizeof(end), "%ld %d %d", used, t->utf8.invalid, t->utf8.need);
+    log->end = log->events.at;
+    fuzz_log_event(log, 'u', end, end_len);
+
+    free(tape.events);
+    free(tape.strings);
+    htmlstream_free(&p[0]);
+    htmlstream_free(&p[1]);
+    return 1;
+}
+
+// plain html, which fuzz_plain tokenizes on its own: text without references, open tags
+// with attributes whose values are quoted or not, and end tags without attributes. names
+// start with a letter and are not of raw text elements. all of it ascii, and without
+// alloc_cb no name, value or text as long as a buffer
+static bool fuzz_plain_space(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\f' || ch == '\r';
+}
+
+static bool fuzz_plain_letter(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+static bool fuzz_plain_name_char(char ch)
+{
+    return fuzz_plain_letter(ch) || (ch >= '0' && ch <= '9') || ch == '-' || ch == '_' || ch == ':';
+}
+
+// a byte that can be in text or a quoted value
+static bool fuzz_plain_char(char ch)
+{
+    return ((ch >= 32 && ch < 127) || fuzz_plain_space(ch)) && ch != '<' && ch != '&';
+}
+
+// a name at html + *at, or 0
+static int fuzz_plain_name(const char *html, int *at)
+{
+    int from = *at;
+    if (!fuzz_plain_letter(html[*at])) {
+        return 0;
+    }
+    while (fuzz_plain_name_char(html[*at])) {
+        ++*at;
+    }
+    return *at - from;
+}
+
+static int fuzz_plain_spaces(const char *html, int *at)
+{
+    int from = *at;
+    while (fuzz_plain_space(html[*at])) {
+        ++*at;
+    }
+    return *at - from;
+}
+
+static void fuzz_plain_event(fuzz_log_t *log, char type, const char *str, int len, bool lower)
+{
+    char *low = (char *)malloc(len + 1);
+    for (int i = 0; i < len; i++) {
+        low[i] = lower && str[i] >= 'A' && str[i] <= 'Z' ? str[i] - 'A' + 'a' : str[i];
+    }
+    fuzz_log_event(log, type, low, len);
+    free(low);
+}
+
+// the events of html and "<end>" into log, the way htmlstream.h should make them, but
+// without any of it. false if html is not plain or c has what is not done here
+static bool fuzz_plain(fuzz_log_t *log, const fuzz_config_t *c, const char *html, int len)
+{
+    if (c->directives || (c->flags & HTMLSTREAM_STACK)) {
+        return false;
+    }
+    fuzz_log_reset(log, c);
+    int n = len + 5;
+    char *doc = (char *)malloc(n + 1);
+    memcpy(doc, html, len);
+    memcpy(doc + len, "<end>", 6);
+    int most = c->alloc ? n : HTMLSTREAM_TAG_BUFFER_SIZE - 1;
+    bool keep_case = c->flags & HTMLSTREAM_KEEP_CASE;
+    char text_type = c->callbacks & FUZZ_TEXT_PART ? 'p' : c->callbacks & FUZZ_TEXT ? 't' : 0;
+    static const char *const raw[] = {"script", "style", "textarea", "title"};
+    bool plain = true;
+    int at = 0;
+    while (plain && at < n) {
+        int text = at;
+        while (at < n && doc[at] != '<') {
+            plain = plain && fuzz_plain_char(doc[at]);
+            ++at;
+        }
+        int text_len = at - text;
+        plain = plain && at < n && text_len <= most;
+        if (!plain) {
+            break;
+        }
+        if (!(c->flags & HTMLSTREAM_KEEP_SPACE)) {
+            while (text_len > 0 && fuzz_plain_space(doc[text])) {
+                ++text;
+                --text_len;
+            }
+            while (text_len > 0 && fuzz_plain_space(doc[text + text_len - 1])) {
+                --text_len;
+            }
+        }
+        if (text_len && text_type) {
+            fuzz_log_event(log, text_type, doc + text, text_len);
+        }
+
+        bool end = doc[++at] == '/';
+        at += end;
+        int name = at;
+        int name_len = fuzz_plain_name(doc, &at);
+        plain = name_len > 0 && name_len <= most;
+        for (int i = 0; plain && i < 4; i++) {
+            int k = 0;
+            while (k < name_len && raw[i][k] && (doc[name + k] | 32) == raw[i][k]) {
+                ++k;
+            }
+            plain = k < name_len || raw[i][k];
+        }
+        if (!plain) {
+            break;
+        }
+        if (end) {
+            fuzz_plain_spaces(doc, &at);
+            plain = doc[at++] == '>';
+            if (plain && (c->callbacks & FUZZ_CLOSE)) {
+                fuzz_plain_event(log, 'c', doc + name, name_len, true);
+            }
+            continue;
+        }
+        if (c->callbacks & FUZZ_OPEN) {
+            fuzz_plain_event(log, 'o', doc + name, name_len, true);
+        }
+        // attributes, each after whitespace
+        for (;;) {
+            int spaces = fuzz_plain_spaces(doc, &at);
+            if (doc[at] == '>') {
+                ++at;
+                break;
+            }
+            int key = at;
+            int key_len = fuzz_plain_name(doc, &at);
+            plain = spaces > 0 && key_len > 0 && key_len <= most;
+            if (!plain) {
+                break;
+            }
+            int after = at;
+            fuzz_plain_spaces(doc, &at);
+            if (doc[at] != '=') {
+                at = after;
+                if (c->callbacks & FUZZ_ATTR) {
+                    fuzz_plain_event(log, 'k', doc + key, key_len, true);
+                    fuzz_log_event(log, 'n', "", 0);
+                }
+                continue;
+            }
+            ++at;
+            fuzz_plain_spaces(doc, &at);
+            char quote = doc[at] == '"' || doc[at] == '\'' ? doc[at++] : 0;
+            int val = at;
+            while (at < n && (quote ? doc[at] != quote && fuzz_plain_char(doc[at]) :
+                        fuzz_plain_char(doc[at]) && !fuzz_plain_space(doc[at]) && !strchr("\"'=>/`", doc[at]))) {
+                ++at;
+            }
+            int val_len = at - val;
+            plain = (quote ? doc[at++] == quote : val_len > 0) && val_len <= most;
+            if (!plain) {
+                break;
+            }
+            if (c->callbacks & FUZZ_ATTR) {
+                fuzz_plain_event(log, 'k', doc + key, key_len, true);
+                fuzz_plain_event(log, 'v', doc + val, val_len, !keep_case);
+            }
+        }
+    }
+    free(doc);
+    if (plain) {
+        char end[64];
+        int end_len = snprintf(end, sizeof(end), "%d 0 0", n);
+        log->end = log->events.at;
+        fuzz_log_event(log, 'u', end, end_len);
+    }
+    return plain;
+}
+
+// s to stderr, with escapes for what is not printable ascii
+static void fuzz_print(const char *s, int len)
+{
+    for (int i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '\\' || c < 32 || c > 126) {
+            fprintf(stderr, "\\x%02x", c);
+        } else {
+            fputc(c, stderr);
+        }
+    }
+}
+
+static void fuzz_print_log(const fuzz_bytes_t *log)
+{
+    for (int at = 0; at < log->at; ) {
+        char type = log->data[at];
+        int len;
+        memcpy(&len, log->data + at + 1, sizeof(int));
+        at += 1 + sizeof(int);
+        fprintf(stderr, "  %c '", type);
+        fuzz_print(log->data + at, len);
+        fprintf(stderr, "'\n");
+        at += len;
+    }
+}
+
+static fuzz_config_t fuzz_config(const unsigned char *in)
+{
+    fuzz_config_t c;
+    c.callbacks  = in[0] & 63;
+    c.directives = (in[0] & 64) != 0;
+    c.alloc      = (in[0] & 128) != 0;
+    c.flags      = (in[1] & 15) | (in[1] & 128 ? HTMLSTREAM_STACK : 0);
+    c.split      = in[1] >> 4 & 7;
+    c.seed       = in[2] | in[3] << 8;
+    return c;
+}
+
+// the reference and then the logs of another engine, FUZZ_BATCH for a batch
+static fuzz_log_t fuzz_logs[1 + FUZZ_BATCH];
+
+// on a difference between the reference's events and got's, writes the input
+// to fuzz-failure and aborts. a log without 'u' event only has to agree up to it
+static void fuzz_check(const unsigned char *in, size_t size, const fuzz_config_t *c,
+        const char *name, const fuzz_log_t *want, const fuzz_log_t *got)
+{
+    const fuzz_bytes_t *a = &want->events;
+    const fuzz_bytes_t *b = &got->events;
+    int a_at = got->end == b->at ? want->end : a->at;
+    if (a_at == b->at && memcmp(a->data, b->data, a_at) == 0) {
+        return;
+    }
+    const char *html = (const char *)in + 4;
+    int len = (int)size - 4;
+    fprintf(stderr, "fuzz: %s differs from the reference, callbacks %d, flags %d, alloc %d, "
+            "directives %d, split %d, seed %u, document:\n",
+            name, c->callbacks, c->flags, c->alloc, c->directives, c->split, c->seed);
+    fuzz_print(html, len);
+    fprintf(stderr, "\nreference:\n");
+    fuzz_print_log(a);
+    fprintf(stderr, "%s:\n", name);
+    fuzz_print_log(b);
+    FILE *f = fopen("fuzz-failure", "wb");
+    if (f) {
+        fwrite(in, 1, size, f);
+        fclose(f);
+        fprintf(stderr, "input written to fuzz-failure\n");
+    }
+    abort();
+}
+
+// run one input (4 bytes of configuration, then the document) through every engine,
+// and fuzz_plain if it is plain html
+static int fuzz_one(const unsigned char *in, size_t size)
+{
+    if (size < 4 || size > (1 << 20)) {
+        return 0;
+    }
+    fuzz_config_t c = fuzz_config(in);
+    const char *html = (const char *)in + 4;
+    int len = (int)size - 4;
+    fuzz_log_t *want = &fuzz_logs[0];
+    fuzz_log_t *got  = &fuzz_logs[1];
+    fuzz_run(want, &c, FUZZ_ENGINE_REFERENCE, html, len);
+    for (int engine = 1; engine < FUZZ_ENGINES; engine++) {
+        int logs = fuzz_run(got, &c, engine, html, len);
+        for (int i = 0; i < logs; i++) {
+            fuzz_check(in, size, &c, fuzz_engines[engine], want, &got[i]);
+        }
+    }
+    if (fuzz_plain(got, &c, html, len)) {
+        fuzz_check(in, size, &c, "plain tokenizer", want, got);
+    }
+    return 0;
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+#ifdef __cplusplus
+extern "C"
+#endif
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    return fuzz_one(data, size);
+}
+
+#else
+
+// pieces of html that make the parser go places, and plain bytes in between
+static const char *const fuzz_tokens[] = {
+    "<", ">", "</", "/>", "/", "=", "'", "\"", " ", "\n", "\t", "<<", "<>", "</>",
+    "<!--", "-->", "--", "-", "<!", "<![CDATA[", "]]>", "]", "<?", "?>", "<!DOCTYPE html>",
+    "&", ";", "#", "&amp;", "&lt", "&#", "&#x", "&#39;", "&#x1F600;", "&#0;", "&#xD800;", "&eacute",
+    "&notin;", "&NotNestedGreaterGreater;", "&ampx", "&#99999999;",
+    "a", "p", "b", "A", "Div", "br", "img", "nav", "stop", "svg",
+    "script", "style", "textarea", "title", "</script>", "</SCRIPT ", "</scri", "</style>", "</title>",
+    "href", "class", "x", "X", "1", "text", "é", "\xe2\x82\xac", "\xe2\x82", "\xff", "\xc0\xaf", "\xed\xa0\x80",
+    "<a href=", "<p class='x y'>", "<img src=x/>", "<nav>", "</nav>", "<stop>", "<script>", "<title>",
+    "<textarea>", "</textarea>", "<b a=1 b='2' c=\"3\" d>",
+};
+
+static int fuzz_generate(unsigned *state, unsigned char *out, int size)
+{
+    int ntokens = sizeof(fuzz_tokens) / sizeof(fuzz_tokens[0]);
+    int n = fuzz_rand(state) % 200;
+    int at = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned r = fuzz_rand(state);
+        if (r % 16 == 0) {
+            // longer than a buffer that cannot grow
+            int run = HTMLSTREAM_TAG_BUFFER_SIZE - 8 + fuzz_rand(state) % 16;
+            for (int j = 0; j < run && at < size; j++) {
+                out[at++] = r & 32 ? ' ' : 'x';
+            }
+        } else if (r % 16 == 1) {
+            if (at < size) {
+                out[at++] = (unsigned char)fuzz_rand(state);
+            }
+        } else {
+            const char *tok = fuzz_tokens[fuzz_rand(state) % ntokens];
+            for (int j = 0; tok[j] && at < size; j++) {
+                out[at++] = tok[j];
+            }
+        }
+    }
+    return at;
+}
+
+// plain html for fuzz_plain, now and then with something that is not
+static int fuzz_generate_plain(unsigned *state, unsigned char *out, int size)
+{
+    static const char *const names[] = {"a", "p", "B", "div", "Li", "x-y", "h1", "my_el", "svg:g", "end"};
+    static const char *const keys[] = {"href", "class", "ID", "data-x", "a:b", "x"};
+    static const char *const words[] = {
+        "hello", "World", "a > b", "x = y", "it's", "\"q\"", "/", "`", " ", "  ", "\n", "\t", "\r\n",
+    };
+    static const char *const spaces[] = {" ", "  ", "\n", "\t", " \f"};
+    static const char *const quotes[] = {"", "'", "\""};
+#define FUZZ_PICK(a) a[fuzz_rand(state) % (sizeof(a) / sizeof(a[0]))]
+    int n = fuzz_rand(state) % 40;
+    int at = 0;
+    char tok[256];
+    for (int i = 0; i < n && at < size - (int)sizeof(tok); i++) {
+        unsigned r = fuzz_rand(state);
+        int len = 0;
+        if (r % 4 == 0) {
+            len = snprintf(tok, sizeof(tok), "</%s%s>", FUZZ_PICK(names), r & 16 ? FUZZ_PICK(spaces) : "");
+        } else if (r % 4 == 1) {
+            len = snprintf(tok, sizeof(tok), "<%s", FUZZ_PICK(names));
+            for (int a = fuzz_rand(state) % 4; a > 0; a--) {
+                const char *quote = FUZZ_PICK(quotes);
+                len += snprintf(tok + len, sizeof(tok) - len, "%s%s", FUZZ_PICK(spaces), FUZZ_PICK(keys));
+                if (fuzz_rand(state) % 4 == 0) {
+                    continue;
+                }
+                const char *val = *quote ? FUZZ_PICK(words) : FUZZ_PICK(names);
+                if (strchr(val, *quote ? *quote : ' ')) {
+                    val = "v";
+                }
+                len += snprintf(tok + len, sizeof(tok) - len, "%s=%s%s%s%s", r & 32 ? " " : "",
+                        r & 64 ? " " : "", quote, val, quote);
+            }
+            len += snprintf(tok + len, sizeof(tok) - len, "%s>", r & 128 ? FUZZ_PICK(spaces) : "");
+        } else if (r % 64 == 2) {
+            // longer than a buffer that cannot grow
+            len = 80 + fuzz_rand(state) % 40;
+            memset(tok, r & 256 ? ' ' : 'x', len);
+        } else if (r % 64 == 3) {
+            // not plain
+            len = snprintf(tok, sizeof(tok), "%s", FUZZ_PICK(fuzz_tokens));
+        } else {
+            len = snprintf(tok, sizeof(tok), "%s", FUZZ_PICK(words));
+        }
+        memcpy(out + at, tok, len);
+        at += len;
+    }
+#undef FUZZ_PICK
+    return at;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = 100000;
+    unsigned seed = 1;
+    int files = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = (unsigned)atol(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: fuzz [-n iterations] [-s seed] [file ...]\n");
+            return 1;
+        } else {
+            FILE *f = fopen(argv[i], "rb");
+            if (!f) {
+                perror(argv[i]);
+                return 1;
+            }
+            static unsigned char in[1 << 20];
+            size_t size = fread(in, 1, sizeof(in), f);
+            fclose(f);
+            fuzz_one(in, size);
+            files++;
+        }
+    }
+    if (files) {
+        printf("fuzz: %d inputs, no differences\n", files);
+        return 0;
+    }
+    static unsigned char in[8192];
+    unsigned state = seed;
+    for (long i = 0; i < iterations; i++) {
+        for (int j = 0; j < 4; j++) {
+            in[j] = (unsigned char)fuzz_rand(&state);
+        }
+        int len = i % 4 == 3 ? fuzz_generate_plain(&state, in + 4, sizeof(in) - 4) :
+                fuzz_generate(&state, in + 4, sizeof(in) - 4);
+        fuzz_one(in, len + 4);
+    }
+    printf("fuzz: %ld documents, seed %u, no differences\n", iterations, seed);
+    return 0;
+}
+
+#endif
+
+#endif
@@ -1,8 +1,27 @@
+#ifndef HTMLSTREAM_H
+#define HTMLSTREAM_H
+
 #include <string.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#if !defined(HTMLSTREAM_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define HTMLSTREAM_SIMD_AVX2
+#endif
+#if !defined(HTMLSTREAM_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HTMLSTREAM_SIMD_SSE2
+#endif
+
+// for what has to be inlined to be worth anything
+#ifdef __GNUC__
+#define HTMLSTREAM_INLINE static inline __attribute__((always_inline))
+#else
+#define HTMLSTREAM_INLINE static inline
+#endif
 
 #define HTMLSTREAM_TAG_BUFFER_SIZE 100
 #define HTMLSTREAM_STATE_TEXT            0
@@ -17,6 +36,344 @@
 #define HTMLSTREAM_STATE_ATTR_EQ         9
 #define HTMLSTREAM_STATE_ATTR_VAL       10
 #define HTMLSTREAM_STATE_ATTR_VAL_QUOTE 11
+// markup that does not depend on the state it shows up in. t->ret is the state to go back to
+#define HTMLSTREAM_STATE_MARKUP         12  // t->markup bytes of "<!--" seen
+#define HTMLSTREAM_STATE_CDATA_START    13  // t->markup bytes of "<![CDATA[" seen
+#define HTMLSTREAM_STATE_COMMENT        14  // in <!-- -->, t->markup trailing dashes
+#define HTMLSTREAM_STATE_CDATA          15  // in <![CDATA[ ]]>, t->markup trailing ]
+#define HTMLSTREAM_STATE_BOGUS          16  // in <? >
+// content of script, style, ... up to its end tag. t->rawtext says which
+#define HTMLSTREAM_STATE_RAWTEXT        17
+#define HTMLSTREAM_STATE_RAWTEXT_END    18  // "<" (markup 1) or "</" (2) and the name so far in t->tag
+// with HTMLSTREAM_DECODE, after a & in text or an attribute value (t->ret).
+// the t->markup bytes after the & so far are in t->entity
+#define HTMLSTREAM_STATE_ENTITY         19
+#define HTMLSTREAM_STATES               20
+
+// what the state machine tells bytes apart by
+#define HTMLSTREAM_CLASS_OTHER  0
+#define HTMLSTREAM_CLASS_LT     1
+#define HTMLSTREAM_CLASS_GT     2
+#define HTMLSTREAM_CLASS_SLASH  3
+#define HTMLSTREAM_CLASS_SPACE  4
+#define HTMLSTREAM_CLASS_QUOTE  5
+#define HTMLSTREAM_CLASS_EQ     6
+#define HTMLSTREAM_CLASS_ESCAPE 7
+#define HTMLSTREAM_CLASSES      8
+
+// what to do with a byte after switching state
+#define HTMLSTREAM_ACTION_NONE            0
+#define HTMLSTREAM_ACTION_PUSH_TEXT       1
+#define HTMLSTREAM_ACTION_PUSH_TAG        2
+#define HTMLSTREAM_ACTION_PUSH_VAL        3
+#define HTMLSTREAM_ACTION_START_TAG       4
+#define HTMLSTREAM_ACTION_START_VAL       5
+#define HTMLSTREAM_ACTION_EMIT_TEXT       6
+#define HTMLSTREAM_ACTION_EMIT_OPEN       7
+#define HTMLSTREAM_ACTION_EMIT_CLOSE      8
+#define HTMLSTREAM_ACTION_EMIT_KEY        9
+#define HTMLSTREAM_ACTION_EMIT_KEY_START 10
+#define HTMLSTREAM_ACTION_EMIT_KEY_QUOTE 11
+#define HTMLSTREAM_ACTION_EMIT_ATTR      12
+#define HTMLSTREAM_ACTION_RESET          13
+#define HTMLSTREAM_ACTION_RESET_VAL      14
+#define HTMLSTREAM_ACTION_QUOTE          15
+#define HTMLSTREAM_ACTION_QUOTE_KEY      16
+#define HTMLSTREAM_ACTION_QUOTE_VAL      17
+#define HTMLSTREAM_ACTION_ESCAPE         18
+#define HTMLSTREAM_ACTION_QUOTED_KEY     19
+#define HTMLSTREAM_ACTION_QUOTED_VAL     20
+#define HTMLSTREAM_ACTION_MARKUP         21
+#define HTMLSTREAM_ACTION_COMMENT        22
+#define HTMLSTREAM_ACTION_CDATA          23
+#define HTMLSTREAM_ACTION_BOGUS          24
+#define HTMLSTREAM_ACTION_RAW_LT         25
+#define HTMLSTREAM_ACTION_RAW_END        26
+#define HTMLSTREAM_ACTION_ENTITY         27
+
+#define HTMLSTREAM_ASCII_LOWER(x) ((char)((x) | (((unsigned char)((x) - 'A') < 26) << 5)))
+// ascii only, no locale. define it as (x) before including to keep case
+#ifndef HTMLSTREAM_TOLOWER
+#define HTMLSTREAM_TOLOWER(x) HTMLSTREAM_ASCII_LOWER(x)
+#endif
+#define HTMLSTREAM_ISSPACE(x) (htmlstream_classes[(unsigned char)(x)] == HTMLSTREAM_CLASS_SPACE)
+
+#define HTMLSTREAM_C_ HTMLSTREAM_CLASS_OTHER
+#define HTMLSTREAM_CS HTMLSTREAM_CLASS_SPACE
+static const unsigned char htmlstream_classes[256] = {
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    // tab, lf, ff and cr are space, vt is not. nothing past ascii is, like in html
+    HTMLSTREAM_C_, HTMLSTREAM_CS, HTMLSTREAM_CS, HTMLSTREAM_C_, HTMLSTREAM_CS, HTMLSTREAM_CS, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    // space ! " # $ % & '
+    HTMLSTREAM_CS, HTMLSTREAM_C_, HTMLSTREAM_CLASS_QUOTE, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_CLASS_QUOTE,
+    // ( ) * + , - . /
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_CLASS_SLASH,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    // 8 9 : ; < = > ?
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_CLASS_LT, HTMLSTREAM_CLASS_EQ, HTMLSTREAM_CLASS_GT, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    // X Y Z [ \ ] ^ _
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_CLASS_ESCAPE, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    // 0x80 - 0xff
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+    HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_, HTMLSTREAM_C_,
+};
+#undef HTMLSTREAM_C_
+#undef HTMLSTREAM_CS
+
+// [state][class] -> action << 8 | next state
+#define HTMLSTREAM_T(STATE, ACTION) (HTMLSTREAM_ACTION_##ACTION << 8 | HTMLSTREAM_STATE_##STATE)
+static const unsigned short htmlstream_transitions[HTMLSTREAM_STATES][HTMLSTREAM_CLASSES] = {
+    // OTHER, <, >, /, space, quote, =, backslash
+    { // TEXT
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+        HTMLSTREAM_T(TAG_START, EMIT_TEXT),
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+        HTMLSTREAM_T(TEXT, PUSH_TEXT),
+    },
+    { // TAG_START
+        HTMLSTREAM_T(OPENING_TAG, START_TAG),
+        HTMLSTREAM_T(TAG_START, NONE),          //trash = <<
+        HTMLSTREAM_T(TEXT, RESET_VAL),          //trash = <>
+        HTMLSTREAM_T(TAG_START_SLASH, NONE),
+        HTMLSTREAM_T(TAG_START, NONE),
+        HTMLSTREAM_T(OPENING_TAG, START_TAG),
+        HTMLSTREAM_T(OPENING_TAG, START_TAG),
+        HTMLSTREAM_T(OPENING_TAG, START_TAG),
+    },
+    { // OPENING_TAG
+        HTMLSTREAM_T(OPENING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(OPENING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(TEXT, EMIT_OPEN),
+        HTMLSTREAM_T(OPENING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(OPENING_TAG_END, EMIT_OPEN),
+        HTMLSTREAM_T(OPENING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(OPENING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(OPENING_TAG, PUSH_TAG),
+    },
+    { // OPENING_TAG_END
+        HTMLSTREAM_T(ATTR_KEY, START_TAG),
+        HTMLSTREAM_T(TAG_START, NONE),          //missing >  before <
+        HTMLSTREAM_T(TEXT, RESET),
+        HTMLSTREAM_T(OPENING_TAG_END, NONE),    //thrash
+        HTMLSTREAM_T(OPENING_TAG_END, NONE),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTE_KEY),
+        HTMLSTREAM_T(ATTR_KEY, START_TAG),
+        HTMLSTREAM_T(ATTR_KEY, START_TAG),
+    },
+    { // TAG_START_SLASH
+        HTMLSTREAM_T(CLOSING_TAG, START_TAG),
+        HTMLSTREAM_T(TAG_START, NONE),          //trash: </<
+        HTMLSTREAM_T(TEXT, RESET),              //trash: </>
+        HTMLSTREAM_T(CLOSING_TAG, START_TAG),
+        HTMLSTREAM_T(TAG_START_SLASH, NONE),
+        HTMLSTREAM_T(CLOSING_TAG, START_TAG),
+        HTMLSTREAM_T(CLOSING_TAG, START_TAG),
+        HTMLSTREAM_T(CLOSING_TAG, START_TAG),
+    },
+    { // CLOSING_TAG
+        HTMLSTREAM_T(CLOSING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(TAG_START, EMIT_CLOSE),    //probably missing > of end tag = </ bla<
+        HTMLSTREAM_T(TEXT, EMIT_CLOSE),
+        HTMLSTREAM_T(CLOSING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(OPENING_TAG_END, EMIT_CLOSE),
+        HTMLSTREAM_T(CLOSING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(CLOSING_TAG, PUSH_TAG),
+        HTMLSTREAM_T(CLOSING_TAG, PUSH_TAG),
+    },
+    { // ATTR_KEY
+        HTMLSTREAM_T(ATTR_KEY, PUSH_TAG),
+        HTMLSTREAM_T(TAG_START, EMIT_KEY),
+        HTMLSTREAM_T(TEXT, EMIT_KEY),
+        HTMLSTREAM_T(ATTR_KEY, PUSH_TAG),
+        HTMLSTREAM_T(ATTR_KEY_END, NONE),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTE),
+        HTMLSTREAM_T(ATTR_EQ, NONE),
+        HTMLSTREAM_T(ATTR_KEY, PUSH_TAG),
+    },
+    { // ATTR_KEY_QUOTE
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, QUOTED_KEY),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, ESCAPE),
+    },
+    { // ATTR_KEY_END
+        HTMLSTREAM_T(ATTR_KEY, EMIT_KEY_START),
+        HTMLSTREAM_T(TAG_START, EMIT_KEY),
+        HTMLSTREAM_T(TEXT, EMIT_KEY),
+        HTMLSTREAM_T(ATTR_KEY, EMIT_KEY_START),
+        HTMLSTREAM_T(ATTR_KEY_END, NONE),
+        HTMLSTREAM_T(ATTR_KEY_QUOTE, EMIT_KEY_QUOTE),
+        HTMLSTREAM_T(ATTR_EQ, NONE),
+        HTMLSTREAM_T(ATTR_KEY, EMIT_KEY_START),
+    },
+    { // ATTR_EQ
+        HTMLSTREAM_T(ATTR_VAL, START_VAL),
+        HTMLSTREAM_T(TAG_START, EMIT_KEY),
+        HTMLSTREAM_T(TEXT, EMIT_KEY),
+        HTMLSTREAM_T(ATTR_VAL, START_VAL),
+        HTMLSTREAM_T(ATTR_EQ, NONE),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTE_VAL),
+        HTMLSTREAM_T(ATTR_EQ, NONE),
+        HTMLSTREAM_T(ATTR_VAL, START_VAL),
+    },
+    { // ATTR_VAL
+        HTMLSTREAM_T(ATTR_VAL, PUSH_VAL),
+        HTMLSTREAM_T(TAG_START, EMIT_ATTR),
+        HTMLSTREAM_T(TEXT, EMIT_ATTR),
+        HTMLSTREAM_T(ATTR_VAL, NONE),           //thrash
+        HTMLSTREAM_T(OPENING_TAG_END, EMIT_ATTR),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTE),
+        HTMLSTREAM_T(ATTR_VAL, PUSH_VAL),
+        HTMLSTREAM_T(ATTR_VAL, PUSH_VAL),
+    },
+    { // ATTR_VAL_QUOTE
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, QUOTED_VAL),
+        HTMLSTREAM_T(ATTR_VAL_QUOTE, ESCAPE),
+    },
+    // these match bytes instead of classes, in the action
+    { // MARKUP
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+        HTMLSTREAM_T(MARKUP, MARKUP),
+    },
+    { // CDATA_START
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+        HTMLSTREAM_T(CDATA_START, MARKUP),
+    },
+    { // COMMENT
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+        HTMLSTREAM_T(COMMENT, COMMENT),
+    },
+    { // CDATA
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+        HTMLSTREAM_T(CDATA, CDATA),
+    },
+    { // BOGUS
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+        HTMLSTREAM_T(BOGUS, BOGUS),
+    },
+    { // RAWTEXT
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_LT),
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+        HTMLSTREAM_T(RAWTEXT, PUSH_TEXT),
+    },
+    { // RAWTEXT_END
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+        HTMLSTREAM_T(RAWTEXT_END, RAW_END),
+    },
+    { // ENTITY
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+        HTMLSTREAM_T(ENTITY, ENTITY),
+    },
+};
+#undef HTMLSTREAM_T
+
+#ifdef HTMLSTREAM_STATS
+// [state] -> the classes whose transition above recovers from malformed input:
+// the trash ones, and tags that end at a < for a missing >
+#define HTMLSTREAM_R(CLASS) (1 << HTMLSTREAM_CLASS_##CLASS)
+static const unsigned char htmlstream_recoveries[HTMLSTREAM_STATES] = {
+    0,                                  // TEXT
+    HTMLSTREAM_R(LT) | HTMLSTREAM_R(GT),    // TAG_START
+    0,                                  // OPENING_TAG
+    HTMLSTREAM_R(LT),                   // OPENING_TAG_END
+    HTMLSTREAM_R(LT) | HTMLSTREAM_R(GT),    // TAG_START_SLASH
+    HTMLSTREAM_R(LT),                   // CLOSING_TAG
+    HTMLSTREAM_R(LT),                   // ATTR_KEY
+    0,                                  // ATTR_KEY_QUOTE
+    HTMLSTREAM_R(LT),                   // ATTR_KEY_END
+    HTMLSTREAM_R(LT),                   // ATTR_EQ
+    HTMLSTREAM_R(LT) | HTMLSTREAM_R(SLASH), // ATTR_VAL
+};
+#undef HTMLSTREAM_R
+#endif
 
 typedef void(*htmlstream_open_cb)(void *parg, const char *tag, int len);
 typedef void(*htmlstream_close_cb)(void *parg, const char *tag, int len);
@@ -24,6 +381,199 @@ typedef void(*htmlstream_attr_cb)(void *parg,
         const char *key, int key_len,
         const char *val, int val_len);
 typedef void(*htmlstream_text_cb)(void *parg, const char *text, int len);
+// text_part_cb gets a text node in pieces as it is scanned. final is set on the last one.
+typedef void(*htmlstream_text_part_cb)(void *parg, const char *text, int len, bool final);
+// comment_cb gets what is between <!-- and --> (or <? and >) in pieces, the same way
+typedef void(*htmlstream_comment_cb)(void *parg, const char *text, int len, bool final);
+// alloc_cb(parg, 0, size) returns a new block of size bytes, or 0 to keep truncating.
+// alloc_cb(parg, ptr, 0) releases a block it returned earlier (an arena may ignore that).
+typedef void *(*htmlstream_alloc_cb)(void *parg, void *ptr, int size);
+
+// elements whose content is text up to their end tag, whatever it looks like.
+// the default for htmlstream_t.rawtext_tags. lower case, 0 terminated
+static const char *const htmlstream_rawtext_default[] = {"script", "style", "textarea", "title", 0};
+// the raw text elements character references are decoded in (rcdata in html).
+// the default for htmlstream_t.rcdata_tags
+static const char *const htmlstream_rcdata_default[] = {"textarea", "title", 0};
+// elements that never have content or an end tag, for HTMLSTREAM_STACK and htmlstream_skip.
+// the same as HTMLSTREAM_TAG_VOID in htmlstream_names.h
+static const char *const htmlstream_void_tags[] = {"area", "base", "basefont", "br", "col", "embed",
+    "frame", "hr", "img", "input", "link", "meta", "param", "source", "track", "wbr", 0};
+
+#ifdef HTMLSTREAM_ENTITIES
+// all the html5 named character references, for HTMLSTREAM_DECODE
+#include "htmlstream_entities.h"
+#else
+// without them only these are decoded, the ones xml has and nbsp. laid out like
+// htmlstream_entities.h, names with their ; and without where html allows that
+#define HTMLSTREAM_ENTITY_COUNT 12
+#define HTMLSTREAM_ENTITY_LONGEST 32
+#define HTMLSTREAM_ENTITY_LEGACY_LONGEST 4
+static const char htmlstream_entity_names[] = "ampamp;ltlt;gtgt;quotquot;apos;nbspnbsp;";
+static const char htmlstream_entity_values[] = "&&<<>>\"\"'\xc2\xa0\xc2\xa0";
+static const unsigned short htmlstream_entity_name_at[HTMLSTREAM_ENTITY_COUNT] = {
+    0, 3, 7, 9, 12, 14, 17, 21, 26, 31, 35, 40};
+static const unsigned short htmlstream_entity_value_at[HTMLSTREAM_ENTITY_COUNT] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 13};
+#endif
+
+// perfect hash of the tables from htmlstream_names.py: fnv-1a, then the
+// displacement of its bucket picks the slot
+#define HTMLSTREAM_HASH_START 2166136261u
+#define HTMLSTREAM_HASH_STEP(h, c) (((h) ^ (unsigned char)(c)) * 16777619u)
+
+HTMLSTREAM_INLINE uint32_t htmlstream_internal_hash(const char *name, int len)
+{
+    uint32_t h = HTMLSTREAM_HASH_START;
+    for (int i = 0; i < len; i++) {
+        h = HTMLSTREAM_HASH_STEP(h, name[i]);
+    }
+    return h;
+}
+
+HTMLSTREAM_INLINE uint32_t htmlstream_internal_slot(uint32_t h, uint32_t d, int bits)
+{
+    return ((h ^ d * 0x9e3779b9u) * 0x85ebca6bu) >> (32 - bits);
+}
+
+// parser options for htmlstream_t.flags
+#define HTMLSTREAM_ZEROCOPY 1
+// decode character references (&amp; &#39; &eacute; ...) in text and attribute values.
+// not in comments, cdata or raw text other than rcdata_tags (textarea and title), like html
+#define HTMLSTREAM_DECODE   2
+// attribute values as they are written. tag and attribute names are still lower cased
+#define HTMLSTREAM_KEEP_CASE 4
+// check that what is fed is valid utf-8, see htmlstream_utf8_t. the bytes are passed on either way
+#define HTMLSTREAM_UTF8     8
+#ifdef HTMLSTREAM_ELEMENT_STACK
+// keep a stack of the open elements, see htmlstream_stack_t: every open_cb gets its close_cb,
+// the ones still open at the end with htmlstream_close_all. only there with HTMLSTREAM_ELEMENT_STACK
+// defined before including, the stack makes htmlstream_t about 1.5KB bigger
+#define HTMLSTREAM_STACK    16
+#define HTMLSTREAM_STACKED(t) ((t)->flags & HTMLSTREAM_STACK)
+#else
+#define HTMLSTREAM_STACKED(t) 0
+#endif
+// text as it is: not trimmed, and whitespace between tags is text too
+#define HTMLSTREAM_KEEP_SPACE 32
+
+// event tape record types
+#define HTMLSTREAM_EVENT_OPEN  1
+#define HTMLSTREAM_EVENT_CLOSE 2
+#define HTMLSTREAM_EVENT_ATTR  3    // the key. always followed by an EVENT_VALUE record
+#define HTMLSTREAM_EVENT_VALUE 4
+#define HTMLSTREAM_EVENT_TEXT  5
+#define HTMLSTREAM_EVENT_COMMENT 6  // a piece, only recorded if comment_cb is set
+
+// event tape record flags
+#define HTMLSTREAM_EVENT_NOVALUE 1  // VALUE of an attribute without =
+#define HTMLSTREAM_EVENT_PART    2  // TEXT piece from streaming (text_part_cb is set)
+#define HTMLSTREAM_EVENT_FINAL   4  // last TEXT piece of a streamed text node, or last COMMENT piece
+
+typedef struct
+{
+    unsigned char type;
+    unsigned char flags;
+    // the token is strings[offset..offset+len) of the tape
+    int offset;
+    int len;
+} htmlstream_event_t;
+
+// with htmlstream_t.tape set, events are appended here instead of going to the callbacks.
+// the caller provides both arrays and empties the tape with htmlstream_tape_clear.
+typedef struct
+{
+    htmlstream_event_t *events;
+    int events_size;
+    int count;
+    char *strings;
+    int strings_size;
+    int strings_at;
+    // an event did not fit. it and every later one were dropped
+    bool overflow;
+} htmlstream_tape_t;
+
+typedef struct
+{
+    char data[HTMLSTREAM_TAG_BUFFER_SIZE];
+    int at;
+    // grown storage from alloc_cb, used instead of data once set
+    char *heap;
+    int size;
+    // with HTMLSTREAM_ZEROCOPY, the token is span[0..at) in the fed chunk instead of data
+    const char *span;
+} htmlstream_buffer_t;
+
+// with HTMLSTREAM_UTF8, in htmlstream_t.utf8
+typedef struct
+{
+    // invalid sequences (stray bytes, overlong forms, surrogates, past U+10FFFF) so far
+    int invalid;
+    // continuation bytes the last sequence still needs, not 0 if the document ends in one.
+    // the next one has to be in lo..hi
+    int need;
+    unsigned char lo;
+    unsigned char hi;
+} htmlstream_utf8_t;
+
+#ifdef HTMLSTREAM_ELEMENT_STACK
+// with HTMLSTREAM_STACK: how many open elements are kept, and how many bytes their path takes
+#ifndef HTMLSTREAM_STACK_DEPTH
+#define HTMLSTREAM_STACK_DEPTH 64
+#endif
+#ifndef HTMLSTREAM_STACK_PATH
+#define HTMLSTREAM_STACK_PATH 1024
+#endif
+
+// with HTMLSTREAM_STACK, in htmlstream_t.stack: the elements that are open, in a fixed size
+// htmlstream_t keeps. callbacks see them with htmlstream_depth and htmlstream_path.
+// void elements and <x/> are closed where their open tag ends. an end tag closes the element
+// it names and everything opened inside it, one that names no open element is dropped
+typedef struct
+{
+    // how many elements are open. past HTMLSTREAM_STACK_DEPTH of them, or once a name does not
+    // fit into path, they are counted but not kept: any end tag that names no kept element
+    // closes one of them, and goes out as it is
+    int depth;
+    int kept;
+    // the kept ones' names, outermost first, separated by '/' and 0 terminated
+    char path[HTMLSTREAM_STACK_PATH + 1];
+    int path_len;
+    // where each name starts in path, and its hash
+    int at[HTMLSTREAM_STACK_DEPTH];
+    uint32_t hash[HTMLSTREAM_STACK_DEPTH];
+    // the innermost one is void (or <x/>) and is closed once its open tag is over
+    bool closing;
+} htmlstream_stack_t;
+#endif
+
+#ifdef HTMLSTREAM_STATS
+// with HTMLSTREAM_STATS defined, in htmlstream_t.stats. counts since htmlstream_init,
+// htmlstream_reset keeps them
+typedef struct
+{
+    // bytes looked at in each state. bytes looked at again after a replay count again
+    long long bytes[HTMLSTREAM_STATES];
+    // events callbacks (or the tape) got. texts and comments when they end
+    long long opens;
+    long long closes;
+    long long attrs;
+    long long texts;
+    long long comments;
+    // held back "<!-", "<![CDATA" or "</scri" that turned out not to be one and was fed again
+    long long replays;
+    // bytes dropped from tags, keys and values longer than their buffer
+    long long truncated;
+    // malformed input the parser recovered from: <<, <>, </>, a < where a > is missing, ...
+    long long recoveries;
+    // bytes parsed inside an element given to htmlstream_skip
+    long long skipped;
+} htmlstream_stats_t;
+
+#define HTMLSTREAM_STAT(t, counter, n) ((t)->stats.counter += (n))
+#else
+#define HTMLSTREAM_STAT(t, counter, n) ((void)0)
+#endif
 
 typedef struct
 {
@@ -31,34 +581,141 @@ typedef struct
     htmlstream_close_cb close_cb;
     htmlstream_attr_cb  attr_cb;
     htmlstream_text_cb  text_cb;
+    htmlstream_text_part_cb text_part_cb;
+    htmlstream_comment_cb comment_cb;
+    htmlstream_alloc_cb alloc_cb;
     void *parg;
+    int flags;
+    htmlstream_tape_t *tape;
+    const char *const *rawtext_tags;
+    const char *const *rcdata_tags;
 
     int state;
 
-    char tag_buffer[HTMLSTREAM_TAG_BUFFER_SIZE];
-    int tag_buffer_at;
-    char val_buffer[HTMLSTREAM_TAG_BUFFER_SIZE];
-    int val_buffer_at;
+    htmlstream_buffer_t tag;
+    htmlstream_buffer_t val;
 
     char quote;
     bool escaped;
 
-    int comment;
+    int ret;
+    int markup;
+    char entity[HTMLSTREAM_ENTITY_LONGEST];
+    // 1 + index in rawtext_tags of the element whose content this is (or, in its open tag, will be)
+    int rawtext;
+    // that element is in rcdata_tags too
+    bool rcdata;
+
+    // a part of the current text node went out through text_part_cb already
+    bool text_parted;
+    // how many bytes at the start of val are whitespace text_part_cb held back, so
+    // a long run of it is not looked through again for every byte that comes
+    int text_space;
+
+    // see htmlstream_skip: how many elements named skip_tag are open in the skipped one
+    // (itself included), 0 if not skipping. -1 after htmlstream_stop
+    int skip;
+    // in the open tag of one of them, and the byte before was a /
+    bool skip_open;
+    bool skip_slash;
+    int skip_len;
+    char skip_tag[HTMLSTREAM_TAG_BUFFER_SIZE];
+
+    htmlstream_utf8_t utf8;
+
+#ifdef HTMLSTREAM_ELEMENT_STACK
+    htmlstream_stack_t stack;
+#endif
+
+#ifdef HTMLSTREAM_STATS
+    htmlstream_stats_t stats;
+#endif
 
 } htmlstream_t;
 
+// c as it goes into an attribute value
+#define HTMLSTREAM_VAL_CASE(t, c) ((t)->flags & HTMLSTREAM_KEEP_CASE ? (c) : HTMLSTREAM_TOLOWER(c))
+
 
 static void htmlstream_init(htmlstream_t *t)
 {
     memset(t, 0, sizeof(htmlstream_t));
+    t->rawtext_tags = htmlstream_rawtext_default;
+    t->rcdata_tags  = htmlstream_rcdata_default;
+}
+
+// copy what the user set up (callbacks, flags, ...) but no parser state
+static void htmlstream_internal_config(htmlstream_t *to, const htmlstream_t *from)
+{
+    to->open_cb      = from->open_cb;
+    to->close_cb     = from->close_cb;
+    to->attr_cb      = from->attr_cb;
+    to->text_cb      = from->text_cb;
+    to->text_part_cb = from->text_part_cb;
+    to->comment_cb   = from->comment_cb;
+    to->alloc_cb     = from->alloc_cb;
+    to->parg         = from->parg;
+    to->flags        = from->flags;
+    to->tape         = from->tape;
+    to->rawtext_tags = from->rawtext_tags;
+    to->rcdata_tags  = from->rcdata_tags;
+}
+
+// start over with a new document. keeps callbacks, flags and grown buffers
+static inline void htmlstream_reset(htmlstream_t *t)
+{
+    htmlstream_t keep = *t;
+    htmlstream_init(t);
+    htmlstream_internal_config(t, &keep);
+    t->tag.heap = keep.tag.heap;
+    t->tag.size = keep.tag.size;
+    t->val.heap = keep.val.heap;
+    t->val.size = keep.val.size;
+#ifdef HTMLSTREAM_STATS
+    t->stats = keep.stats;
+#endif
+}
+
+#ifdef HTMLSTREAM_STATS
+static inline void htmlstream_stats_add(htmlstream_stats_t *to, const htmlstream_stats_t *from)
+{
+    for (int i = 0; i < HTMLSTREAM_STATES; i++) {
+        to->bytes[i] += from->bytes[i];
+    }
+    to->opens      += from->opens;
+    to->closes     += from->closes;
+    to->attrs      += from->attrs;
+    to->texts      += from->texts;
+    to->comments   += from->comments;
+    to->replays    += from->replays;
+    to->truncated  += from->truncated;
+    to->recoveries += from->recoveries;
+    to->skipped    += from->skipped;
+}
+#endif
+
+// release buffers grown through alloc_cb. t can be fed again afterwards.
+static inline void htmlstream_free(htmlstream_t *t)
+{
+    htmlstream_buffer_t *buffers[] = {&t->tag, &t->val};
+    for (int i = 0; i < 2; i++) {
+        htmlstream_buffer_t *b = buffers[i];
+        if (b->heap && t->alloc_cb) {
+            t->alloc_cb(t->parg, b->heap, 0);
+        }
+        b->heap = 0;
+        b->size = 0;
+        b->span = 0;
+        b->at   = 0;
+    }
 }
 
-static char *htmlstream_trimwhitespace(char *in, int *len)
+static const char *htmlstream_trimwhitespace(const char *in, int *len)
 {
     int nustart = 0;
     int nulen   = *len;
     for (int i = 0; i < *len ; i++) {
-        if (isspace(in[i])) {
+        if (HTMLSTREAM_ISSPACE(in[i])) {
             ++nustart;
             --nulen;
         } else {
@@ -66,7 +723,7 @@ static char *htmlstream_trimwhitespace(char *in, int *len)
         }
     }
     for (int i = (*len - 1); i > 0; i--) {
-        if (isspace(in[i])) {
+        if (HTMLSTREAM_ISSPACE(in[i])) {
             --nulen;
         } else {
             break;
@@ -80,352 +737,2039 @@ static char *htmlstream_trimwhitespace(char *in, int *len)
     return in + nustart;
 }
 
-static void htmlstream_internal_feed(htmlstream_t *t, const char c)
+static void htmlstream_buffer_reset(htmlstream_buffer_t *b)
 {
-    switch (t->state) {
-        case HTMLSTREAM_STATE_TEXT:
-            if (c == '<') {
-                t->state = HTMLSTREAM_STATE_TAG_START;
-                //trim
-
-                if (t->text_cb) {
-                    char *nu = htmlstream_trimwhitespace(t->val_buffer, &t->val_buffer_at);
-                    if (t->val_buffer_at) {
-                        t->text_cb(t->parg, nu, t->val_buffer_at);
-                    }
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else {
-                if (t->val_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                    t->val_buffer[t->val_buffer_at++] = c;
-                }
-            }
-            break;
-        case HTMLSTREAM_STATE_TAG_START:
-            if (c == '<') {
-                //trash = <<
-            } else if (c == '>') {
-                //trash = <>
-                t->state = HTMLSTREAM_STATE_TEXT;
-                t->val_buffer_at = 0;
-            } else if (c == '/') {
-                t->state = HTMLSTREAM_STATE_TAG_START_SLASH;
-            } else if (isspace(c)) {
-                return;
-            } else {
-                t->state = HTMLSTREAM_STATE_OPENING_TAG;
-                t->tag_buffer[0] = tolower(c);
-                t->tag_buffer_at = 1;
-            }
-            break;
-        case HTMLSTREAM_STATE_OPENING_TAG:
-            if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                if (t->open_cb) {
-                    t->open_cb(t->parg, t->tag_buffer, t->tag_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (isspace(c)) {
-                t->state = HTMLSTREAM_STATE_OPENING_TAG_END;
-                if (t->open_cb) {
-                    t->open_cb(t->parg, t->tag_buffer, t->tag_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else {
-                if (t->tag_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                    t->tag_buffer[t->tag_buffer_at++] = tolower(c);
-                }
-            }
-            break;
-        case HTMLSTREAM_STATE_TAG_START_SLASH:
-            if (c == '>') {
-                //trash: </>
-                t->state = HTMLSTREAM_STATE_TEXT;
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '<') {
-                //trash: </<
-                t->state = HTMLSTREAM_STATE_TAG_START;
-            } else if (isspace(c)) {
-                return;
-            } else{
-                t->state = HTMLSTREAM_STATE_CLOSING_TAG;
-                t->tag_buffer[0] = tolower(c);
-                t->tag_buffer_at = 1;
-            }
-            break;
-        case HTMLSTREAM_STATE_CLOSING_TAG:
-            if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                if (t->close_cb) {
-                    t->close_cb(t->parg, t->tag_buffer, t->tag_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '<') {
-                //probably missing > of end tag = </ bla<
-                t->state = HTMLSTREAM_STATE_TAG_START;
-                if (t->close_cb) {
-                    t->close_cb(t->parg, t->tag_buffer, t->tag_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (isspace(c)) {
-                t->state = HTMLSTREAM_STATE_OPENING_TAG_END;
-                if (t->close_cb) {
-                    t->close_cb(t->parg, t->tag_buffer, t->tag_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else {
-                if (t->tag_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                    t->tag_buffer[t->tag_buffer_at++] = tolower(c);
-                }
-            }
-            break;
-        case HTMLSTREAM_STATE_OPENING_TAG_END:
-            if (c == '<') {
-                //missing >  before <
-                t->state = HTMLSTREAM_STATE_TAG_START;
-            } else if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (isspace(c)) {
-                return;
-            } else if (c == '/') {
-                //thrash
-            } else if (c == '\'' || c == '"') {
-                t->state = HTMLSTREAM_STATE_ATTR_KEY_QUOTE;
-                t->quote = c;
-                t->tag_buffer_at = 0;
-            } else {
-                t->state = HTMLSTREAM_STATE_ATTR_KEY;
-                t->tag_buffer[0] = tolower(c);
-                t->tag_buffer_at = 1;
-            }
-            break;
-        case HTMLSTREAM_STATE_ATTR_KEY:
-            if (c == '<') {
-                t->state = HTMLSTREAM_STATE_TAG_START;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (isspace(c)) {
-                t->state = HTMLSTREAM_STATE_ATTR_KEY_END;
-            } else if (c == '\'' || c == '"') {
-                t->state = HTMLSTREAM_STATE_ATTR_KEY_QUOTE;
-                t->quote = c;
-            } else if (c == '=') {
-                t->state = HTMLSTREAM_STATE_ATTR_EQ;
-            } else {
-                if (t->tag_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                    t->tag_buffer[t->tag_buffer_at++] = tolower(c);
-                }
-            }
-            break;
-        case HTMLSTREAM_STATE_ATTR_KEY_QUOTE:
-            if (c == '\\') {
-                t->escaped = true;
-            } else {
-                if (c == t->quote && !t->escaped) {
-                    t->state = HTMLSTREAM_STATE_ATTR_KEY;
-                } else {
-                    if (t->tag_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                        t->tag_buffer[t->tag_buffer_at++] = tolower(c);
-                    }
-                }
-                t->escaped = false;
-            }
-            break;
+    b->at = 0;
+    b->span = 0;
+}
 
-        case HTMLSTREAM_STATE_ATTR_KEY_END:
-            if (c == '<') {
-                t->state = HTMLSTREAM_STATE_TAG_START;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (isspace(c)) {
-            } else if (c == '=') {
-                t->state = HTMLSTREAM_STATE_ATTR_EQ;
-            } else if (c == '\'' || c == '"') {
-                t->state = HTMLSTREAM_STATE_ATTR_KEY_QUOTE;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->quote = c;
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else {
-                t->state = HTMLSTREAM_STATE_ATTR_KEY;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer[0] = tolower(c);
-                t->tag_buffer_at = 1;
+static const char *htmlstream_buffer_get(const htmlstream_buffer_t *b)
+{
+    return b->span ? b->span : b->heap ? b->heap : b->data;
+}
+
+static char *htmlstream_buffer_data(htmlstream_buffer_t *b)
+{
+    return b->heap ? b->heap : b->data;
+}
+
+static int htmlstream_buffer_size(const htmlstream_buffer_t *b)
+{
+    return b->heap ? b->size : HTMLSTREAM_TAG_BUFFER_SIZE;
+}
+
+// how long a token may get. unbounded when it can grow through alloc_cb
+static int htmlstream_buffer_limit(const htmlstream_t *t, const htmlstream_buffer_t *b)
+{
+    return t->alloc_cb ? 0x7fffffff : htmlstream_buffer_size(b);
+}
+
+// make room for n more bytes, growing through alloc_cb if needed.
+// returns how many of them fit.
+static int htmlstream_buffer_reserve(htmlstream_t *t, htmlstream_buffer_t *b, int n)
+{
+    int size = htmlstream_buffer_size(b);
+    if (n > size - b->at && t->alloc_cb) {
+        int nusize = size * 2;
+        if (nusize - b->at < n) {
+            nusize = b->at + n;
+        }
+        char *nu = (char *)t->alloc_cb(t->parg, 0, nusize);
+        if (nu) {
+            memcpy(nu, htmlstream_buffer_data(b), b->at);
+            if (b->heap) {
+                t->alloc_cb(t->parg, b->heap, 0);
             }
-            break;
-        case HTMLSTREAM_STATE_ATTR_EQ:
-            if (c == '<') {
-                t->state = HTMLSTREAM_STATE_TAG_START;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at, 0, 0);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '=') {
-            } else if (isspace(c)) {
-            } else if (c == '\'' || c == '"') {
-                t->state = HTMLSTREAM_STATE_ATTR_VAL_QUOTE;
-                t->val_buffer_at = 0;
-                t->quote = c;
+            b->heap = nu;
+            b->size = nusize;
+            size    = nusize;
+        }
+    }
+    if (n > size - b->at) {
+        HTMLSTREAM_STAT(t, truncated, n - (size - b->at));
+        n = size - b->at;
+    }
+    return n;
+}
+
+// copy a zero copy token into the buffer, so it survives the end of the chunk
+static void htmlstream_buffer_unspan(htmlstream_t *t, htmlstream_buffer_t *b)
+{
+    if (b->span) {
+        const char *span = b->span;
+        int len = b->at;
+        b->span = 0;
+        b->at   = 0;
+        len = htmlstream_buffer_reserve(t, b, len);
+        memcpy(htmlstream_buffer_data(b), span, len);
+        b->at = len;
+    }
+}
+
+// src is where c was read from in the fed chunk, or 0 if c is not in there as is
+static void htmlstream_buffer_push(htmlstream_t *t, htmlstream_buffer_t *b,
+        char c, const char *src)
+{
+    if (b->span) {
+        if (src == b->span + b->at && *src == c) {
+            if (b->at < htmlstream_buffer_limit(t, b)) {
+                b->at++;
             } else {
-                t->state = HTMLSTREAM_STATE_ATTR_VAL;
-                t->val_buffer[0] = tolower(c);
-                t->val_buffer_at = 1;
+                HTMLSTREAM_STAT(t, truncated, 1);
             }
-            break;
-        case HTMLSTREAM_STATE_ATTR_VAL:
-            if (c == '<') {
-                t->state = HTMLSTREAM_STATE_TAG_START;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at,
-                            t->val_buffer, t->val_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '>') {
-                t->state = HTMLSTREAM_STATE_TEXT;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at,
-                            t->val_buffer, t->val_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '/') {
-                //thrash
-            } else if (isspace(c)) {
-                t->state = HTMLSTREAM_STATE_OPENING_TAG_END;
-                if (t->attr_cb) {
-                    t->attr_cb(t->parg, t->tag_buffer, t->tag_buffer_at,
-                            t->val_buffer, t->val_buffer_at);
-                }
-                t->tag_buffer_at = 0;
-                t->val_buffer_at = 0;
-            } else if (c == '\'' || c == '"') {
-                t->state = HTMLSTREAM_STATE_ATTR_VAL_QUOTE;
-                t->quote = c;
-            } else {
-                if (t->val_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                    t->val_buffer[t->val_buffer_at++] = tolower(c);
-                }
+            return;
+        }
+        htmlstream_buffer_unspan(t, b);
+    } else if (b->at == 0 && src && *src == c && (t->flags & HTMLSTREAM_ZEROCOPY)) {
+        b->span = src;
+        b->at = 1;
+        return;
+    }
+    if (htmlstream_buffer_reserve(t, b, 1)) {
+        htmlstream_buffer_data(b)[b->at++] = c;
+    }
+}
+
+// index of the first byte that is a, b, c or d, or len if there is none
+HTMLSTREAM_INLINE int htmlstream_scan(const char *data, int len, char a, char b, char c, char d)
+{
+    int i = 0;
+#ifdef HTMLSTREAM_SIMD_AVX2
+    const __m256i wa = _mm256_set1_epi8(a);
+    const __m256i wb = _mm256_set1_epi8(b);
+    const __m256i wc = _mm256_set1_epi8(c);
+    const __m256i wd = _mm256_set1_epi8(d);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, wa), _mm256_cmpeq_epi8(v, wb)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, wc), _mm256_cmpeq_epi8(v, wd)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#ifdef HTMLSTREAM_SIMD_SSE2
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vd = _mm_set1_epi8(d);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (data[i] == a || data[i] == b || data[i] == c || data[i] == d) {
+            return i;
+        }
+    }
+    return len;
+}
+
+// index of the first byte past ascii, or len if there is none
+HTMLSTREAM_INLINE int htmlstream_ascii(const char *data, int len)
+{
+    int i = 0;
+#ifdef HTMLSTREAM_SIMD_AVX2
+    for (; i + 32 <= len; i += 32) {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(data + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#ifdef HTMLSTREAM_SIMD_SSE2
+    for (; i + 16 <= len; i += 16) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (data[i] & 0x80) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef HTMLSTREAM_SIMD_AVX2
+#define HTMLSTREAM_U8_TABLE(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+// if the 32 bytes at data are valid utf-8 (after complete sequences), how many of them are, up to
+// a sequence cut off at the end. 0 if not. the lookup method of keiser and lemire: the high nibble
+// of a byte, the low nibble of the one before and the high nibble of the one before that each give
+// a set of errors they could be part of. the errors are what is in all three
+HTMLSTREAM_INLINE int htmlstream_utf8_block(const char *data)
+{
+    enum {
+        U8_TOO_SHORT = 1, U8_TOO_LONG = 2, U8_OVERLONG_3 = 4, U8_TOO_LARGE = 8, U8_SURROGATE = 16,
+        U8_OVERLONG_2 = 32, U8_TOO_LARGE_1000 = 64, U8_OVERLONG_4 = 64, U8_TWO_CONTS = 128,
+        U8_CARRY = U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS
+    };
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i v = _mm256_loadu_si256((const __m256i *)data);
+    if (!_mm256_movemask_epi8(v)) {
+        return 32;
+    }
+    // the bytes 1, 2 and 3 before, zeros (as good as complete) before data
+    __m256i before = _mm256_permute2x128_si256(v, v, 0x08);
+    __m256i prev1 = _mm256_alignr_epi8(v, before, 15);
+    __m256i prev2 = _mm256_alignr_epi8(v, before, 14);
+    __m256i prev3 = _mm256_alignr_epi8(v, before, 13);
+    __m256i byte1_high = _mm256_shuffle_epi8(HTMLSTREAM_U8_TABLE(
+            U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+            U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+            U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+            U8_TOO_SHORT | U8_OVERLONG_2,
+            U8_TOO_SHORT,
+            U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+            U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4),
+            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte1_low = _mm256_shuffle_epi8(HTMLSTREAM_U8_TABLE(
+            U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+            U8_CARRY | U8_OVERLONG_2,
+            U8_CARRY,
+            U8_CARRY,
+            U8_CARRY | U8_TOO_LARGE,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+            U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+            _mm256_and_si256(prev1, nibble));
+    __m256i byte2_high = _mm256_shuffle_epi8(HTMLSTREAM_U8_TABLE(
+            U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+            U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+            U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+            U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+            U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+            U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+            U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT),
+            _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte1_high, byte1_low), byte2_high);
+    // a third or fourth byte has to be a continuation, which is where U8_TWO_CONTS is fine
+    __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80))),
+            _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80))));
+    __m256i error = _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8((char)0x80)), special);
+    if (!_mm256_testz_si256(error, error)) {
+        return 0;
+    }
+    // a lead byte in the last three that needs more than is left
+    const unsigned char *end = (const unsigned char *)data + 32;
+    return end[-1] >= 0xc0 ? 31 : end[-2] >= 0xe0 ? 30 : end[-3] >= 0xf0 ? 29 : 32;
+}
+#undef HTMLSTREAM_U8_TABLE
+#endif
+
+// validate the next len bytes. ascii goes by in bulk, and with avx2 so does valid utf-8.
+// the rest, around invalid sequences, byte by byte
+static void htmlstream_internal_utf8_check(htmlstream_utf8_t *u, const char *data, int len)
+{
+    int need = u->need;
+    unsigned char lo = u->lo;
+    unsigned char hi = u->hi;
+    int i = 0;
+#ifdef HTMLSTREAM_SIMD_AVX2
+    int checked = 0;
+#endif
+    while (i < len) {
+        unsigned char c = (unsigned char)data[i];
+        if (need) {
+            if (c < lo || c > hi) {
+                // cut short. c starts over
+                u->invalid++;
+                need = 0;
+                continue;
             }
-            break;
-        case HTMLSTREAM_STATE_ATTR_VAL_QUOTE:
-            if (c == '\\') {
-                t->escaped = true;
-            } else {
-                if (c == t->quote && !t->escaped) {
-                    t->state = HTMLSTREAM_STATE_ATTR_VAL;
-                } else {
-                    if (t->val_buffer_at < HTMLSTREAM_TAG_BUFFER_SIZE) {
-                        t->val_buffer[t->val_buffer_at++] = tolower(c);
-                    }
-                }
-                t->escaped = false;
+            need--;
+            lo = 0x80;
+            hi = 0xbf;
+            i++;
+            continue;
+        }
+#ifdef HTMLSTREAM_SIMD_AVX2
+        if (i >= checked && i + 32 <= len) {
+            int n = htmlstream_utf8_block(data + i);
+            if (n) {
+                i += n;
+                continue;
             }
-            break;
+            // something is wrong in there, look closer
+            checked = i + 32;
+        }
+#endif
+        if (c < 0x80) {
+            i += htmlstream_ascii(data + i, len - i);
+            continue;
+        }
+        i++;
+        lo = 0x80;
+        hi = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            need = 1;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            // no overlong forms, no surrogates
+            need = 2;
+            lo = c == 0xe0 ? 0xa0 : 0x80;
+            hi = c == 0xed ? 0x9f : 0xbf;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            // no overlong forms, nothing past U+10FFFF
+            need = 3;
+            lo = c == 0xf0 ? 0x90 : 0x80;
+            hi = c == 0xf4 ? 0x8f : 0xbf;
+        } else {
+            u->invalid++;
+        }
     }
+    u->need = need;
+    u->lo   = lo;
+    u->hi   = hi;
 }
 
-//TODO find comments and shit
-static void htmlstream_feed(htmlstream_t *t, const char *data, int len)
+static void htmlstream_buffer_append(htmlstream_t *t, htmlstream_buffer_t *b,
+        const char *data, int len, bool lower)
 {
-    for (int i = 0; i < len; i++) {
-        char c = data[i];
-        switch (t->comment) {
-            case 0:
-                if (c == '<') {
-                    t->comment = 1;
-                    continue;
-                }
+    int room = htmlstream_buffer_limit(t, b) - b->at;
+    if (len < room) {
+        room = len;
+    }
+    if (room < 1) {
+        HTMLSTREAM_STAT(t, truncated, len);
+        return;
+    }
+    HTMLSTREAM_STAT(t, truncated, len - room);
+    bool verbatim = true;
+    if (lower) {
+        for (int i = 0; i < room; i++) {
+            if (HTMLSTREAM_TOLOWER(data[i]) != data[i]) {
+                verbatim = false;
                 break;
-            case 1:
-                if (c == '!') {
-                    t->comment = 2;
-                    continue;
+            }
+        }
+    }
+    if (verbatim) {
+        if (b->span && data == b->span + b->at) {
+            b->at += room;
+            return;
+        }
+        if (!b->span && b->at == 0 && (t->flags & HTMLSTREAM_ZEROCOPY)) {
+            b->span = data;
+            b->at = room;
+            return;
+        }
+    }
+    htmlstream_buffer_unspan(t, b);
+    room = htmlstream_buffer_reserve(t, b, room);
+    char *to = htmlstream_buffer_data(b) + b->at;
+    if (lower) {
+        for (int i = 0; i < room; i++) {
+            to[i] = HTMLSTREAM_TOLOWER(data[i]);
+        }
+    } else {
+        memcpy(to, data, room);
+    }
+    b->at += room;
+}
+
+static inline void htmlstream_tape_clear(htmlstream_tape_t *tape)
+{
+    tape->count      = 0;
+    tape->strings_at = 0;
+    tape->overflow   = false;
+}
+
+// append n records, the i-th holding str[i][0..len[i]). all of them or none
+static void htmlstream_tape_put(htmlstream_tape_t *tape, int n, const int *type, const int *flags,
+        const char *const *str, const int *len)
+{
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += len[i];
+    }
+    if (tape->overflow ||
+            tape->events_size - tape->count < n ||
+            tape->strings_size - tape->strings_at < total) {
+        tape->overflow = true;
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        htmlstream_event_t *e = &tape->events[tape->count++];
+        e->type   = (unsigned char)type[i];
+        e->flags  = (unsigned char)flags[i];
+        e->offset = tape->strings_at;
+        e->len    = len[i];
+        if (len[i]) {
+            memcpy(tape->strings + tape->strings_at, str[i], len[i]);
+        }
+        tape->strings_at += len[i];
+    }
+}
+
+// call t's callbacks for every event on the tape, as if t had parsed it without one
+static inline void htmlstream_tape_replay(const htmlstream_tape_t *tape, const htmlstream_t *t)
+{
+    for (int i = 0; i < tape->count; i++) {
+        const htmlstream_event_t *e = &tape->events[i];
+        const char *str = tape->strings + e->offset;
+        switch (e->type) {
+            case HTMLSTREAM_EVENT_OPEN:
+                if (t->open_cb) {
+                    t->open_cb(t->parg, str, e->len);
                 }
                 break;
-            case 2:
-                if (c == '-') {
-                    t->comment = 3;
-                    continue;
+            case HTMLSTREAM_EVENT_CLOSE:
+                if (t->close_cb) {
+                    t->close_cb(t->parg, str, e->len);
                 }
                 break;
-            case 3:
-                if (c == '-') {
-                    t->comment = 4;
-                    continue;
+            case HTMLSTREAM_EVENT_ATTR:
+                if (i + 1 < tape->count) {
+                    const htmlstream_event_t *v = &tape->events[++i];
+                    if (t->attr_cb) {
+                        if (v->flags & HTMLSTREAM_EVENT_NOVALUE) {
+                            t->attr_cb(t->parg, str, e->len, 0, 0);
+                        } else {
+                            t->attr_cb(t->parg, str, e->len, tape->strings + v->offset, v->len);
+                        }
+                    }
                 }
                 break;
-            case 4:
-                if (c == '-') {
-                    t->comment = 5;
-                } else {
-                    t->comment = 4;
+            case HTMLSTREAM_EVENT_COMMENT:
+                if (t->comment_cb) {
+                    t->comment_cb(t->parg, str, e->len, (e->flags & HTMLSTREAM_EVENT_FINAL) != 0);
                 }
-                continue;
                 break;
-            case 5:
-                if (c == '-') {
-                    t->comment = 6;
-                } else {
-                    t->comment = 4;
-                }
-                continue;
-            case 6:
-                if (c == '>') {
-                    t->comment = 0;
-                } else {
-                    t->comment = 4;
+            case HTMLSTREAM_EVENT_TEXT:
+                if (e->flags & HTMLSTREAM_EVENT_PART) {
+                    if (t->text_part_cb) {
+                        t->text_part_cb(t->parg, str, e->len, (e->flags & HTMLSTREAM_EVENT_FINAL) != 0);
+                    }
+                } else if (t->text_cb) {
+                    t->text_cb(t->parg, str, e->len);
                 }
-                continue;
                 break;
         }
-        //was not comment
-        const char *backfeed = "<!-";
-        for (int i = 0; i < t->comment; i++) {
-            htmlstream_internal_feed(t, backfeed[i]);
+    }
+}
+
+// event output: to the tape if there is one, else to the callbacks
+static void htmlstream_internal_tag(htmlstream_t *t, int type, const char *tag, int len)
+{
+    if (t->tape || (type == HTMLSTREAM_EVENT_OPEN ? t->open_cb != 0 : t->close_cb != 0)) {
+        HTMLSTREAM_STAT(t, opens, type == HTMLSTREAM_EVENT_OPEN);
+        HTMLSTREAM_STAT(t, closes, type != HTMLSTREAM_EVENT_OPEN);
+    }
+    if (t->tape) {
+        int flags = 0;
+        htmlstream_tape_put(t->tape, 1, &type, &flags, &tag, &len);
+    } else if (type == HTMLSTREAM_EVENT_OPEN) {
+        if (t->open_cb) {
+            t->open_cb(t->parg, tag, len);
         }
-        t->comment = 0;
-        htmlstream_internal_feed(t, c);
+    } else if (t->close_cb) {
+        t->close_cb(t->parg, tag, len);
+    }
+}
+
+static void htmlstream_internal_attr(htmlstream_t *t, bool value)
+{
+    const char *key = htmlstream_buffer_get(&t->tag);
+    const char *val = value ? htmlstream_buffer_get(&t->val) : 0;
+    int val_len     = value ? t->val.at : 0;
+    HTMLSTREAM_STAT(t, attrs, t->tape || t->attr_cb);
+    if (t->tape) {
+        int type[2]  = {HTMLSTREAM_EVENT_ATTR, HTMLSTREAM_EVENT_VALUE};
+        int flags[2] = {0, value ? 0 : HTMLSTREAM_EVENT_NOVALUE};
+        const char *str[2] = {key, val};
+        int len[2] = {t->tag.at, val_len};
+        htmlstream_tape_put(t->tape, 2, type, flags, str, len);
+    } else if (t->attr_cb) {
+        t->attr_cb(t->parg, key, t->tag.at, val, val_len);
+    }
+}
+
+static void htmlstream_internal_text(htmlstream_t *t, const char *text, int len)
+{
+    HTMLSTREAM_STAT(t, texts, t->tape || t->text_cb);
+    if (t->tape) {
+        int type  = HTMLSTREAM_EVENT_TEXT;
+        int flags = 0;
+        htmlstream_tape_put(t->tape, 1, &type, &flags, &text, &len);
+    } else if (t->text_cb) {
+        t->text_cb(t->parg, text, len);
+    }
+}
+
+static void htmlstream_internal_part(htmlstream_t *t, const char *text, int len, bool final)
+{
+    HTMLSTREAM_STAT(t, texts, final);
+    if (t->tape) {
+        int type  = HTMLSTREAM_EVENT_TEXT;
+        int flags = HTMLSTREAM_EVENT_PART | (final ? HTMLSTREAM_EVENT_FINAL : 0);
+        htmlstream_tape_put(t->tape, 1, &type, &flags, &text, &len);
+    } else {
+        t->text_part_cb(t->parg, text, len, final);
     }
 }
+
+static void htmlstream_internal_comment(htmlstream_t *t, const char *text, int len, bool final)
+{
+    if (!t->comment_cb) {
+        return;
+    }
+    HTMLSTREAM_STAT(t, comments, final);
+    if (t->tape) {
+        int type  = HTMLSTREAM_EVENT_COMMENT;
+        int flags = HTMLSTREAM_EVENT_PART | (final ? HTMLSTREAM_EVENT_FINAL : 0);
+        htmlstream_tape_put(t->tape, 1, &type, &flags, &text, &len);
+    } else {
+        t->comment_cb(t->parg, text, len, final);
+    }
+}
+
+// streaming text: hand out what is buffered so far, keeping back trailing
+// whitespace that may still turn out to be the end of the text node. more:
+// the next byte of the node is not whitespace, so nothing needs keeping back
+static void htmlstream_internal_text_part(htmlstream_t *t, bool more)
+{
+    htmlstream_buffer_t *b = &t->val;
+    const char *text = htmlstream_buffer_get(b);
+    int start = 0;
+    int end   = b->at;
+    bool keep = t->flags & HTMLSTREAM_KEEP_SPACE;
+    if (!t->text_parted && !keep) {
+        while (start < end && HTMLSTREAM_ISSPACE(text[start])) {
+            ++start;
+        }
+    }
+    if (!more && !keep) {
+        int low = t->text_space < start ? start : t->text_space < end ? t->text_space : end;
+        while (end > low && HTMLSTREAM_ISSPACE(text[end - 1])) {
+            --end;
+        }
+        if (end == low) {
+            end = start;
+        }
+    }
+    if (end == start) {
+        if (!t->text_parted) {
+            //nothing but leading whitespace
+            htmlstream_buffer_reset(b);
+            return;
+        }
+        //nothing but whitespace: it goes out with whatever comes after it, if anything does
+        t->text_space = b->at;
+        return;
+    }
+    htmlstream_internal_part(t, text + start, end - start, false);
+    t->text_parted = true;
+    if (b->span) {
+        b->span += end;
+    } else {
+        memmove(htmlstream_buffer_data(b), text + end, b->at - end);
+    }
+    b->at -= end;
+    t->text_space = b->at;
+}
+
+static void htmlstream_internal_text_end(htmlstream_t *t)
+{
+    int len = t->val.at;
+    const char *text = htmlstream_buffer_get(&t->val);
+    bool keep = t->flags & HTMLSTREAM_KEEP_SPACE;
+    if (t->text_parted) {
+        while (len > 0 && !keep && HTMLSTREAM_ISSPACE(text[len - 1])) {
+            --len;
+        }
+        htmlstream_internal_part(t, text, len, true);
+        t->text_parted = false;
+        t->text_space = 0;
+    } else {
+        if (!keep) {
+            text = htmlstream_trimwhitespace(text, &len);
+        }
+        if (len) {
+            htmlstream_internal_part(t, text, len, true);
+        }
+    }
+}
+
+// handlers of a parser specialized with HTMLSTREAM_SPECIALIZE. the internal
+// functions take one of these, or 0 for the callbacks (and tape) in htmlstream_t.
+typedef struct
+{
+    htmlstream_open_cb  open_cb;
+    htmlstream_close_cb close_cb;
+    htmlstream_attr_cb  attr_cb;
+    htmlstream_text_cb  text_cb;
+} htmlstream_spec_t;
+
+// which buffers are worth filling. constant for a specialized parser
+#define HTMLSTREAM_WANT_TAG(s)  (!(s) || (s)->open_cb || (s)->close_cb || (s)->attr_cb)
+#define HTMLSTREAM_WANT_VAL(s)  (!(s) || (s)->attr_cb)
+#define HTMLSTREAM_WANT_TEXT(s) (!(s) || (s)->text_cb)
+// open tag names are needed anyway, to see raw text elements, and close tag names to end a skip
+#define HTMLSTREAM_WANT_NAME(s, t) (HTMLSTREAM_WANT_TAG(s) || (t)->state == HTMLSTREAM_STATE_OPENING_TAG || \
+        (((s) == &htmlstream_skip_spec || HTMLSTREAM_STACKED(t)) && (t)->state == HTMLSTREAM_STATE_CLOSING_TAG))
+
+// 1 + index of the name in b in names (lower case, 0 terminated), or 0
+HTMLSTREAM_INLINE int htmlstream_internal_find(const char *const *names, const htmlstream_buffer_t *b)
+{
+    if (!names || b->at == 0) {
+        return 0;
+    }
+    const char *tag = htmlstream_buffer_get(b);
+    char first = HTMLSTREAM_ASCII_LOWER(tag[0]);
+    for (int k = 0; names[k]; k++) {
+        const char *name = names[k];
+        if (name[0] != first) {
+            continue;
+        }
+        int i = 1;
+        while (i < b->at && name[i] && HTMLSTREAM_ASCII_LOWER(tag[i]) == name[i]) {
+            i++;
+        }
+        if (i == b->at && !name[i]) {
+            return k + 1;
+        }
+    }
+    return 0;
+}
+
+// the spec skipped elements are parsed with. nothing is emitted, only tag names are buffered
+static const htmlstream_spec_t htmlstream_skip_spec = {0, 0, 0, 0};
+
+// an open or close tag inside the skipped element
+static void htmlstream_internal_skip_tag(htmlstream_t *t, int type)
+{
+    const char *tag = htmlstream_buffer_get(&t->tag);
+    if (t->tag.at != t->skip_len) {
+        return;
+    }
+    for (int i = 0; i < t->skip_len; i++) {
+        if (HTMLSTREAM_ASCII_LOWER(tag[i]) != t->skip_tag[i]) {
+            return;
+        }
+    }
+    if (type == HTMLSTREAM_EVENT_OPEN) {
+        t->skip++;
+        t->skip_open = true;
+    } else {
+        t->skip--;
+    }
+}
+
+HTMLSTREAM_INLINE void htmlstream_internal_emit_tag(htmlstream_t *t, int type, const char *tag, int len,
+        const htmlstream_spec_t *s)
+{
+    if (!s) {
+        htmlstream_internal_tag(t, type, tag, len);
+        return;
+    }
+    htmlstream_open_cb cb = type == HTMLSTREAM_EVENT_OPEN ? s->open_cb : s->close_cb;
+    if (cb) {
+        HTMLSTREAM_STAT(t, opens, type == HTMLSTREAM_EVENT_OPEN);
+        HTMLSTREAM_STAT(t, closes, type != HTMLSTREAM_EVENT_OPEN);
+        cb(t->parg, tag, len);
+    }
+}
+
+#ifdef HTMLSTREAM_ELEMENT_STACK
+// with HTMLSTREAM_STACK: an element opens
+static void htmlstream_internal_stack_push(htmlstream_t *t, const char *name, int len)
+{
+    htmlstream_stack_t *k = &t->stack;
+    int sep = k->kept > 0;
+    if (k->kept == k->depth && k->kept < HTMLSTREAM_STACK_DEPTH &&
+            k->path_len + sep + len <= HTMLSTREAM_STACK_PATH) {
+        k->path[k->path_len] = '/';
+        k->path_len += sep;
+        k->at[k->kept]   = k->path_len;
+        k->hash[k->kept] = htmlstream_internal_hash(name, len);
+        memcpy(k->path + k->path_len, name, len);
+        k->path_len += len;
+        k->path[k->path_len] = 0;
+        k->kept++;
+    }
+    k->depth++;
+}
+
+// close the innermost element. one that is not kept gets an empty name
+static void htmlstream_internal_stack_pop(htmlstream_t *t, const htmlstream_spec_t *s)
+{
+    htmlstream_stack_t *k = &t->stack;
+    if (k->depth > k->kept) {
+        htmlstream_internal_emit_tag(t, HTMLSTREAM_EVENT_CLOSE, "", 0, s);
+        k->depth--;
+        return;
+    }
+    // still on the stack while close_cb runs
+    int at = k->at[k->kept - 1];
+    htmlstream_internal_emit_tag(t, HTMLSTREAM_EVENT_CLOSE, k->path + at, k->path_len - at, s);
+    k->depth--;
+    k->kept--;
+    k->path_len = at > 0 ? at - 1 : 0;
+    k->path[k->path_len] = 0;
+}
+
+static void htmlstream_internal_stack_tag(htmlstream_t *t, int type, const htmlstream_spec_t *s)
+{
+    htmlstream_stack_t *k = &t->stack;
+    const char *tag = htmlstream_buffer_get(&t->tag);
+    int len = t->tag.at;
+    // the void element before did not get its >, this < ends it
+    if (k->closing) {
+        k->closing = false;
+        htmlstream_internal_stack_pop(t, s);
+    }
+    if (type == HTMLSTREAM_EVENT_OPEN) {
+        int name_len = len > 1 && tag[len - 1] == '/' ? len - 1 : len;
+        htmlstream_internal_stack_push(t, tag, name_len);
+        htmlstream_internal_emit_tag(t, type, tag, len, s);
+        // if open_cb skipped it, it closes where the skip ends
+        k->closing = !t->skip && (name_len < len || htmlstream_internal_find(htmlstream_void_tags, &t->tag));
+        return;
+    }
+    uint32_t h = htmlstream_internal_hash(tag, len);
+    int i = k->kept - 1;
+    for (; i >= 0; i--) {
+        int end = i + 1 < k->kept ? k->at[i + 1] - 1 : k->path_len;
+        if (k->hash[i] == h && end - k->at[i] == len && memcmp(k->path + k->at[i], tag, len) == 0) {
+            break;
+        }
+    }
+    if (i < 0) {
+        // no kept element has that name: maybe one that is not kept, else there is nothing to close
+        if (k->depth > k->kept) {
+            htmlstream_internal_emit_tag(t, type, tag, len, s);
+            k->depth--;
+        }
+        return;
+    }
+    // everything opened inside it is closed first
+    while (k->depth > i) {
+        htmlstream_internal_stack_pop(t, s);
+    }
+}
+#endif
+
+HTMLSTREAM_INLINE void htmlstream_spec_tag(htmlstream_t *t, int type, const htmlstream_spec_t *s)
+{
+    if (s == &htmlstream_skip_spec) {
+        htmlstream_internal_skip_tag(t, type);
+#ifdef HTMLSTREAM_ELEMENT_STACK
+    } else if (t->flags & HTMLSTREAM_STACK) {
+        htmlstream_internal_stack_tag(t, type, s);
+#endif
+    } else {
+        htmlstream_internal_emit_tag(t, type, htmlstream_buffer_get(&t->tag), t->tag.at, s);
+    }
+}
+
+HTMLSTREAM_INLINE void htmlstream_spec_attr(htmlstream_t *t, bool value, const htmlstream_spec_t *s)
+{
+    if (!s) {
+        htmlstream_internal_attr(t, value);
+    } else if (s->attr_cb) {
+        HTMLSTREAM_STAT(t, attrs, 1);
+        s->attr_cb(t->parg, htmlstream_buffer_get(&t->tag), t->tag.at,
+                value ? htmlstream_buffer_get(&t->val) : 0, value ? t->val.at : 0);
+    }
+}
+
+HTMLSTREAM_INLINE void htmlstream_internal_push_text(htmlstream_t *t, const char c, const char *src,
+        const htmlstream_spec_t *s)
+{
+    if (!HTMLSTREAM_WANT_TEXT(s)) {
+        return;
+    }
+    if (!s && t->text_part_cb && t->val.at >= HTMLSTREAM_TAG_BUFFER_SIZE) {
+        htmlstream_internal_text_part(t, !HTMLSTREAM_ISSPACE(c));
+    }
+    htmlstream_buffer_push(t, &t->val, c, src);
+}
+
+// hand out the text node that just ended. resets val
+HTMLSTREAM_INLINE void htmlstream_internal_emit_text(htmlstream_t *t, const htmlstream_spec_t *s)
+{
+    //trim
+    bool keep = t->flags & HTMLSTREAM_KEEP_SPACE;
+    if (s) {
+        int len = t->val.at;
+        const char *nu = htmlstream_buffer_get(&t->val);
+        if (!keep) {
+            nu = htmlstream_trimwhitespace(nu, &len);
+        }
+        if (s->text_cb && len) {
+            HTMLSTREAM_STAT(t, texts, 1);
+            s->text_cb(t->parg, nu, len);
+        }
+    } else if (t->text_part_cb) {
+        htmlstream_internal_text_end(t);
+    } else if (t->text_cb || t->tape) {
+        int len = t->val.at;
+        const char *nu = htmlstream_buffer_get(&t->val);
+        if (!keep) {
+            nu = htmlstream_trimwhitespace(nu, &len);
+        }
+        if (len) {
+            htmlstream_internal_text(t, nu, len);
+        }
+    }
+    htmlstream_buffer_reset(&t->val);
+}
+
+// an open tag is over, the element's content starts
+HTMLSTREAM_INLINE void htmlstream_internal_raw_start(htmlstream_t *t, const htmlstream_spec_t *s)
+{
+    if (t->state != HTMLSTREAM_STATE_TEXT) {
+        return;
+    }
+    if (s == &htmlstream_skip_spec && t->skip_open) {
+        // <svg/> has none
+        if (t->skip_slash) {
+            t->skip--;
+        }
+        t->skip_open = false;
+    }
+#ifdef HTMLSTREAM_ELEMENT_STACK
+    if (t->stack.closing && s != &htmlstream_skip_spec) {
+        t->stack.closing = false;
+        htmlstream_internal_stack_pop(t, s);
+    }
+#endif
+    if (t->rawtext) {
+        t->state = HTMLSTREAM_STATE_RAWTEXT;
+    }
+}
+
+// b as if it had been pushed with HTMLSTREAM_TOLOWER
+static void htmlstream_internal_lower(htmlstream_t *t, htmlstream_buffer_t *b)
+{
+    const char *data = htmlstream_buffer_get(b);
+    for (int i = 0; i < b->at; i++) {
+        if (HTMLSTREAM_TOLOWER(data[i]) != data[i]) {
+            htmlstream_buffer_unspan(t, b);
+            char *to = htmlstream_buffer_data(b);
+            for (; i < b->at; i++) {
+                to[i] = HTMLSTREAM_TOLOWER(to[i]);
+            }
+            return;
+        }
+    }
+}
+
+// character references
+
+#define HTMLSTREAM_ISALNUM(x) \
+    ((unsigned char)(HTMLSTREAM_ASCII_LOWER(x) - 'a') < 26 || (unsigned char)((x) - '0') < 10)
+
+// what &#128; to &#159; stand for, as in windows-1252
+static const unsigned short htmlstream_windows1252[32] = {
+    0x20ac, 0x81, 0x201a, 0x192, 0x201e, 0x2026, 0x2020, 0x2021,
+    0x2c6, 0x2030, 0x160, 0x2039, 0x152, 0x8d, 0x17d, 0x8f,
+    0x90, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+    0x2dc, 0x2122, 0x161, 0x203a, 0x153, 0x9d, 0x17e, 0x178,
+};
+
+// value of a digit in base 10 or 16, or -1
+HTMLSTREAM_INLINE int htmlstream_internal_digit(char c, int base)
+{
+    if ((unsigned char)(c - '0') < 10) {
+        return c - '0';
+    }
+    char l = HTMLSTREAM_ASCII_LOWER(c);
+    if (base == 16 && (unsigned char)(l - 'a') < 6) {
+        return l - 'a' + 10;
+    }
+    return -1;
+}
+
+// whether the named reference id is the len bytes at name. names are short,
+// byte loops beat memcmp here
+HTMLSTREAM_INLINE bool htmlstream_internal_entity_is(int id, const char *name, int len)
+{
+    int at = htmlstream_entity_name_at[id - 1];
+    if (htmlstream_entity_name_at[id] - at != len) {
+        return false;
+    }
+    for (int i = 0; i < len; i++) {
+        if (htmlstream_entity_names[at + i] != name[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// id of a named reference (with its ; if it has one) that hashes to h, or 0
+HTMLSTREAM_INLINE int htmlstream_internal_entity_id(const char *name, int len, uint32_t h)
+{
+#ifdef HTMLSTREAM_ENTITIES
+    uint32_t d = htmlstream_entity_displace[h >> (32 - HTMLSTREAM_ENTITY_BUCKET_BITS)];
+    int id = htmlstream_entity_slots[htmlstream_internal_slot(h, d, HTMLSTREAM_ENTITY_BITS)];
+    return id && htmlstream_internal_entity_is(id, name, len) ? id : 0;
+#else
+    (void)h;
+    for (int id = 1; id < HTMLSTREAM_ENTITY_COUNT; id++) {
+        if (htmlstream_internal_entity_is(id, name, len)) {
+            return id;
+        }
+    }
+    return 0;
+#endif
+}
+
+static int htmlstream_internal_utf8(uint32_t code, char *out)
+{
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xc0 | code >> 6);
+        out[1] = (char)(0x80 | (code & 0x3f));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xe0 | code >> 12);
+        out[1] = (char)(0x80 | (code >> 6 & 0x3f));
+        out[2] = (char)(0x80 | (code & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | code >> 18);
+    out[1] = (char)(0x80 | (code >> 12 & 0x3f));
+    out[2] = (char)(0x80 | (code >> 6 & 0x3f));
+    out[3] = (char)(0x80 | (code & 0x3f));
+    return 4;
+}
+
+// the character reference in the n bytes at ref (what follows the &). returns how many of
+// them it takes up, its utf-8 (at most 8 bytes) is in out[0..*out_len). 0 if there is none.
+// in attribute values old names without ; followed by a letter, digit or = are none
+static int htmlstream_internal_reference(const char *ref, int n, bool attr, char *out, int *out_len)
+{
+    *out_len = 0;
+    if (n > 0 && ref[0] == '#') {
+        int base = 10;
+        int i    = 1;
+        if (i < n && HTMLSTREAM_ASCII_LOWER(ref[i]) == 'x') {
+            base = 16;
+            i++;
+        }
+        int start = i;
+        uint32_t code = 0;
+        int d;
+        while (i < n && (d = htmlstream_internal_digit(ref[i], base)) >= 0) {
+            code = code * base + d;
+            if (code > 0x10ffff) {
+                code = 0x110000;
+            }
+            i++;
+        }
+        if (i == start) {
+            return 0;
+        }
+        if (i < n && ref[i] == ';') {
+            i++;
+        }
+        if (code == 0 || code > 0x10ffff || (code >= 0xd800 && code < 0xe000)) {
+            code = 0xfffd;
+        } else if (code >= 0x80 && code < 0xa0) {
+            code = htmlstream_windows1252[code - 0x80];
+        }
+        *out_len = htmlstream_internal_utf8(code, out);
+        return i;
+    }
+    // hashes of the name so far, and of its first bytes for old names without ;
+    uint32_t h = HTMLSTREAM_HASH_START;
+    uint32_t prefix[HTMLSTREAM_ENTITY_LEGACY_LONGEST + 1];
+    int i = 0;
+    while (i < n && i < HTMLSTREAM_ENTITY_LONGEST && HTMLSTREAM_ISALNUM(ref[i])) {
+        h = HTMLSTREAM_HASH_STEP(h, ref[i]);
+        if (i < HTMLSTREAM_ENTITY_LEGACY_LONGEST) {
+            prefix[i + 1] = h;
+        }
+        i++;
+    }
+    int len = i + 1;
+    int id  = 0;
+    if (i < n && ref[i] == ';') {
+        id = htmlstream_internal_entity_id(ref, len, HTMLSTREAM_HASH_STEP(h, ';'));
+    }
+    if (!id) {
+        // the longest old name it starts with
+        len = i < HTMLSTREAM_ENTITY_LEGACY_LONGEST ? i : HTMLSTREAM_ENTITY_LEGACY_LONGEST;
+        while (len > 0 && !(id = htmlstream_internal_entity_id(ref, len, prefix[len]))) {
+            len--;
+        }
+        if (!id || (attr && len < n && (HTMLSTREAM_ISALNUM(ref[len]) || ref[len] == '='))) {
+            return 0;
+        }
+    }
+    int at = htmlstream_entity_value_at[id - 1];
+    *out_len = htmlstream_entity_value_at[id] - at;
+    for (int k = 0; k < *out_len; k++) {
+        out[k] = htmlstream_entity_values[at + k];
+    }
+    return len;
+}
+
+// with HTMLSTREAM_DECODE, a & starts a reference where html has them.
+// not where the text or value is dropped anyway
+static bool htmlstream_internal_entity_start(htmlstream_t *t, const htmlstream_spec_t *s)
+{
+    bool attr = t->state >= HTMLSTREAM_STATE_ATTR_EQ && t->state <= HTMLSTREAM_STATE_ATTR_VAL_QUOTE;
+    bool room = t->state == HTMLSTREAM_STATE_ATTR_EQ || t->val.at < htmlstream_buffer_limit(t, &t->val);
+    if (attr ? !HTMLSTREAM_WANT_VAL(s) || !room :
+            (s || !t->text_part_cb) && (!HTMLSTREAM_WANT_TEXT(s) || !room)) {
+        return false;
+    }
+    switch (t->state) {
+        case HTMLSTREAM_STATE_TEXT:
+        case HTMLSTREAM_STATE_ATTR_VAL:
+            break;
+        case HTMLSTREAM_STATE_ATTR_VAL_QUOTE:
+            if (t->escaped) {
+                return false;
+            }
+            break;
+        case HTMLSTREAM_STATE_ATTR_EQ:
+            // the value starts with it
+            htmlstream_buffer_reset(&t->val);
+            t->state = HTMLSTREAM_STATE_ATTR_VAL;
+            break;
+        case HTMLSTREAM_STATE_RAWTEXT:
+            if (!t->rcdata) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    t->ret    = t->state;
+    t->state  = HTMLSTREAM_STATE_ENTITY;
+    t->markup = 0;
+    return true;
+}
+
+// whether c can still be part of the reference, then it is held too
+static bool htmlstream_internal_entity_hold(htmlstream_t *t, char c)
+{
+    int n = t->markup;
+    if (n > 0 && t->entity[0] == '#') {
+        if (n == 1 && HTMLSTREAM_ASCII_LOWER(c) == 'x') {
+            t->entity[t->markup++] = c;
+            return true;
+        }
+        int start = n > 1 && HTMLSTREAM_ASCII_LOWER(t->entity[1]) == 'x' ? 2 : 1;
+        if (htmlstream_internal_digit(c, start == 2 ? 16 : 10) < 0) {
+            return false;
+        }
+        // leading zeros, and digits once it is past any code point anyway, change nothing
+        if ((n == start + 1 && t->entity[start] == '0') || n == HTMLSTREAM_ENTITY_LONGEST) {
+            n--;
+        }
+        t->entity[n] = c;
+        t->markup = n + 1;
+        return true;
+    }
+    if (n < HTMLSTREAM_ENTITY_LONGEST - 1 && (HTMLSTREAM_ISALNUM(c) || (n == 0 && c == '#'))) {
+        t->entity[t->markup++] = c;
+        return true;
+    }
+    return false;
+}
+
+static void htmlstream_internal_entity_push(htmlstream_t *t, const char *data, int n, bool attr,
+        const htmlstream_spec_t *s)
+{
+    htmlstream_buffer_t *b = &t->val;
+    if (!b->span && b->at + n <= htmlstream_buffer_size(b) &&
+            (attr ? HTMLSTREAM_WANT_VAL(s) : (s || !t->text_part_cb) && HTMLSTREAM_WANT_TEXT(s))) {
+        // fits as it is, the usual case
+        char *to = htmlstream_buffer_data(b) + b->at;
+        for (int i = 0; i < n; i++) {
+            to[i] = attr ? HTMLSTREAM_VAL_CASE(t, data[i]) : data[i];
+        }
+        b->at += n;
+        return;
+    }
+    if (attr) {
+        if (HTMLSTREAM_WANT_VAL(s)) {
+            htmlstream_buffer_append(t, &t->val, data, n, !(t->flags & HTMLSTREAM_KEEP_CASE));
+        }
+    } else if (!s && t->text_part_cb) {
+        for (int i = 0; i < n; i++) {
+            htmlstream_internal_push_text(t, data[i], 0, s);
+        }
+    } else if (HTMLSTREAM_WANT_TEXT(s)) {
+        htmlstream_buffer_append(t, &t->val, data, n, false);
+    }
+}
+
+// c does not continue the reference: decode it, or hand out the held bytes as they are.
+// returns 1 if c was not part of it and has to be looked at again
+static int htmlstream_internal_entity_end(htmlstream_t *t, char c, const htmlstream_spec_t *s)
+{
+    char ref[HTMLSTREAM_ENTITY_LONGEST + 1];
+    char out[8];
+    int n = t->markup;
+    memcpy(ref, t->entity, n);
+    ref[n] = c;
+    bool attr = t->ret != HTMLSTREAM_STATE_TEXT && t->ret != HTMLSTREAM_STATE_RAWTEXT;
+    int out_len;
+    int used = htmlstream_internal_reference(ref, n + 1, attr, out, &out_len);
+    if (!used) {
+        out[0]  = '&';
+        out_len = 1;
+    }
+    t->state  = t->ret;
+    t->markup = 0;
+    htmlstream_internal_entity_push(t, out, out_len, attr, s);
+    if (used < n) {
+        htmlstream_internal_entity_push(t, ref + used, n - used, attr, s);
+    }
+    return used <= n;
+}
+
+// right after the &, when the reference can not go on past the end of the chunk:
+// decode it in one go. returns how many bytes after the & it took
+static int htmlstream_internal_entity_now(htmlstream_t *t, const char *ref, int n,
+        const htmlstream_spec_t *s)
+{
+    if (n <= HTMLSTREAM_ENTITY_LONGEST) {
+        return 0;
+    }
+    char out[8];
+    bool attr = t->ret != HTMLSTREAM_STATE_TEXT && t->ret != HTMLSTREAM_STATE_RAWTEXT;
+    int out_len;
+    int used = htmlstream_internal_reference(ref, n, attr, out, &out_len);
+    if (used == n) {
+        // digits up to the end, there may be more
+        return 0;
+    }
+    if (!used) {
+        out[0]  = '&';
+        out_len = 1;
+    }
+    t->state = t->ret;
+    htmlstream_internal_entity_push(t, out, out_len, attr, s);
+    return used;
+}
+
+#ifndef HTMLSTREAM_NO_FASTPATH
+static const int htmlstream_bulk_states =
+    1 << HTMLSTREAM_STATE_TEXT |
+    1 << HTMLSTREAM_STATE_ATTR_KEY_QUOTE |
+    1 << HTMLSTREAM_STATE_ATTR_VAL_QUOTE |
+    1 << HTMLSTREAM_STATE_COMMENT |
+    1 << HTMLSTREAM_STATE_CDATA |
+    1 << HTMLSTREAM_STATE_BOGUS |
+    1 << HTMLSTREAM_STATE_RAWTEXT;
+
+// the attributes of an open tag, outside quotes. a parser without attr_cb only has to find
+// where the tag ends, or a quote that may hide its >. all of these go on the same way from
+// there, so the run can end in any of them
+static const int htmlstream_attr_states =
+    1 << HTMLSTREAM_STATE_OPENING_TAG_END |
+    1 << HTMLSTREAM_STATE_ATTR_KEY |
+    1 << HTMLSTREAM_STATE_ATTR_KEY_END |
+    1 << HTMLSTREAM_STATE_ATTR_EQ |
+    1 << HTMLSTREAM_STATE_ATTR_VAL;
+#define HTMLSTREAM_BULK_STATES(s) (htmlstream_bulk_states | ((s) && !(s)->attr_cb ? htmlstream_attr_states : 0))
+
+// streaming text buffers no more than HTMLSTREAM_TAG_BUFFER_SIZE, but for a run of
+// whitespace held back, which grows with alloc_cb and is cut without it
+static void htmlstream_internal_text_stream(htmlstream_t *t, const char *data, int len)
+{
+    while (len > 0) {
+        int room = HTMLSTREAM_TAG_BUFFER_SIZE - t->val.at;
+        if (room < 1) {
+            htmlstream_internal_text_part(t, !HTMLSTREAM_ISSPACE(*data));
+            room = HTMLSTREAM_TAG_BUFFER_SIZE - t->val.at;
+        }
+        if (room < 1) {
+            int n = 0;
+            while (n < len && HTMLSTREAM_ISSPACE(data[n])) {
+                ++n;
+            }
+            htmlstream_buffer_append(t, &t->val, data, n, false);
+            data += n;
+            len  -= n;
+            continue;
+        }
+        if (room > len) {
+            room = len;
+        }
+        htmlstream_buffer_append(t, &t->val, data, room, false);
+        data += room;
+        len  -= room;
+    }
+}
+
+HTMLSTREAM_INLINE void htmlstream_internal_append_text(htmlstream_t *t, const char *data, int n,
+        const htmlstream_spec_t *s)
+{
+    if (!s && t->text_part_cb) {
+        htmlstream_internal_text_stream(t, data, n);
+    } else if (HTMLSTREAM_WANT_TEXT(s)) {
+        htmlstream_buffer_append(t, &t->val, data, n, false);
+    }
+}
+
+// consume the run of bytes the current state would only buffer,
+// up to the next byte that could change state. returns the run length.
+HTMLSTREAM_INLINE int htmlstream_internal_bulk(htmlstream_t *t, const char *data, int len,
+        const htmlstream_spec_t *s)
+{
+    int n;
+    // stop at references too when decoding
+    char amp = t->flags & HTMLSTREAM_DECODE ? '&' : '<';
+    switch (t->state) {
+        case HTMLSTREAM_STATE_TEXT:
+        case HTMLSTREAM_STATE_RAWTEXT:
+            n = htmlstream_scan(data, len, '<', amp, amp, amp);
+            htmlstream_internal_append_text(t, data, n, s);
+            return n;
+        case HTMLSTREAM_STATE_ATTR_KEY_QUOTE:
+            n = htmlstream_scan(data, len, '<', '\\', t->quote, t->quote);
+            if (n) {
+                if (HTMLSTREAM_WANT_TAG(s)) {
+                    htmlstream_buffer_append(t, &t->tag, data, n, true);
+                }
+                t->escaped = false;
+            }
+            return n;
+        case HTMLSTREAM_STATE_ATTR_VAL_QUOTE:
+            n = htmlstream_scan(data, len, '<', '\\', t->quote, HTMLSTREAM_WANT_VAL(s) ? amp : '<');
+            if (n) {
+                if (HTMLSTREAM_WANT_VAL(s)) {
+                    htmlstream_buffer_append(t, &t->val, data, n, !(t->flags & HTMLSTREAM_KEEP_CASE));
+                }
+                t->escaped = false;
+            }
+            return n;
+        // only with HTMLSTREAM_BULK_STATES(s)
+        case HTMLSTREAM_STATE_OPENING_TAG_END:
+        case HTMLSTREAM_STATE_ATTR_KEY:
+        case HTMLSTREAM_STATE_ATTR_KEY_END:
+        case HTMLSTREAM_STATE_ATTR_EQ:
+        case HTMLSTREAM_STATE_ATTR_VAL:
+            n = htmlstream_scan(data, len, '<', '>', '"', '\'');
+            if (n) {
+                // a quote from here starts a value, which nothing wants
+                t->state = HTMLSTREAM_STATE_ATTR_VAL;
+                if (s == &htmlstream_skip_spec) {
+                    t->skip_slash = data[n - 1] == '/';
+                }
+            }
+            return n;
+        // the rest only once no dash or bracket is pending
+        case HTMLSTREAM_STATE_COMMENT:
+            if (t->markup) {
+                return 0;
+            }
+            n = htmlstream_scan(data, len, '-', '-', '-', '-');
+            if (n && !s) {
+                htmlstream_internal_comment(t, data, n, false);
+            }
+            return n;
+        case HTMLSTREAM_STATE_CDATA:
+            if (t->markup) {
+                return 0;
+            }
+            n = htmlstream_scan(data, len, ']', ']', ']', ']');
+            htmlstream_internal_append_text(t, data, n, s);
+            return n;
+        case HTMLSTREAM_STATE_BOGUS:
+            n = htmlstream_scan(data, len, '>', '>', '>', '>');
+            if (n && !s) {
+                htmlstream_internal_comment(t, data, n, false);
+            }
+            return n;
+    }
+    return 0;
+}
+
+#ifdef HTMLSTREAM_STATS
+// count a run htmlstream_internal_bulk took from state the way one step per byte would.
+// a run over attributes goes through several states, and can have a / in an unquoted value
+static void htmlstream_internal_bulk_stats(htmlstream_t *t, int state, const char *data, int n)
+{
+    if (!(htmlstream_attr_states & 1 << state)) {
+        t->stats.bytes[state] += n;
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        int c = htmlstream_classes[(unsigned char)data[i]];
+        t->stats.bytes[state]++;
+        t->stats.recoveries += htmlstream_recoveries[state] >> c & 1;
+        state = htmlstream_transitions[state][c] & 0xff;
+    }
+}
+#endif
+#endif
+
+// returns 1 if held back markup turned out not to be any. see htmlstream_internal_replay
+HTMLSTREAM_INLINE int htmlstream_internal_feed_spec(htmlstream_t *t, const char c, const char *src,
+        const htmlstream_spec_t *s)
+{
+    unsigned short tr = htmlstream_transitions[t->state][htmlstream_classes[(unsigned char)c]];
+#ifdef HTMLSTREAM_STATS
+    t->stats.recoveries += htmlstream_recoveries[t->state] >> htmlstream_classes[(unsigned char)c] & 1;
+#endif
+    t->state = tr & 0xff;
+    switch (tr >> 8) {
+        case HTMLSTREAM_ACTION_NONE:
+            break;
+        case HTMLSTREAM_ACTION_PUSH_TEXT:
+            htmlstream_internal_push_text(t, c, src, s);
+            break;
+        case HTMLSTREAM_ACTION_PUSH_TAG:
+            if (HTMLSTREAM_WANT_NAME(s, t)) {
+                htmlstream_buffer_push(t, &t->tag, HTMLSTREAM_TOLOWER(c), src);
+            }
+            break;
+        case HTMLSTREAM_ACTION_PUSH_VAL:
+            if (HTMLSTREAM_WANT_VAL(s)) {
+                htmlstream_buffer_push(t, &t->val, HTMLSTREAM_VAL_CASE(t, c), src);
+            }
+            break;
+        case HTMLSTREAM_ACTION_START_TAG:
+            htmlstream_buffer_reset(&t->tag);
+            if (HTMLSTREAM_WANT_NAME(s, t)) {
+                htmlstream_buffer_push(t, &t->tag, HTMLSTREAM_TOLOWER(c), src);
+            }
+            break;
+        case HTMLSTREAM_ACTION_START_VAL:
+            htmlstream_buffer_reset(&t->val);
+            if (HTMLSTREAM_WANT_VAL(s)) {
+                htmlstream_buffer_push(t, &t->val, HTMLSTREAM_VAL_CASE(t, c), src);
+            }
+            break;
+        case HTMLSTREAM_ACTION_EMIT_TEXT:
+            htmlstream_internal_emit_text(t, s);
+            htmlstream_buffer_reset(&t->tag);
+            t->rawtext = 0;
+            break;
+        case HTMLSTREAM_ACTION_EMIT_OPEN:
+            htmlstream_spec_tag(t, HTMLSTREAM_EVENT_OPEN, s);
+            t->rawtext = htmlstream_internal_find(t->rawtext_tags, &t->tag);
+            t->rcdata  = t->rawtext && htmlstream_internal_find(t->rcdata_tags, &t->tag);
+            htmlstream_buffer_reset(&t->tag);
+            htmlstream_buffer_reset(&t->val);
+            htmlstream_internal_raw_start(t, s);
+            break;
+        case HTMLSTREAM_ACTION_EMIT_CLOSE:
+            htmlstream_spec_tag(t, HTMLSTREAM_EVENT_CLOSE, s);
+            htmlstream_buffer_reset(&t->tag);
+            htmlstream_buffer_reset(&t->val);
+            t->rawtext = 0;
+            break;
+        case HTMLSTREAM_ACTION_EMIT_KEY:
+            htmlstream_spec_attr(t, false, s);
+            htmlstream_buffer_reset(&t->tag);
+            htmlstream_buffer_reset(&t->val);
+            htmlstream_internal_raw_start(t, s);
+            break;
+        case HTMLSTREAM_ACTION_EMIT_KEY_START:
+            htmlstream_spec_attr(t, false, s);
+            htmlstream_buffer_reset(&t->tag);
+            if (HTMLSTREAM_WANT_TAG(s)) {
+                htmlstream_buffer_push(t, &t->tag, HTMLSTREAM_TOLOWER(c), src);
+            }
+            break;
+        case HTMLSTREAM_ACTION_EMIT_KEY_QUOTE:
+            htmlstream_spec_attr(t, false, s);
+            t->quote = c;
+            htmlstream_buffer_reset(&t->tag);
+            htmlstream_buffer_reset(&t->val);
+            break;
+        case HTMLSTREAM_ACTION_EMIT_ATTR:
+            htmlstream_spec_attr(t, true, s);
+            htmlstream_buffer_reset(&t->tag);
+            htmlstream_buffer_reset(&t->val);
+            htmlstream_internal_raw_start(t, s);
+            break;
+        case HTMLSTREAM_ACTION_RESET:
+            htmlstream_buffer_reset(&t->tag);
+            htmlstream_buffer_reset(&t->val);
+            htmlstream_internal_raw_start(t, s);
+            break;
+        case HTMLSTREAM_ACTION_RESET_VAL:
+            htmlstream_buffer_reset(&t->val);
+            break;
+        case HTMLSTREAM_ACTION_QUOTE:
+            t->quote = c;
+            break;
+        case HTMLSTREAM_ACTION_QUOTE_KEY:
+            t->quote = c;
+            htmlstream_buffer_reset(&t->tag);
+            break;
+        case HTMLSTREAM_ACTION_QUOTE_VAL:
+            t->quote = c;
+            htmlstream_buffer_reset(&t->val);
+            break;
+        case HTMLSTREAM_ACTION_ESCAPE:
+            t->escaped = true;
+            break;
+        case HTMLSTREAM_ACTION_QUOTED_KEY:
+            if (c == t->quote && !t->escaped) {
+                t->state = HTMLSTREAM_STATE_ATTR_KEY;
+            } else if (HTMLSTREAM_WANT_TAG(s)) {
+                htmlstream_buffer_push(t, &t->tag, HTMLSTREAM_TOLOWER(c), src);
+            }
+            t->escaped = false;
+            break;
+        case HTMLSTREAM_ACTION_QUOTED_VAL:
+            if (c == t->quote && !t->escaped) {
+                t->state = HTMLSTREAM_STATE_ATTR_VAL;
+            } else if (HTMLSTREAM_WANT_VAL(s)) {
+                htmlstream_buffer_push(t, &t->val, HTMLSTREAM_VAL_CASE(t, c), src);
+            }
+            t->escaped = false;
+            break;
+        case HTMLSTREAM_ACTION_MARKUP:
+            if (t->state == HTMLSTREAM_STATE_MARKUP) {
+                if (c == "<!--"[t->markup]) {
+                    if (++t->markup == 4) {
+                        t->state  = HTMLSTREAM_STATE_COMMENT;
+                        t->markup = 0;
+                    }
+                    break;
+                }
+                // processing instructions and cdata only mean something between tags
+                if (t->ret == HTMLSTREAM_STATE_TEXT && t->markup == 1 && c == '?') {
+                    t->state = HTMLSTREAM_STATE_BOGUS;
+                    if (!s) {
+                        htmlstream_internal_comment(t, "?", 1, false);
+                    }
+                    break;
+                }
+                if (t->ret == HTMLSTREAM_STATE_TEXT && t->markup == 2 && c == '[') {
+                    t->state  = HTMLSTREAM_STATE_CDATA_START;
+                    t->markup = 3;
+                    break;
+                }
+            } else if (c == "<![CDATA["[t->markup]) {
+                if (++t->markup == 9) {
+                    t->state  = HTMLSTREAM_STATE_CDATA;
+                    t->markup = 0;
+                }
+                break;
+            }
+            return 1;
+        case HTMLSTREAM_ACTION_COMMENT:
+            if (c == '>' && t->markup == 2) {
+                if (!s) {
+                    htmlstream_internal_comment(t, "", 0, true);
+                }
+                t->state  = t->ret;
+                t->markup = 0;
+                break;
+            }
+            if (c == '-' && t->markup < 2) {
+                t->markup++;
+                break;
+            }
+            // dashes that did not end the comment are part of it
+            if (c == '-') {
+                if (!s) {
+                    htmlstream_internal_comment(t, "-", 1, false);
+                }
+                break;
+            }
+            if (!s) {
+                if (t->markup) {
+                    htmlstream_internal_comment(t, "--", t->markup, false);
+                }
+                htmlstream_internal_comment(t, &c, 1, false);
+            }
+            t->markup = 0;
+            break;
+        case HTMLSTREAM_ACTION_CDATA:
+            if (c == '>' && t->markup == 2) {
+                t->state  = t->ret;
+                t->markup = 0;
+                break;
+            }
+            if (c == ']' && t->markup < 2) {
+                t->markup++;
+                break;
+            }
+            if (c == ']') {
+                htmlstream_internal_push_text(t, ']', 0, s);
+                break;
+            }
+            for (; t->markup > 0; t->markup--) {
+                htmlstream_internal_push_text(t, ']', 0, s);
+            }
+            htmlstream_internal_push_text(t, c, src, s);
+            break;
+        case HTMLSTREAM_ACTION_BOGUS:
+            if (c == '>') {
+                t->state = t->ret;
+            }
+            if (!s) {
+                htmlstream_internal_comment(t, &c, c != '>', c == '>');
+            }
+            break;
+        case HTMLSTREAM_ACTION_RAW_LT:
+            htmlstream_buffer_reset(&t->tag);
+            t->markup = 1;
+            break;
+        case HTMLSTREAM_ACTION_ENTITY:
+            if (htmlstream_internal_entity_hold(t, c)) {
+                break;
+            }
+            return htmlstream_internal_entity_end(t, c, s);
+        case HTMLSTREAM_ACTION_RAW_END: {
+            const char *name = t->rawtext_tags[t->rawtext - 1];
+            int at = t->markup - 2;
+            if (at < 0 ? c == '/' : name[at] && HTMLSTREAM_ASCII_LOWER(c) == name[at]) {
+                if (at >= 0) {
+                    htmlstream_buffer_push(t, &t->tag, c, src);
+                }
+                t->markup++;
+                break;
+            }
+            if (at >= 0 && !name[at] && (c == '>' || HTMLSTREAM_ISSPACE(c))) {
+                // the end tag. c goes on to end it like any other
+                htmlstream_internal_emit_text(t, s);
+                htmlstream_internal_lower(t, &t->tag);
+                t->state   = HTMLSTREAM_STATE_CLOSING_TAG;
+                t->markup  = 0;
+                t->rawtext = 0;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int htmlstream_internal_feed(htmlstream_t *t, const char c, const char *src)
+{
+    return htmlstream_internal_feed_spec(t, c, src, 0);
+}
+
+// inlined into a specialized parser, a plain call otherwise
+HTMLSTREAM_INLINE int htmlstream_internal_feed_as(htmlstream_t *t, const char c, const char *src,
+        const htmlstream_spec_t *s)
+{
+    if (s) {
+        return htmlstream_internal_feed_spec(t, c, src, s);
+    }
+    return htmlstream_internal_feed(t, c, src);
+}
+
+// held back bytes were not a comment, cdata or raw text end tag after all.
+// they go to the state they interrupted, as if they never were held back
+HTMLSTREAM_INLINE void htmlstream_internal_replay(htmlstream_t *t, const htmlstream_spec_t *s)
+{
+    const char *held;
+    HTMLSTREAM_STAT(t, replays, t->state == HTMLSTREAM_STATE_MARKUP || t->state == HTMLSTREAM_STATE_CDATA_START ||
+            t->state == HTMLSTREAM_STATE_RAWTEXT_END);
+    switch (t->state) {
+        case HTMLSTREAM_STATE_MARKUP:
+            held = "<!--";
+            break;
+        case HTMLSTREAM_STATE_CDATA_START:
+            held = "<![CDATA[";
+            break;
+        case HTMLSTREAM_STATE_RAWTEXT_END:
+            htmlstream_internal_push_text(t, '<', 0, s);
+            if (t->markup > 1) {
+                htmlstream_internal_push_text(t, '/', 0, s);
+            }
+            for (int i = 0; i < t->tag.at; i++) {
+                htmlstream_internal_push_text(t, htmlstream_buffer_get(&t->tag)[i], 0, s);
+            }
+            htmlstream_buffer_reset(&t->tag);
+            t->state  = HTMLSTREAM_STATE_RAWTEXT;
+            t->markup = 0;
+            return;
+        default:
+            // nothing held back, c just has to be looked at again
+            return;
+    }
+    int n = t->markup;
+    t->state  = t->ret;
+    t->markup = 0;
+    for (int i = 0; i < n; i++) {
+        htmlstream_internal_feed_as(t, held[i], 0, s);
+    }
+}
+
+static int htmlstream_internal_skip_chunk(htmlstream_t *t, const char *data, int len);
+
+// returns how much of data was used: all of it, unless parsing stopped
+HTMLSTREAM_INLINE int htmlstream_internal_feed_chunk_spec(htmlstream_t *t, const char *data, int len,
+        const htmlstream_spec_t *s)
+{
+    bool skipping = s == &htmlstream_skip_spec;
+    for (int i = 0; i < len; i++) {
+        // a callback skipped or stopped, or the skipped element is over
+        if (skipping ? t->skip <= 0 : t->skip != 0) {
+            if (skipping || t->skip < 0) {
+                return i;
+            }
+            int skipped = htmlstream_internal_skip_chunk(t, data + i, len - i);
+            HTMLSTREAM_STAT(t, skipped, skipped);
+            i += skipped;
+#ifdef HTMLSTREAM_ELEMENT_STACK
+            // the skipped element still closes, where the skip ends
+            if (t->skip == 0 && (t->flags & HTMLSTREAM_STACK)) {
+                htmlstream_internal_stack_pop(t, s);
+            }
+#endif
+            if (i == len || t->skip < 0) {
+                return i;
+            }
+        }
+        char c = data[i];
+#ifndef HTMLSTREAM_NO_FASTPATH
+        if (HTMLSTREAM_BULK_STATES(s) & (1 << t->state)) {
+#ifdef HTMLSTREAM_STATS
+            int from = t->state;
+#endif
+            int n = htmlstream_internal_bulk(t, data + i, len - i, s);
+#ifdef HTMLSTREAM_STATS
+            htmlstream_internal_bulk_stats(t, from, data + i, n);
+#endif
+            i += n;
+            if (i == len) {
+                break;
+            }
+            c = data[i];
+        }
+#endif
+        HTMLSTREAM_STAT(t, bytes[t->state], 1);
+        // a comment can start anywhere. hold the < back until the next bytes tell,
+        // unless the next one is right here and already rules it out
+        if (c == '<' && t->state < HTMLSTREAM_STATE_MARKUP) {
+            char next = i + 1 < len ? data[i + 1] : '!';
+            if (next == '!' || (next == '?' && t->state == HTMLSTREAM_STATE_TEXT)) {
+                t->ret    = t->state;
+                t->state  = HTMLSTREAM_STATE_MARKUP;
+                t->markup = 1;
+                continue;
+            }
+        }
+        // a character reference is held back until it is complete too
+        if (c == '&' && (t->flags & HTMLSTREAM_DECODE) && !skipping && htmlstream_internal_entity_start(t, s)) {
+            i += htmlstream_internal_entity_now(t, data + i + 1, len - i - 1, s);
+            continue;
+        }
+        if (htmlstream_internal_feed_as(t, c, data + i, s)) {
+            htmlstream_internal_replay(t, s);
+            i--;
+        } else if (skipping) {
+            t->skip_slash = c == '/';
+        }
+    }
+    return len;
+}
+
+static int htmlstream_internal_feed_chunk(htmlstream_t *t, const char *data, int len)
+{
+    return htmlstream_internal_feed_chunk_spec(t, data, len, 0);
+}
+
+// parse without emitting anything until the skipped element is over
+static int htmlstream_internal_skip_chunk(htmlstream_t *t, const char *data, int len)
+{
+    return htmlstream_internal_feed_chunk_spec(t, data, len, &htmlstream_skip_spec);
+}
+
+// the fed chunk is about to go away. nothing may point into it anymore
+static void htmlstream_internal_end_chunk(htmlstream_t *t)
+{
+    htmlstream_buffer_unspan(t, &t->tag);
+    htmlstream_buffer_unspan(t, &t->val);
+}
+
+// from open_cb: skip the content of the element just opened. the rest of its open tag,
+// everything inside and its end tag are parsed as usual but emit nothing.
+// void elements (htmlstream_void_tags) and <x/> have no content, so nothing is skipped
+static inline void htmlstream_skip(htmlstream_t *t)
+{
+    const char *tag = htmlstream_buffer_get(&t->tag);
+    int len = t->tag.at;
+    if (t->skip || htmlstream_internal_find(htmlstream_void_tags, &t->tag)) {
+        return;
+    }
+    if (len == 0 || len > HTMLSTREAM_TAG_BUFFER_SIZE ||
+            (t->state == HTMLSTREAM_STATE_TEXT && tag[len - 1] == '/')) {
+        return;
+    }
+    for (int i = 0; i < len; i++) {
+        t->skip_tag[i] = HTMLSTREAM_ASCII_LOWER(tag[i]);
+    }
+    t->skip_len   = len;
+    t->skip       = 1;
+    // unless open_cb came at the > already
+    t->skip_open  = t->state != HTMLSTREAM_STATE_TEXT;
+    t->skip_slash = false;
+}
+
+// from any callback: stop parsing. htmlstream_feed returns right after the token
+// that was being emitted, and any later htmlstream_feed returns 0, until htmlstream_reset
+static inline void htmlstream_stop(htmlstream_t *t)
+{
+    t->skip = -1;
+}
+
+#ifdef HTMLSTREAM_ELEMENT_STACK
+// with HTMLSTREAM_STACK, from any callback: how many elements are open. the one an open_cb,
+// attr_cb or close_cb is about counts, for text_cb the one it is in is the innermost
+static inline int htmlstream_depth(const htmlstream_t *t)
+{
+    return t->stack.depth;
+}
+
+// with HTMLSTREAM_STACK, from any callback: the names of the open elements, outermost first,
+// like "html/body/div", 0 terminated. *len gets its length. only the ones kept, see
+// htmlstream_stack_t
+static inline const char *htmlstream_path(const htmlstream_t *t, int *len)
+{
+    *len = t->stack.path_len;
+    return t->stack.path;
+}
+
+// with HTMLSTREAM_STACK, once the document is over: close_cb for each element still open,
+// innermost first
+static inline void htmlstream_close_all(htmlstream_t *t)
+{
+    t->stack.closing = false;
+    while (t->stack.depth > 0) {
+        htmlstream_internal_stack_pop(t, 0);
+    }
+}
+#endif
+
+// returns how many bytes were parsed: len, unless a callback called htmlstream_stop
+static int htmlstream_feed(htmlstream_t *t, const char *data, int len)
+{
+    int used = htmlstream_internal_feed_chunk(t, data, len);
+    if (t->flags & HTMLSTREAM_UTF8) {
+        htmlstream_internal_utf8_check(&t->utf8, data, used);
+    }
+    if (t->text_part_cb && t->skip == 0 &&
+            (t->state == HTMLSTREAM_STATE_TEXT || t->state == HTMLSTREAM_STATE_RAWTEXT)) {
+        htmlstream_internal_text_part(t, false);
+    }
+    htmlstream_internal_end_chunk(t);
+    return used;
+}
+
+// checkpoints: the parser state (not callbacks, flags or other configuration) as bytes.
+// varints, zigzag so the -1 of a stopped parser stays short. an idle parser takes about 17
+#define HTMLSTREAM_CHECKPOINT_VERSION 2
+
+static void htmlstream_internal_put(char *out, int size, int *at, int v)
+{
+    unsigned u = ((unsigned)v << 1) ^ (unsigned)(v >> 31);
+    do {
+        unsigned char byte = (u & 0x7f) | (u > 0x7f ? 0x80 : 0);
+        if (*at < size) {
+            out[*at] = (char)byte;
+        }
+        (*at)++;
+        u >>= 7;
+    } while (u);
+}
+
+static void htmlstream_internal_put_bytes(char *out, int size, int *at, const char *data, int len)
+{
+    htmlstream_internal_put(out, size, at, len);
+    if (*at + len <= size) {
+        memcpy(out + *at, data, len);
+    }
+    *at += len;
+}
+
+// *at is past len once anything was missing or broken
+static int htmlstream_internal_get(const char *in, int len, int *at)
+{
+    unsigned u = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*at >= len) {
+            *at = len + 1;
+            return 0;
+        }
+        unsigned char byte = (unsigned char)in[(*at)++];
+        u |= (unsigned)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return (int)(u >> 1) ^ -(int)(u & 1);
+        }
+    }
+    *at = len + 1;
+    return 0;
+}
+
+// true if the bytes are there and fit in at most size
+static bool htmlstream_internal_get_bytes(const char *in, int len, int *at, int size, const char **data, int *n)
+{
+    *n = htmlstream_internal_get(in, len, at);
+    *data = in + *at;
+    if (*n < 0 || *n > size || *n > len - *at) {
+        *at = len + 1;
+        return false;
+    }
+    *at += *n;
+    return true;
+}
+
+#ifdef HTMLSTREAM_ELEMENT_STACK
+// the element stack, at the end of a checkpoint. stack.closing goes with the other bits
+static bool htmlstream_internal_closing(const htmlstream_t *t)
+{
+    return t->stack.closing;
+}
+
+static void htmlstream_internal_put_stack(const htmlstream_t *t, char *out, int size, int *at)
+{
+    const htmlstream_stack_t *k = &t->stack;
+    htmlstream_internal_put(out, size, at, k->depth);
+    htmlstream_internal_put_bytes(out, size, at, k->path, k->path_len);
+    htmlstream_internal_put(out, size, at, k->kept);
+    for (int i = 1; i < k->kept; i++) {
+        htmlstream_internal_put(out, size, at, k->at[i]);
+    }
+}
+
+static bool htmlstream_internal_get_stack(htmlstream_t *t, bool closing, const char *in, int len, int *at)
+{
+    htmlstream_stack_t *k = &t->stack;
+    const char *path;
+    k->closing = closing;
+    k->depth   = htmlstream_internal_get(in, len, at);
+    if (!htmlstream_internal_get_bytes(in, len, at, HTMLSTREAM_STACK_PATH, &path, &k->path_len)) {
+        return false;
+    }
+    memcpy(k->path, path, k->path_len);
+    k->path[k->path_len] = 0;
+    k->kept = htmlstream_internal_get(in, len, at);
+    bool stack = k->depth >= 0 && k->kept >= 0 && k->kept <= HTMLSTREAM_STACK_DEPTH && k->kept <= k->depth &&
+        (k->kept > 0 || k->path_len == 0);
+    k->at[0] = 0;
+    for (int i = 1; stack && i < k->kept; i++) {
+        k->at[i] = htmlstream_internal_get(in, len, at);
+        stack = k->at[i] > k->at[i - 1] && k->at[i] <= k->path_len && k->path[k->at[i] - 1] == '/';
+    }
+    for (int i = 0; stack && i < k->kept; i++) {
+        int end = i + 1 < k->kept ? k->at[i + 1] - 1 : k->path_len;
+        k->hash[i] = htmlstream_internal_hash(k->path + k->at[i], end - k->at[i]);
+    }
+    return stack;
+}
+#else
+// without the element stack a checkpoint has an empty one, and takes no other
+static bool htmlstream_internal_closing(const htmlstream_t *t)
+{
+    (void)t;
+    return false;
+}
+
+static void htmlstream_internal_put_stack(const htmlstream_t *t, char *out, int size, int *at)
+{
+    (void)t;
+    htmlstream_internal_put(out, size, at, 0);
+    htmlstream_internal_put_bytes(out, size, at, "", 0);
+    htmlstream_internal_put(out, size, at, 0);
+}
+
+static bool htmlstream_internal_get_stack(htmlstream_t *t, bool closing, const char *in, int len, int *at)
+{
+    (void)t;
+    const char *path;
+    int path_len;
+    int depth = htmlstream_internal_get(in, len, at);
+    if (!htmlstream_internal_get_bytes(in, len, at, 0, &path, &path_len)) {
+        return false;
+    }
+    return !closing && depth == 0 && htmlstream_internal_get(in, len, at) == 0;
+}
+#endif
+
+// write the state of t to out, between two htmlstream_feed calls. returns how many bytes
+// that takes, like snprintf: if it is more than size, out is not complete, try again with
+// more room. htmlstream_checkpoint(t, 0, 0) just tells
+static inline int htmlstream_checkpoint(const htmlstream_t *t, char *out, int size)
+{
+    int at = 0;
+    htmlstream_internal_put(out, size, &at, HTMLSTREAM_CHECKPOINT_VERSION);
+    htmlstream_internal_put(out, size, &at, t->state);
+    htmlstream_internal_put(out, size, &at, t->ret);
+    htmlstream_internal_put(out, size, &at, t->markup);
+    htmlstream_internal_put(out, size, &at, t->rawtext);
+    htmlstream_internal_put(out, size, &at, t->skip);
+    htmlstream_internal_put(out, size, &at, (unsigned char)t->quote);
+    htmlstream_internal_put(out, size, &at,
+            t->escaped | t->text_parted << 1 | t->skip_open << 2 | t->skip_slash << 3 |
+            htmlstream_internal_closing(t) << 4);
+    htmlstream_internal_put_bytes(out, size, &at, htmlstream_buffer_get(&t->tag), t->tag.at);
+    htmlstream_internal_put_bytes(out, size, &at, htmlstream_buffer_get(&t->val), t->val.at);
+    // what only some states use
+    htmlstream_internal_put_bytes(out, size, &at, t->entity,
+            t->state == HTMLSTREAM_STATE_ENTITY ? t->markup : 0);
+    htmlstream_internal_put_bytes(out, size, &at, t->skip_tag, t->skip > 0 ? t->skip_len : 0);
+    htmlstream_internal_put(out, size, &at, t->utf8.invalid);
+    htmlstream_internal_put(out, size, &at, t->utf8.need);
+    if (t->utf8.need) {
+        htmlstream_internal_put(out, size, &at, t->utf8.lo);
+        htmlstream_internal_put(out, size, &at, t->utf8.hi);
+    }
+    htmlstream_internal_put_stack(t, out, size, &at);
+    return at;
+}
+
+// whether what restore read makes sense for this parser: nothing the state machine
+// uses as an index may point past what it indexes
+static bool htmlstream_internal_restorable(const htmlstream_t *t, int state, int entity_len)
+{
+    int raw_tags = 0;
+    while (t->rawtext_tags && t->rawtext_tags[raw_tags]) {
+        raw_tags++;
+    }
+    // ret only counts in the states that go back to it
+    bool raw = state == HTMLSTREAM_STATE_RAWTEXT || state == HTMLSTREAM_STATE_RAWTEXT_END ||
+        (state >= HTMLSTREAM_STATE_MARKUP && state != HTMLSTREAM_STATE_RAWTEXT && t->ret == HTMLSTREAM_STATE_RAWTEXT);
+    if (t->rawtext < (raw ? 1 : 0) || t->rawtext > raw_tags || t->skip < -1 ||
+            (t->quote != 0 && t->quote != '"' && t->quote != '\'') ||
+            t->utf8.need < 0 || t->utf8.need > 3 || t->utf8.invalid < 0) {
+        return false;
+    }
+    switch (state) {
+        case HTMLSTREAM_STATE_MARKUP:      return t->markup >= 1 && t->markup <= 3;
+        case HTMLSTREAM_STATE_CDATA_START: return t->markup >= 3 && t->markup <= 8;
+        case HTMLSTREAM_STATE_COMMENT:
+        case HTMLSTREAM_STATE_CDATA:       return t->markup >= 0 && t->markup <= 2;
+        case HTMLSTREAM_STATE_RAWTEXT_END:
+            return t->markup >= 1 && t->markup - 2 <= (int)strlen(t->rawtext_tags[t->rawtext - 1]);
+        case HTMLSTREAM_STATE_ENTITY:      return t->markup == entity_len;
+        default:                           return t->markup >= 0;
+    }
+}
+
+// continue where a checkpoint of a parser with the same configuration left off.
+// t keeps its callbacks, flags and other configuration, and its buffers; the rest is
+// replaced. returns false (and resets t) if in is not a checkpoint of this version
+static inline bool htmlstream_restore(htmlstream_t *t, const char *in, int len)
+{
+    htmlstream_reset(t);
+    int at = 0;
+    const char *tag, *val, *entity, *skip_tag;
+    int tag_len, val_len, entity_len, skip_len;
+    if (htmlstream_internal_get(in, len, &at) != HTMLSTREAM_CHECKPOINT_VERSION) {
+        return false;
+    }
+    int state  = htmlstream_internal_get(in, len, &at);
+    t->ret     = htmlstream_internal_get(in, len, &at);
+    t->markup  = htmlstream_internal_get(in, len, &at);
+    t->rawtext = htmlstream_internal_get(in, len, &at);
+    t->skip    = htmlstream_internal_get(in, len, &at);
+    t->quote   = (char)htmlstream_internal_get(in, len, &at);
+    int bits   = htmlstream_internal_get(in, len, &at);
+    t->escaped     = bits & 1;
+    t->text_parted = (bits >> 1) & 1;
+    t->skip_open   = (bits >> 2) & 1;
+    t->skip_slash  = (bits >> 3) & 1;
+    if (!htmlstream_internal_get_bytes(in, len, &at, 0x7fffffff, &tag, &tag_len) ||
+            !htmlstream_internal_get_bytes(in, len, &at, 0x7fffffff, &val, &val_len) ||
+            !htmlstream_internal_get_bytes(in, len, &at, HTMLSTREAM_ENTITY_LONGEST, &entity, &entity_len) ||
+            !htmlstream_internal_get_bytes(in, len, &at, HTMLSTREAM_TAG_BUFFER_SIZE, &skip_tag, &skip_len)) {
+        htmlstream_reset(t);
+        return false;
+    }
+    t->utf8.invalid = htmlstream_internal_get(in, len, &at);
+    t->utf8.need    = htmlstream_internal_get(in, len, &at);
+    if (t->utf8.need) {
+        t->utf8.lo = (unsigned char)htmlstream_internal_get(in, len, &at);
+        t->utf8.hi = (unsigned char)htmlstream_internal_get(in, len, &at);
+    }
+    if (!htmlstream_internal_get_stack(t, (bits >> 4) & 1, in, len, &at)) {
+        htmlstream_reset(t);
+        return false;
+    }
+    if (at != len || state < 0 || state >= HTMLSTREAM_STATES || t->ret < 0 || t->ret >= HTMLSTREAM_STATES ||
+            !htmlstream_internal_restorable(t, state, entity_len)) {
+        htmlstream_reset(t);
+        return false;
+    }
+    // rcdata is not in the checkpoint, it follows from rawtext
+    const char *raw = t->rawtext ? t->rawtext_tags[t->rawtext - 1] : 0;
+    for (int i = 0; raw && t->rcdata_tags && t->rcdata_tags[i]; i++) {
+        t->rcdata = t->rcdata || strcmp(t->rcdata_tags[i], raw) == 0;
+    }
+    t->state = state;
+    t->tag.at = htmlstream_buffer_reserve(t, &t->tag, tag_len);
+    memcpy(htmlstream_buffer_data(&t->tag), tag, t->tag.at);
+    t->val.at = htmlstream_buffer_reserve(t, &t->val, val_len);
+    memcpy(htmlstream_buffer_data(&t->val), val, t->val.at);
+    memcpy(t->entity, entity, entity_len);
+    memcpy(t->skip_tag, skip_tag, skip_len);
+    t->skip_len = skip_len;
+    return true;
+}
+
+// decode the character references in len bytes of text at in, like HTMLSTREAM_DECODE does
+// while parsing. out (not overlapping in) needs room for len + len / 4 + 1 bytes.
+// returns how many it got
+static inline int htmlstream_decode(char *out, const char *in, int len)
+{
+    int at = 0;
+    int i  = 0;
+    while (i < len) {
+        int n = htmlstream_scan(in + i, len - i, '&', '&', '&', '&');
+        memcpy(out + at, in + i, n);
+        at += n;
+        i  += n;
+        if (i == len) {
+            break;
+        }
+        int out_len;
+        int used = htmlstream_internal_reference(in + i + 1, len - i - 1, false, out + at, &out_len);
+        if (!used) {
+            out[at] = '&';
+            out_len = 1;
+        }
+        at += out_len;
+        i  += 1 + used;
+    }
+    return at;
+}
+
+// HTMLSTREAM_SPECIALIZE(links_feed, 0, 0, my_attr_cb, 0) defines
+// static inline int links_feed(htmlstream_t *t, const char *data, int len),
+// a htmlstream_feed that calls the given functions (0 for none) directly instead of
+// t's callbacks, and does not even buffer what none of them wants.
+// t->parg, flags and alloc_cb are used as usual; the tape, text_part_cb and comment_cb are not.
+#define HTMLSTREAM_SPECIALIZE(NAME, OPEN, CLOSE, ATTR, TEXT) \
+static inline int NAME(htmlstream_t *t, const char *data, int len) \
+{ \
+    static const htmlstream_spec_t spec = {OPEN, CLOSE, ATTR, TEXT}; \
+    int used = htmlstream_internal_feed_chunk_spec(t, data, len, &spec); \
+    if (t->flags & HTMLSTREAM_UTF8) { \
+        htmlstream_internal_utf8_check(&t->utf8, data, used); \
+    } \
+    htmlstream_internal_end_chunk(t); \
+    return used; \
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef HTMLSTREAM_FILE_H
+#define HTMLSTREAM_FILE_H
+
+// parse straight from a file or file descriptor, instead of a read loop of your own.
+//
+// regular files are mapped with mmap and fed in one piece: nothing is copied, no token
+// is held back over a chunk boundary, and with HTMLSTREAM_ZEROCOPY the spans callbacks
+// get point into the mapping. what cannot be mapped (pipes, sockets, ttys, /proc) is
+// read HTMLSTREAM_FILE_BUFFER bytes at a time.
+
+#include "htmlstream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read size for what cannot be mapped
+#ifndef HTMLSTREAM_FILE_BUFFER
+#define HTMLSTREAM_FILE_BUFFER (1 << 20)
+#endif
+// htmlstream_feed takes an int, bigger mappings go in pieces of this
+#define HTMLSTREAM_FILE_PIECE  (1 << 30)
+
+// how many of the len bytes were parsed: less if a callback stopped parsing
+static size_t htmlstream_internal_feed_all(htmlstream_t *t, const char *data, size_t len)
+{
+    size_t used = 0;
+    while (used < len) {
+        int n = len - used < HTMLSTREAM_FILE_PIECE ? (int)(len - used) : HTMLSTREAM_FILE_PIECE;
+        int got = htmlstream_feed(t, data + used, n);
+        used += got;
+        if (got < n) {
+            break;
+        }
+    }
+    return used;
+}
+
+// map what is left of a regular file and feed it. -1 if it cannot be mapped, else
+// what htmlstream_feed_fd returns. fd is left after the last byte parsed
+static int htmlstream_internal_feed_map(htmlstream_t *t, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+            (off_t)(size_t)st.st_size != st.st_size) {
+        return -1;
+    }
+    // from where fd is, like read would
+    off_t at = lseek(fd, 0, SEEK_CUR);
+    if (at < 0 || at >= st.st_size) {
+        return -1;
+    }
+    void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+    size_t used = htmlstream_internal_feed_all(t, (const char *)map + at, st.st_size - at);
+    munmap(map, st.st_size);
+    lseek(fd, at + (off_t)used, SEEK_SET);
+    return used < (size_t)(st.st_size - at);
+}
+
+// feed everything that can be read from fd to t, like htmlstream_feed in a loop.
+// returns 0, 1 if a callback stopped parsing with htmlstream_stop, or -1 (errno tells
+// why) if fd could not be read. fd stays open. after a stop it is right after the last
+// byte parsed if it can seek, a pipe has read a buffer more
+static int htmlstream_feed_fd(htmlstream_t *t, int fd)
+{
+    int mapped = htmlstream_internal_feed_map(t, fd);
+    if (mapped >= 0) {
+        return mapped;
+    }
+    char *buf = (char *)malloc(HTMLSTREAM_FILE_BUFFER);
+    if (!buf) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int ret = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf, HTMLSTREAM_FILE_BUFFER);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ret = n < 0 ? -1 : 0;
+            break;
+        }
+        int used = htmlstream_feed(t, buf, (int)n);
+        if (used < n) {
+            lseek(fd, used - n, SEEK_CUR);
+            ret = 1;
+            break;
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+// htmlstream_feed_fd on the file at path
+static int htmlstream_feed_file(htmlstream_t *t, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = htmlstream_feed_fd(t, fd);
+    int err = errno;
+    close(fd);
+    errno = err;
+    return ret;
+}
+
+#endif
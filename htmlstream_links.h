@@ -0,0 +1,450 @@
+#ifndef HTMLSTREAM_LINKS_H
+#define HTMLSTREAM_LINKS_H
+
+// pull links and metadata out of a document, for crawlers: <a href>, <link href>,
+// <base href>, <meta> and the <title>, with urls resolved against the document's url
+// and its <base> as they come. results go into one array and one string buffer.
+//
+// this parses with HTMLSTREAM_SPECIALIZE parsers that buffer as little as they can.
+// outside the tags it wants only tag names are kept, not text or attribute values.
+// it switches to one that buffers values for the attributes of a, link, base and meta,
+// and to one that buffers text for the title. the callbacks switch it by stopping the
+// parser where they are, and the feed goes on from there with the other one.
+
+#include "htmlstream.h"
+#include "htmlstream_names.h"
+#include <stddef.h>
+#include <stdlib.h>
+
+// longest <base href> (resolved) or document url kept. longer ones are ignored
+#define HTMLSTREAM_LINKS_BASE 2048
+
+#define HTMLSTREAM_LINK_A     1    // <a href>, key is its rel
+#define HTMLSTREAM_LINK_LINK  2    // <link href>, key is its rel
+#define HTMLSTREAM_LINK_BASE  3    // <base href>, what later urls are resolved against
+#define HTMLSTREAM_LINK_META  4    // <meta content>, key is its name, property or http-equiv.
+                                   // <meta charset> has key "charset"
+#define HTMLSTREAM_LINK_TITLE 5    // the first <title>
+
+// which parser runs
+#define HTMLSTREAM_LINKS_SKIM  0
+#define HTMLSTREAM_LINKS_ATTRS 1
+#define HTMLSTREAM_LINKS_TITLE 2
+
+typedef struct
+{
+    int kind;
+    // resolved url, content or title: strings + value. both -1 if not there
+    int value;
+    int value_len;
+    // strings + key, or -1 and 0
+    int key;
+    int key_len;
+} htmlstream_link_t;
+
+typedef struct
+{
+    // the parser. flags are set to HTMLSTREAM_ZEROCOPY | HTMLSTREAM_DECODE | HTMLSTREAM_KEEP_CASE
+    // and it grows its buffers with malloc. its callbacks and parg belong to links
+    htmlstream_t t;
+    htmlstream_link_t *links;
+    int links_count;
+    char *strings;
+    int strings_at;
+    // memory ran out, parsing stopped there
+    bool failed;
+
+    int links_size;
+    int strings_size;
+    char base[HTMLSTREAM_LINKS_BASE];
+    int base_len;
+    // the tag whose attributes come now, not in links yet. kind 0 for none
+    htmlstream_link_t pending;
+    int pending_at;
+    int mode;
+    bool title;
+} htmlstream_links_t;
+
+// length of url's scheme (before the :), 0 if it has none
+static int htmlstream_links_scheme(const char *url, int len)
+{
+    if (len == 0 || (unsigned char)(HTMLSTREAM_ASCII_LOWER(url[0]) - 'a') >= 26) {
+        return 0;
+    }
+    for (int i = 1; i < len; i++) {
+        char c = url[i];
+        if (c == ':') {
+            return i;
+        }
+        if (!HTMLSTREAM_ISALNUM(c) && c != '+' && c != '-' && c != '.') {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+// first of a, b or c in url from at on, or len
+static inline int htmlstream_links_find(const char *url, int at, int len, char a, char b, char c)
+{
+    return at + htmlstream_scan(url + at, len - at, a, b, c, c);
+}
+
+// drop . and .. segments of path (which starts with /) in place. returns its new length
+static int htmlstream_links_dots(char *path, int len)
+{
+    int out = 0;
+    int i = 0;
+    while (i < len) {
+        int end = htmlstream_links_find(path, i + 1, len, '/', '/', '/');
+        const char *seg = path + i + 1;
+        int seg_len = end - i - 1;
+        if ((seg_len == 1 && seg[0] == '.') || (seg_len == 2 && seg[0] == '.' && seg[1] == '.')) {
+            if (seg_len == 2) {
+                while (out > 0 && path[--out] != '/') {
+                }
+            }
+            // a/b/.. is a/
+            if (end == len) {
+                path[out++] = '/';
+            }
+        } else {
+            memmove(path + out, path + i, end - i);
+            out += end - i;
+        }
+        i = end;
+    }
+    return out;
+}
+
+// ref resolved against base, like a browser does (rfc 3986). base has to be an absolute
+// url, without a scheme ref is taken as it is. out needs room for base_len + ref_len + 1
+// bytes. returns the length written
+static int htmlstream_links_resolve(const char *base, int base_len, const char *ref, int ref_len, char *out)
+{
+    int scheme = htmlstream_links_scheme(base, base_len);
+    if (!scheme || htmlstream_links_scheme(ref, ref_len)) {
+        memcpy(out, ref, ref_len);
+        return ref_len;
+    }
+    if (ref_len >= 2 && ref[0] == '/' && ref[1] == '/') {
+        // the base's scheme, and the path after the host without its dots
+        memcpy(out, base, scheme + 1);
+        int path = htmlstream_links_find(ref, 2, ref_len, '/', '?', '#');
+        int end  = htmlstream_links_find(ref, path, ref_len, '?', '#', '#');
+        memcpy(out + scheme + 1, ref, path);
+        int at = scheme + 1 + path;
+        memcpy(out + at, ref + path, end - path);
+        at += htmlstream_links_dots(out + at, end - path);
+        memcpy(out + at, ref + end, ref_len - end);
+        return at + ref_len - end;
+    }
+    int path = scheme + 1;
+    if (base_len >= path + 2 && base[path] == '/' && base[path + 1] == '/') {
+        path = htmlstream_links_find(base, path + 2, base_len, '/', '?', '#');
+    }
+    int query    = htmlstream_links_find(base, path, base_len, '?', '#', '#');
+    int fragment = htmlstream_links_find(base, query, base_len, '#', '#', '#');
+    int at;
+    if (ref_len == 0 || ref[0] == '#' || ref[0] == '?') {
+        at = ref_len && ref[0] == '?' ? query : fragment;
+        memcpy(out, base, at);
+        memcpy(out + at, ref, ref_len);
+        return at + ref_len;
+    }
+    memcpy(out, base, path);
+    at = path;
+    if (ref[0] != '/') {
+        // in the directory of the base path
+        int dir = query;
+        while (dir > path && base[dir - 1] != '/') {
+            dir--;
+        }
+        if (dir == path) {
+            out[at++] = '/';
+        }
+        memcpy(out + at, base + path, dir - path);
+        at += dir - path;
+    }
+    int end = htmlstream_links_find(ref, 0, ref_len, '?', '#', '#');
+    memcpy(out + at, ref, end);
+    at += end;
+    if (out[path] == '/') {
+        at = path + htmlstream_links_dots(out + path, at - path);
+    }
+    memcpy(out + at, ref + end, ref_len - end);
+    return at + ref_len - end;
+}
+
+static void htmlstream_links_fail(htmlstream_links_t *l)
+{
+    l->failed = true;
+    htmlstream_stop(&l->t);
+}
+
+// room for n more bytes of strings, or 0 if memory ran out
+static char *htmlstream_links_reserve(htmlstream_links_t *l, int n)
+{
+    if (n > l->strings_size - l->strings_at) {
+        int nusize = l->strings_size ? l->strings_size : 4096;
+        while (n > nusize - l->strings_at) {
+            nusize *= 2;
+        }
+        char *nu = (char *)realloc(l->strings, nusize);
+        if (!nu) {
+            htmlstream_links_fail(l);
+            return 0;
+        }
+        l->strings      = nu;
+        l->strings_size = nusize;
+    }
+    return l->strings + l->strings_at;
+}
+
+// copy s to strings, or resolve it against the base there. its offset (and *out its
+// length), or -1 if memory ran out
+static int htmlstream_links_string(htmlstream_links_t *l, const char *s, int len, bool url, int *out)
+{
+    *out = 0;
+    if (!s) {
+        s = "";
+    }
+    if (url) {
+        s = htmlstream_trimwhitespace(s, &len);
+    }
+    char *to = htmlstream_links_reserve(l, len + (url ? l->base_len + 1 : 0));
+    if (!to) {
+        return -1;
+    }
+    if (url) {
+        len = htmlstream_links_resolve(l->base, l->base_len, s, len, to);
+    } else {
+        memcpy(to, s, len);
+    }
+    int at = l->strings_at;
+    l->strings_at += len;
+    *out = len;
+    return at;
+}
+
+// the tag whose attributes were coming is over: keep what it had, if it had enough
+static void htmlstream_links_end(htmlstream_links_t *l)
+{
+    htmlstream_link_t *p = &l->pending;
+    if (!p->kind) {
+        return;
+    }
+    if (p->value < 0 || (p->kind == HTMLSTREAM_LINK_META && p->key < 0)) {
+        l->strings_at = l->pending_at;
+        p->kind = 0;
+        return;
+    }
+    if (p->kind == HTMLSTREAM_LINK_BASE && p->value_len <= HTMLSTREAM_LINKS_BASE) {
+        memcpy(l->base, l->strings + p->value, p->value_len);
+        l->base_len = p->value_len;
+    }
+    if (l->links_count == l->links_size) {
+        int nusize = l->links_size ? l->links_size * 2 : 256;
+        htmlstream_link_t *nu = (htmlstream_link_t *)realloc(l->links, nusize * sizeof(htmlstream_link_t));
+        if (!nu) {
+            htmlstream_links_fail(l);
+            p->kind = 0;
+            return;
+        }
+        l->links      = nu;
+        l->links_size = nusize;
+    }
+    l->links[l->links_count++] = *p;
+    p->kind = 0;
+}
+
+// run the parser for mode from the next byte on
+static void htmlstream_links_switch(htmlstream_links_t *l, int mode)
+{
+    if (l->mode != mode) {
+        l->mode = mode;
+        htmlstream_stop(&l->t);
+    }
+}
+
+static void htmlstream_links_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_links_t *l = (htmlstream_links_t *)parg;
+    htmlstream_links_end(l);
+    int kind = 0;
+    // most tags are none of these, tell without hashing
+    int id = len == 1 || len == 4 || len == 5 ? htmlstream_tag_id(tag, len) : 0;
+    switch (id) {
+        case HTMLSTREAM_TAG_A:
+            kind = HTMLSTREAM_LINK_A;
+            break;
+        case HTMLSTREAM_TAG_LINK:
+            kind = HTMLSTREAM_LINK_LINK;
+            break;
+        case HTMLSTREAM_TAG_BASE:
+            kind = HTMLSTREAM_LINK_BASE;
+            break;
+        case HTMLSTREAM_TAG_META:
+            kind = HTMLSTREAM_LINK_META;
+            break;
+        case HTMLSTREAM_TAG_TITLE:
+            htmlstream_links_switch(l, l->title ? HTMLSTREAM_LINKS_SKIM : HTMLSTREAM_LINKS_TITLE);
+            return;
+    }
+    if (kind) {
+        htmlstream_link_t *p = &l->pending;
+        p->kind      = kind;
+        p->value     = -1;
+        p->value_len = 0;
+        p->key       = -1;
+        p->key_len   = 0;
+        l->pending_at = l->strings_at;
+    }
+    htmlstream_links_switch(l, kind ? HTMLSTREAM_LINKS_ATTRS : HTMLSTREAM_LINKS_SKIM);
+}
+
+static void htmlstream_links_attr_cb(void *parg, const char *key, int key_len, const char *val, int val_len)
+{
+    htmlstream_links_t *l = (htmlstream_links_t *)parg;
+    htmlstream_link_t *p = &l->pending;
+    bool meta = p->kind == HTMLSTREAM_LINK_META;
+    bool value = false;
+    bool name  = false;
+    switch (htmlstream_attr_id(key, key_len)) {
+        case HTMLSTREAM_ATTR_HREF:
+            value = !meta;
+            break;
+        case HTMLSTREAM_ATTR_CONTENT:
+            value = meta;
+            break;
+        case HTMLSTREAM_ATTR_REL:
+            name = p->kind == HTMLSTREAM_LINK_A || p->kind == HTMLSTREAM_LINK_LINK;
+            break;
+        case HTMLSTREAM_ATTR_NAME:
+        case HTMLSTREAM_ATTR_PROPERTY:
+        case HTMLSTREAM_ATTR_HTTP_EQUIV:
+            name = meta;
+            break;
+        case HTMLSTREAM_ATTR_CHARSET:
+            if (meta && p->value < 0 && p->key < 0) {
+                p->key   = htmlstream_links_string(l, key, key_len, false, &p->key_len);
+                p->value = htmlstream_links_string(l, val, val_len, false, &p->value_len);
+            }
+            return;
+    }
+    // the first of each counts, like in a browser
+    if (value && p->value < 0) {
+        p->value = htmlstream_links_string(l, val, val_len, !meta, &p->value_len);
+    }
+    if (name && p->key < 0) {
+        p->key = htmlstream_links_string(l, val, val_len, false, &p->key_len);
+    }
+}
+
+static void htmlstream_links_text_cb(void *parg, const char *text, int len)
+{
+    htmlstream_links_t *l = (htmlstream_links_t *)parg;
+    // only the title's own text, not what comes after an empty one
+    if (l->mode != HTMLSTREAM_LINKS_TITLE || !l->t.rawtext) {
+        return;
+    }
+    htmlstream_link_t *p = &l->pending;
+    p->kind       = HTMLSTREAM_LINK_TITLE;
+    p->key        = -1;
+    p->key_len    = 0;
+    l->pending_at = l->strings_at;
+    p->value      = htmlstream_links_string(l, text, len, false, &p->value_len);
+    htmlstream_links_end(l);
+    l->title = true;
+    htmlstream_links_switch(l, HTMLSTREAM_LINKS_SKIM);
+}
+
+HTMLSTREAM_SPECIALIZE(htmlstream_links_skim, htmlstream_links_open_cb, 0, 0, 0)
+HTMLSTREAM_SPECIALIZE(htmlstream_links_attrs, htmlstream_links_open_cb, 0, htmlstream_links_attr_cb, 0)
+HTMLSTREAM_SPECIALIZE(htmlstream_links_title, htmlstream_links_open_cb, 0, 0, htmlstream_links_text_cb)
+
+static void *htmlstream_links_alloc(void *parg, void *ptr, int size)
+{
+    if (!size) {
+        free(ptr);
+        return 0;
+    }
+    return malloc(size);
+}
+
+// start over with a new document at url (0 if not known: relative urls stay as they are).
+// keeps all memory
+static void htmlstream_links_reset(htmlstream_links_t *l, const char *url)
+{
+    htmlstream_reset(&l->t);
+    l->links_count  = 0;
+    l->strings_at   = 0;
+    l->failed       = false;
+    l->pending.kind = 0;
+    l->mode         = HTMLSTREAM_LINKS_SKIM;
+    l->title        = false;
+    int len = url ? strlen(url) : 0;
+    l->base_len = len <= HTMLSTREAM_LINKS_BASE ? len : 0;
+    if (l->base_len) {
+        memcpy(l->base, url, l->base_len);
+    }
+}
+
+static void htmlstream_links_init(htmlstream_links_t *l, const char *url)
+{
+    memset(l, 0, offsetof(htmlstream_links_t, base));
+    htmlstream_init(&l->t);
+    l->t.flags    = HTMLSTREAM_ZEROCOPY | HTMLSTREAM_DECODE | HTMLSTREAM_KEEP_CASE;
+    l->t.alloc_cb = htmlstream_links_alloc;
+    l->t.parg     = l;
+    htmlstream_links_reset(l, url);
+}
+
+static void htmlstream_links_free(htmlstream_links_t *l)
+{
+    htmlstream_free(&l->t);
+    free(l->links);
+    free(l->strings);
+    l->links   = 0;
+    l->strings = 0;
+    l->links_size   = 0;
+    l->strings_size = 0;
+}
+
+// the next piece of the document, like htmlstream_feed. returns less than len if memory ran out
+static int htmlstream_links_feed(htmlstream_links_t *l, const char *data, int len)
+{
+    int at = 0;
+    while (at < len && !l->failed) {
+        if (l->mode == HTMLSTREAM_LINKS_SKIM) {
+            at += htmlstream_links_skim(&l->t, data + at, len - at);
+        } else if (l->mode == HTMLSTREAM_LINKS_ATTRS) {
+            at += htmlstream_links_attrs(&l->t, data + at, len - at);
+        } else {
+            at += htmlstream_links_title(&l->t, data + at, len - at);
+        }
+        // a callback switched parsers, not a real stop
+        if (!l->failed) {
+            l->t.skip = 0;
+        }
+    }
+    return at;
+}
+
+// after the last htmlstream_links_feed: the last tag may still have to go into links
+static inline void htmlstream_links_finish(htmlstream_links_t *l)
+{
+    htmlstream_links_end(l);
+}
+
+static inline const char *htmlstream_link_value(const htmlstream_links_t *l, const htmlstream_link_t *link)
+{
+    return l->strings + link->value;
+}
+
+// 0 if it has none
+static inline const char *htmlstream_link_key(const htmlstream_links_t *l, const htmlstream_link_t *link)
+{
+    return link->key < 0 ? 0 : l->strings + link->key;
+}
+
+#endif
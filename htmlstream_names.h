@@ -0,0 +1,418 @@
+// generated by htmlstream_names.py, do not edit
+// ids for known tag and attribute names: HTMLSTREAM_TAG_DIV, HTMLSTREAM_ATTR_HREF, ...
+#ifndef HTMLSTREAM_NAMES_H
+#define HTMLSTREAM_NAMES_H
+
+#include "htmlstream.h"
+
+// htmlstream_tag_flags[id]
+#define HTMLSTREAM_TAG_VOID    1    // never has content or an end tag
+#define HTMLSTREAM_TAG_RAWTEXT 2    // content is text in html: script, style, textarea, title, xmp
+
+#define HTMLSTREAM_TAG_A                    1
+#define HTMLSTREAM_TAG_ABBR                 2
+#define HTMLSTREAM_TAG_ACRONYM              3
+#define HTMLSTREAM_TAG_ADDRESS              4
+#define HTMLSTREAM_TAG_AREA                 5
+#define HTMLSTREAM_TAG_ARTICLE              6
+#define HTMLSTREAM_TAG_ASIDE                7
+#define HTMLSTREAM_TAG_AUDIO                8
+#define HTMLSTREAM_TAG_B                    9
+#define HTMLSTREAM_TAG_BASE                 10
+#define HTMLSTREAM_TAG_BASEFONT             11
+#define HTMLSTREAM_TAG_BDI                  12
+#define HTMLSTREAM_TAG_BDO                  13
+#define HTMLSTREAM_TAG_BIG                  14
+#define HTMLSTREAM_TAG_BLOCKQUOTE           15
+#define HTMLSTREAM_TAG_BODY                 16
+#define HTMLSTREAM_TAG_BR                   17
+#define HTMLSTREAM_TAG_BUTTON               18
+#define HTMLSTREAM_TAG_CANVAS               19
+#define HTMLSTREAM_TAG_CAPTION              20
+#define HTMLSTREAM_TAG_CENTER               21
+#define HTMLSTREAM_TAG_CITE                 22
+#define HTMLSTREAM_TAG_CODE                 23
+#define HTMLSTREAM_TAG_COL                  24
+#define HTMLSTREAM_TAG_COLGROUP             25
+#define HTMLSTREAM_TAG_DATA                 26
+#define HTMLSTREAM_TAG_DATALIST             27
+#define HTMLSTREAM_TAG_DD                   28
+#define HTMLSTREAM_TAG_DEL                  29
+#define HTMLSTREAM_TAG_DETAILS              30
+#define HTMLSTREAM_TAG_DFN                  31
+#define HTMLSTREAM_TAG_DIALOG               32
+#define HTMLSTREAM_TAG_DIR                  33
+#define HTMLSTREAM_TAG_DIV                  34
+#define HTMLSTREAM_TAG_DL                   35
+#define HTMLSTREAM_TAG_DT                   36
+#define HTMLSTREAM_TAG_EM                   37
+#define HTMLSTREAM_TAG_EMBED                38
+#define HTMLSTREAM_TAG_FIELDSET             39
+#define HTMLSTREAM_TAG_FIGCAPTION           40
+#define HTMLSTREAM_TAG_FIGURE               41
+#define HTMLSTREAM_TAG_FONT                 42
+#define HTMLSTREAM_TAG_FOOTER               43
+#define HTMLSTREAM_TAG_FORM                 44
+#define HTMLSTREAM_TAG_FRAME                45
+#define HTMLSTREAM_TAG_FRAMESET             46
+#define HTMLSTREAM_TAG_H1                   47
+#define HTMLSTREAM_TAG_H2                   48
+#define HTMLSTREAM_TAG_H3                   49
+#define HTMLSTREAM_TAG_H4                   50
+#define HTMLSTREAM_TAG_H5                   51
+#define HTMLSTREAM_TAG_H6                   52
+#define HTMLSTREAM_TAG_HEAD                 53
+#define HTMLSTREAM_TAG_HEADER               54
+#define HTMLSTREAM_TAG_HGROUP               55
+#define HTMLSTREAM_TAG_HR                   56
+#define HTMLSTREAM_TAG_HTML                 57
+#define HTMLSTREAM_TAG_I                    58
+#define HTMLSTREAM_TAG_IFRAME               59
+#define HTMLSTREAM_TAG_IMG                  60
+#define HTMLSTREAM_TAG_INPUT                61
+#define HTMLSTREAM_TAG_INS                  62
+#define HTMLSTREAM_TAG_KBD                  63
+#define HTMLSTREAM_TAG_LABEL                64
+#define HTMLSTREAM_TAG_LEGEND               65
+#define HTMLSTREAM_TAG_LI                   66
+#define HTMLSTREAM_TAG_LINK                 67
+#define HTMLSTREAM_TAG_MAIN                 68
+#define HTMLSTREAM_TAG_MAP                  69
+#define HTMLSTREAM_TAG_MARK                 70
+#define HTMLSTREAM_TAG_MARQUEE              71
+#define HTMLSTREAM_TAG_MATH                 72
+#define HTMLSTREAM_TAG_MENU                 73
+#define HTMLSTREAM_TAG_META                 74
+#define HTMLSTREAM_TAG_METER                75
+#define HTMLSTREAM_TAG_NAV                  76
+#define HTMLSTREAM_TAG_NOFRAMES             77
+#define HTMLSTREAM_TAG_NOSCRIPT             78
+#define HTMLSTREAM_TAG_OBJECT               79
+#define HTMLSTREAM_TAG_OL                   80
+#define HTMLSTREAM_TAG_OPTGROUP             81
+#define HTMLSTREAM_TAG_OPTION               82
+#define HTMLSTREAM_TAG_OUTPUT               83
+#define HTMLSTREAM_TAG_P                    84
+#define HTMLSTREAM_TAG_PARAM                85
+#define HTMLSTREAM_TAG_PICTURE              86
+#define HTMLSTREAM_TAG_PRE                  87
+#define HTMLSTREAM_TAG_PROGRESS             88
+#define HTMLSTREAM_TAG_Q                    89
+#define HTMLSTREAM_TAG_RP                   90
+#define HTMLSTREAM_TAG_RT                   91
+#define HTMLSTREAM_TAG_RUBY                 92
+#define HTMLSTREAM_TAG_S                    93
+#define HTMLSTREAM_TAG_SAMP                 94
+#define HTMLSTREAM_TAG_SCRIPT               95
+#define HTMLSTREAM_TAG_SEARCH               96
+#define HTMLSTREAM_TAG_SECTION              97
+#define HTMLSTREAM_TAG_SELECT               98
+#define HTMLSTREAM_TAG_SLOT                 99
+#define HTMLSTREAM_TAG_SMALL                100
+#define HTMLSTREAM_TAG_SOURCE               101
+#define HTMLSTREAM_TAG_SPAN                 102
+#define HTMLSTREAM_TAG_STRIKE               103
+#define HTMLSTREAM_TAG_STRONG               104
+#define HTMLSTREAM_TAG_STYLE                105
+#define HTMLSTREAM_TAG_SUB                  106
+#define HTMLSTREAM_TAG_SUMMARY              107
+#define HTMLSTREAM_TAG_SUP                  108
+#define HTMLSTREAM_TAG_SVG                  109
+#define HTMLSTREAM_TAG_TABLE                110
+#define HTMLSTREAM_TAG_TBODY                111
+#define HTMLSTREAM_TAG_TD                   112
+#define HTMLSTREAM_TAG_TEMPLATE             113
+#define HTMLSTREAM_TAG_TEXTAREA             114
+#define HTMLSTREAM_TAG_TFOOT                115
+#define HTMLSTREAM_TAG_TH                   116
+#define HTMLSTREAM_TAG_THEAD                117
+#define HTMLSTREAM_TAG_TIME                 118
+#define HTMLSTREAM_TAG_TITLE                119
+#define HTMLSTREAM_TAG_TR                   120
+#define HTMLSTREAM_TAG_TRACK                121
+#define HTMLSTREAM_TAG_TT                   122
+#define HTMLSTREAM_TAG_U                    123
+#define HTMLSTREAM_TAG_UL                   124
+#define HTMLSTREAM_TAG_VAR                  125
+#define HTMLSTREAM_TAG_VIDEO                126
+#define HTMLSTREAM_TAG_WBR                  127
+#define HTMLSTREAM_TAG_XMP                  128
+#define HTMLSTREAM_TAG_COUNT 129
+#define HTMLSTREAM_TAG_BITS  8
+#define HTMLSTREAM_TAG_BUCKET_BITS 6
+#define HTMLSTREAM_TAG_LONGEST 10
+
+static const char *const htmlstream_tag_names[HTMLSTREAM_TAG_COUNT] = {
+    0, "a", "abbr", "acronym", "address", "area", "article", "aside", "audio", "b", "base",
+    "basefont", "bdi", "bdo", "big", "blockquote", "body", "br", "button", "canvas", "caption",
+    "center", "cite", "code", "col", "colgroup", "data", "datalist", "dd", "del", "details", "dfn",
+    "dialog", "dir", "div", "dl", "dt", "em", "embed", "fieldset", "figcaption", "figure", "font",
+    "footer", "form", "frame", "frameset", "h1", "h2", "h3", "h4", "h5", "h6", "head", "header",
+    "hgroup", "hr", "html", "i", "iframe", "img", "input", "ins", "kbd", "label", "legend", "li",
+    "link", "main", "map", "mark", "marquee", "math", "menu", "meta", "meter", "nav", "noframes",
+    "noscript", "object", "ol", "optgroup", "option", "output", "p", "param", "picture", "pre",
+    "progress", "q", "rp", "rt", "ruby", "s", "samp", "script", "search", "section", "select",
+    "slot", "small", "source", "span", "strike", "strong", "style", "sub", "summary", "sup", "svg",
+    "table", "tbody", "td", "template", "textarea", "tfoot", "th", "thead", "time", "title", "tr",
+    "track", "tt", "u", "ul", "var", "video", "wbr", "xmp",
+};
+static const unsigned char htmlstream_tag_lens[HTMLSTREAM_TAG_COUNT] = {
+    0, 1, 4, 7, 7, 4, 7, 5, 5, 1, 4, 8, 3, 3, 3, 10, 4, 2, 6, 6,
+    7, 6, 4, 4, 3, 8, 4, 8, 2, 3, 7, 3, 6, 3, 3, 2, 2, 2, 5, 8,
+    10, 6, 4, 6, 4, 5, 8, 2, 2, 2, 2, 2, 2, 4, 6, 6, 2, 4, 1, 6,
+    3, 5, 3, 3, 5, 6, 2, 4, 4, 3, 4, 7, 4, 4, 4, 5, 3, 8, 8, 6,
+    2, 8, 6, 6, 1, 5, 7, 3, 8, 1, 2, 2, 4, 1, 4, 6, 6, 7, 6, 4,
+    5, 6, 4, 6, 6, 5, 3, 7, 3, 3, 5, 5, 2, 8, 8, 5, 2, 5, 4, 5,
+    2, 5, 2, 1, 2, 3, 5, 3, 3,
+};
+static const unsigned char htmlstream_tag_flags[HTMLSTREAM_TAG_COUNT] = {
+    0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0,
+    0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0,
+    0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+    1, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0,
+    0, 1, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 2,
+    0, 1, 0, 0, 0, 0, 0, 1, 2,
+};
+static const unsigned char htmlstream_tag_displace[1 << HTMLSTREAM_TAG_BUCKET_BITS] = {
+    5, 2, 2, 0, 1, 0, 0, 2, 1, 0, 2, 1, 0, 0, 0, 2, 2, 3, 1, 1,
+    0, 0, 1, 7, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 3, 0, 0,
+    5, 0, 1, 0, 0, 4, 3, 2, 0, 0, 2, 0, 0, 1, 0, 0, 0, 0, 2, 0,
+    0, 0, 1, 0,
+};
+static const unsigned char htmlstream_tag_slots[1 << HTMLSTREAM_TAG_BITS] = {
+    39, 14, 53, 24, 0, 0, 69, 4, 47, 90, 0, 0, 67, 0, 83, 112, 79, 0, 0, 0,
+    0, 7, 94, 0, 125, 57, 0, 2, 0, 106, 100, 73, 0, 0, 99, 0, 0, 44, 0, 0,
+    0, 0, 0, 88, 0, 0, 0, 30, 0, 25, 0, 0, 0, 0, 0, 120, 0, 0, 81, 0,
+    80, 0, 0, 0, 0, 0, 43, 102, 71, 128, 0, 36, 9, 0, 15, 0, 0, 103, 0, 0,
+    54, 0, 0, 74, 104, 0, 110, 70, 0, 0, 0, 22, 0, 56, 34, 48, 0, 63, 0, 89,
+    29, 115, 0, 0, 0, 124, 0, 23, 0, 0, 12, 123, 0, 0, 0, 0, 62, 32, 111, 98,
+    27, 0, 58, 6, 85, 0, 0, 108, 11, 121, 40, 65, 0, 122, 0, 46, 91, 113, 0, 20,
+    38, 0, 0, 0, 1, 35, 0, 0, 0, 0, 0, 0, 0, 45, 114, 16, 5, 126, 51, 107,
+    33, 84, 0, 92, 82, 0, 55, 86, 0, 59, 0, 0, 0, 96, 49, 0, 0, 41, 0, 0,
+    109, 116, 31, 101, 0, 0, 0, 95, 0, 72, 0, 0, 64, 37, 68, 21, 0, 0, 61, 76,
+    0, 0, 0, 0, 127, 0, 0, 119, 117, 75, 0, 0, 0, 0, 52, 97, 105, 0, 17, 0,
+    8, 19, 93, 0, 0, 0, 42, 50, 0, 26, 0, 77, 13, 0, 0, 0, 78, 87, 0, 118,
+    0, 0, 18, 0, 0, 28, 10, 0, 0, 3, 0, 0, 0, 66, 60, 0,
+};
+
+#define HTMLSTREAM_ATTR_ACCEPT               1
+#define HTMLSTREAM_ATTR_ACCEPT_CHARSET       2
+#define HTMLSTREAM_ATTR_ACCESSKEY            3
+#define HTMLSTREAM_ATTR_ACTION               4
+#define HTMLSTREAM_ATTR_ALIGN                5
+#define HTMLSTREAM_ATTR_ALLOW                6
+#define HTMLSTREAM_ATTR_ALT                  7
+#define HTMLSTREAM_ATTR_ARIA_HIDDEN          8
+#define HTMLSTREAM_ATTR_ARIA_LABEL           9
+#define HTMLSTREAM_ATTR_ASYNC                10
+#define HTMLSTREAM_ATTR_AUTOCAPITALIZE       11
+#define HTMLSTREAM_ATTR_AUTOCOMPLETE         12
+#define HTMLSTREAM_ATTR_AUTOFOCUS            13
+#define HTMLSTREAM_ATTR_AUTOPLAY             14
+#define HTMLSTREAM_ATTR_BACKGROUND           15
+#define HTMLSTREAM_ATTR_BGCOLOR              16
+#define HTMLSTREAM_ATTR_BORDER               17
+#define HTMLSTREAM_ATTR_CELLPADDING          18
+#define HTMLSTREAM_ATTR_CELLSPACING          19
+#define HTMLSTREAM_ATTR_CHARSET              20
+#define HTMLSTREAM_ATTR_CHECKED              21
+#define HTMLSTREAM_ATTR_CITE                 22
+#define HTMLSTREAM_ATTR_CLASS                23
+#define HTMLSTREAM_ATTR_COLOR                24
+#define HTMLSTREAM_ATTR_COLS                 25
+#define HTMLSTREAM_ATTR_COLSPAN              26
+#define HTMLSTREAM_ATTR_CONTENT              27
+#define HTMLSTREAM_ATTR_CONTENTEDITABLE      28
+#define HTMLSTREAM_ATTR_CONTROLS             29
+#define HTMLSTREAM_ATTR_COORDS               30
+#define HTMLSTREAM_ATTR_CROSSORIGIN          31
+#define HTMLSTREAM_ATTR_DATA                 32
+#define HTMLSTREAM_ATTR_DATETIME             33
+#define HTMLSTREAM_ATTR_DECODING             34
+#define HTMLSTREAM_ATTR_DEFAULT              35
+#define HTMLSTREAM_ATTR_DEFER                36
+#define HTMLSTREAM_ATTR_DIR                  37
+#define HTMLSTREAM_ATTR_DIRNAME              38
+#define HTMLSTREAM_ATTR_DISABLED             39
+#define HTMLSTREAM_ATTR_DOWNLOAD             40
+#define HTMLSTREAM_ATTR_DRAGGABLE            41
+#define HTMLSTREAM_ATTR_ENCTYPE              42
+#define HTMLSTREAM_ATTR_ENTERKEYHINT         43
+#define HTMLSTREAM_ATTR_FOR                  44
+#define HTMLSTREAM_ATTR_FORM                 45
+#define HTMLSTREAM_ATTR_FORMACTION           46
+#define HTMLSTREAM_ATTR_FORMENCTYPE          47
+#define HTMLSTREAM_ATTR_FORMMETHOD           48
+#define HTMLSTREAM_ATTR_FORMNOVALIDATE       49
+#define HTMLSTREAM_ATTR_FORMTARGET           50
+#define HTMLSTREAM_ATTR_HEADERS              51
+#define HTMLSTREAM_ATTR_HEIGHT               52
+#define HTMLSTREAM_ATTR_HIDDEN               53
+#define HTMLSTREAM_ATTR_HIGH                 54
+#define HTMLSTREAM_ATTR_HREF                 55
+#define HTMLSTREAM_ATTR_HREFLANG             56
+#define HTMLSTREAM_ATTR_HTTP_EQUIV           57
+#define HTMLSTREAM_ATTR_ID                   58
+#define HTMLSTREAM_ATTR_INERT                59
+#define HTMLSTREAM_ATTR_INPUTMODE            60
+#define HTMLSTREAM_ATTR_INTEGRITY            61
+#define HTMLSTREAM_ATTR_IS                   62
+#define HTMLSTREAM_ATTR_ITEMID               63
+#define HTMLSTREAM_ATTR_ITEMPROP             64
+#define HTMLSTREAM_ATTR_ITEMREF              65
+#define HTMLSTREAM_ATTR_ITEMSCOPE            66
+#define HTMLSTREAM_ATTR_ITEMTYPE             67
+#define HTMLSTREAM_ATTR_KIND                 68
+#define HTMLSTREAM_ATTR_LABEL                69
+#define HTMLSTREAM_ATTR_LANG                 70
+#define HTMLSTREAM_ATTR_LANGUAGE             71
+#define HTMLSTREAM_ATTR_LIST                 72
+#define HTMLSTREAM_ATTR_LOADING              73
+#define HTMLSTREAM_ATTR_LOOP                 74
+#define HTMLSTREAM_ATTR_LOW                  75
+#define HTMLSTREAM_ATTR_MAX                  76
+#define HTMLSTREAM_ATTR_MAXLENGTH            77
+#define HTMLSTREAM_ATTR_MEDIA                78
+#define HTMLSTREAM_ATTR_METHOD               79
+#define HTMLSTREAM_ATTR_MIN                  80
+#define HTMLSTREAM_ATTR_MINLENGTH            81
+#define HTMLSTREAM_ATTR_MULTIPLE             82
+#define HTMLSTREAM_ATTR_MUTED                83
+#define HTMLSTREAM_ATTR_NAME                 84
+#define HTMLSTREAM_ATTR_NONCE                85
+#define HTMLSTREAM_ATTR_NOVALIDATE           86
+#define HTMLSTREAM_ATTR_ONCHANGE             87
+#define HTMLSTREAM_ATTR_ONCLICK              88
+#define HTMLSTREAM_ATTR_ONERROR              89
+#define HTMLSTREAM_ATTR_ONLOAD               90
+#define HTMLSTREAM_ATTR_ONSUBMIT             91
+#define HTMLSTREAM_ATTR_OPEN                 92
+#define HTMLSTREAM_ATTR_OPTIMUM              93
+#define HTMLSTREAM_ATTR_PATTERN              94
+#define HTMLSTREAM_ATTR_PING                 95
+#define HTMLSTREAM_ATTR_PLACEHOLDER          96
+#define HTMLSTREAM_ATTR_PLAYSINLINE          97
+#define HTMLSTREAM_ATTR_POPOVER              98
+#define HTMLSTREAM_ATTR_POSTER               99
+#define HTMLSTREAM_ATTR_PRELOAD              100
+#define HTMLSTREAM_ATTR_PROPERTY             101
+#define HTMLSTREAM_ATTR_READONLY             102
+#define HTMLSTREAM_ATTR_REFERRERPOLICY       103
+#define HTMLSTREAM_ATTR_REL                  104
+#define HTMLSTREAM_ATTR_REQUIRED             105
+#define HTMLSTREAM_ATTR_REVERSED             106
+#define HTMLSTREAM_ATTR_ROLE                 107
+#define HTMLSTREAM_ATTR_ROWS                 108
+#define HTMLSTREAM_ATTR_ROWSPAN              109
+#define HTMLSTREAM_ATTR_SANDBOX              110
+#define HTMLSTREAM_ATTR_SCOPE                111
+#define HTMLSTREAM_ATTR_SELECTED             112
+#define HTMLSTREAM_ATTR_SHAPE                113
+#define HTMLSTREAM_ATTR_SIZE                 114
+#define HTMLSTREAM_ATTR_SIZES                115
+#define HTMLSTREAM_ATTR_SLOT                 116
+#define HTMLSTREAM_ATTR_SPAN                 117
+#define HTMLSTREAM_ATTR_SPELLCHECK           118
+#define HTMLSTREAM_ATTR_SRC                  119
+#define HTMLSTREAM_ATTR_SRCDOC               120
+#define HTMLSTREAM_ATTR_SRCLANG              121
+#define HTMLSTREAM_ATTR_SRCSET               122
+#define HTMLSTREAM_ATTR_START                123
+#define HTMLSTREAM_ATTR_STEP                 124
+#define HTMLSTREAM_ATTR_STYLE                125
+#define HTMLSTREAM_ATTR_TABINDEX             126
+#define HTMLSTREAM_ATTR_TARGET               127
+#define HTMLSTREAM_ATTR_TITLE                128
+#define HTMLSTREAM_ATTR_TRANSLATE            129
+#define HTMLSTREAM_ATTR_TYPE                 130
+#define HTMLSTREAM_ATTR_USEMAP               131
+#define HTMLSTREAM_ATTR_VALIGN               132
+#define HTMLSTREAM_ATTR_VALUE                133
+#define HTMLSTREAM_ATTR_WIDTH                134
+#define HTMLSTREAM_ATTR_WRAP                 135
+#define HTMLSTREAM_ATTR_XMLNS                136
+#define HTMLSTREAM_ATTR_COUNT 137
+#define HTMLSTREAM_ATTR_BITS  8
+#define HTMLSTREAM_ATTR_BUCKET_BITS 6
+#define HTMLSTREAM_ATTR_LONGEST 15
+
+static const char *const htmlstream_attr_names[HTMLSTREAM_ATTR_COUNT] = {
+    0, "accept", "accept-charset", "accesskey", "action", "align", "allow", "alt", "aria-hidden",
+    "aria-label", "async", "autocapitalize", "autocomplete", "autofocus", "autoplay", "background",
+    "bgcolor", "border", "cellpadding", "cellspacing", "charset", "checked", "cite", "class",
+    "color", "cols", "colspan", "content", "contenteditable", "controls", "coords", "crossorigin",
+    "data", "datetime", "decoding", "default", "defer", "dir", "dirname", "disabled", "download",
+    "draggable", "enctype", "enterkeyhint", "for", "form", "formaction", "formenctype",
+    "formmethod", "formnovalidate", "formtarget", "headers", "height", "hidden", "high", "href",
+    "hreflang", "http-equiv", "id", "inert", "inputmode", "integrity", "is", "itemid", "itemprop",
+    "itemref", "itemscope", "itemtype", "kind", "label", "lang", "language", "list", "loading",
+    "loop", "low", "max", "maxlength", "media", "method", "min", "minlength", "multiple", "muted",
+    "name", "nonce", "novalidate", "onchange", "onclick", "onerror", "onload", "onsubmit", "open",
+    "optimum", "pattern", "ping", "placeholder", "playsinline", "popover", "poster", "preload",
+    "property", "readonly", "referrerpolicy", "rel", "required", "reversed", "role", "rows",
+    "rowspan", "sandbox", "scope", "selected", "shape", "size", "sizes", "slot", "span",
+    "spellcheck", "src", "srcdoc", "srclang", "srcset", "start", "step", "style", "tabindex",
+    "target", "title", "translate", "type", "usemap", "valign", "value", "width", "wrap", "xmlns",
+};
+static const unsigned char htmlstream_attr_lens[HTMLSTREAM_ATTR_COUNT] = {
+    0, 6, 14, 9, 6, 5, 5, 3, 11, 10, 5, 14, 12, 9, 8, 10, 7, 6, 11, 11,
+    7, 7, 4, 5, 5, 4, 7, 7, 15, 8, 6, 11, 4, 8, 8, 7, 5, 3, 7, 8,
+    8, 9, 7, 12, 3, 4, 10, 11, 10, 14, 10, 7, 6, 6, 4, 4, 8, 10, 2, 5,
+    9, 9, 2, 6, 8, 7, 9, 8, 4, 5, 4, 8, 4, 7, 4, 3, 3, 9, 5, 6,
+    3, 9, 8, 5, 4, 5, 10, 8, 7, 7, 6, 8, 4, 7, 7, 4, 11, 11, 7, 6,
+    7, 8, 8, 14, 3, 8, 8, 4, 4, 7, 7, 5, 8, 5, 4, 5, 4, 4, 10, 3,
+    6, 7, 6, 5, 4, 5, 8, 6, 5, 9, 4, 6, 6, 5, 5, 4, 5,
+};
+static const unsigned char htmlstream_attr_displace[1 << HTMLSTREAM_ATTR_BUCKET_BITS] = {
+    0, 0, 3, 2, 0, 1, 2, 0, 1, 3, 6, 8, 0, 2, 0, 0, 0, 0, 2, 0,
+    1, 0, 2, 3, 0, 3, 1, 1, 0, 0, 1, 1, 5, 1, 2, 2, 0, 2, 0, 1,
+    1, 0, 3, 0, 0, 0, 2, 9, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 0, 0,
+    0, 0, 1, 0,
+};
+static const unsigned char htmlstream_attr_slots[1 << HTMLSTREAM_ATTR_BITS] = {
+    0, 30, 0, 33, 44, 119, 0, 0, 42, 84, 0, 35, 0, 0, 97, 78, 51, 0, 120, 130,
+    109, 0, 0, 0, 0, 115, 0, 0, 1, 76, 131, 48, 0, 117, 116, 15, 55, 102, 67, 110,
+    0, 135, 7, 59, 0, 0, 75, 0, 108, 92, 0, 0, 36, 96, 94, 0, 0, 10, 0, 52,
+    5, 0, 0, 0, 0, 0, 0, 0, 23, 71, 126, 0, 0, 0, 0, 0, 80, 111, 39, 8,
+    122, 0, 90, 37, 0, 0, 65, 0, 43, 0, 0, 74, 63, 132, 0, 0, 112, 0, 0, 0,
+    47, 0, 0, 88, 66, 0, 0, 0, 24, 83, 25, 0, 103, 104, 101, 18, 9, 121, 129, 91,
+    0, 0, 0, 0, 0, 14, 134, 72, 56, 0, 0, 27, 89, 11, 0, 0, 93, 0, 0, 0,
+    0, 0, 114, 0, 87, 32, 6, 62, 61, 73, 0, 53, 0, 0, 19, 0, 3, 0, 17, 0,
+    0, 0, 105, 82, 70, 12, 0, 118, 0, 0, 0, 0, 123, 0, 0, 79, 0, 31, 49, 0,
+    107, 0, 34, 0, 136, 0, 113, 127, 124, 0, 0, 0, 69, 0, 4, 45, 0, 64, 0, 41,
+    86, 0, 0, 0, 0, 0, 0, 128, 0, 29, 0, 2, 0, 50, 60, 68, 125, 0, 0, 0,
+    57, 106, 85, 0, 13, 77, 22, 100, 16, 58, 0, 99, 0, 38, 0, 0, 0, 133, 0, 40,
+    46, 0, 81, 95, 0, 98, 28, 26, 0, 21, 0, 20, 54, 0, 0, 0,
+};
+
+// 0 for names not in the table
+HTMLSTREAM_INLINE int htmlstream_internal_name_id(const char *name, int len, int longest,
+        const unsigned char *displace, int bucket_bits, const unsigned char *slots, int bits,
+        const char *const *names, const unsigned char *lens)
+{
+    if (len < 1 || len > longest) {
+        return 0;
+    }
+    uint32_t h = htmlstream_internal_hash(name, len);
+    int id = slots[htmlstream_internal_slot(h, displace[h >> (32 - bucket_bits)], bits)];
+    return lens[id] == len && memcmp(names[id], name, len) == 0 ? id : 0;
+}
+
+// HTMLSTREAM_TAG_ id of a tag name as open_cb and close_cb get it, or 0
+static inline int htmlstream_tag_id(const char *tag, int len)
+{
+    return htmlstream_internal_name_id(tag, len, HTMLSTREAM_TAG_LONGEST,
+            htmlstream_tag_displace, HTMLSTREAM_TAG_BUCKET_BITS, htmlstream_tag_slots, HTMLSTREAM_TAG_BITS,
+            htmlstream_tag_names, htmlstream_tag_lens);
+}
+
+// HTMLSTREAM_ATTR_ id of an attribute name as attr_cb gets it, or 0
+static inline int htmlstream_attr_id(const char *key, int len)
+{
+    return htmlstream_internal_name_id(key, len, HTMLSTREAM_ATTR_LONGEST,
+            htmlstream_attr_displace, HTMLSTREAM_ATTR_BUCKET_BITS, htmlstream_attr_slots, HTMLSTREAM_ATTR_BITS,
+            htmlstream_attr_names, htmlstream_attr_lens);
+}
+
+#endif
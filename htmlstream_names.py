@@ -0,0 +1,266 @@
+#!/usr/bin/env python3
+# writes htmlstream_names.h: ids for known tag and attribute names, and perfect
+# hash tables that htmlstream_tag_id and htmlstream_attr_id look them up in.
+# with "entities", writes htmlstream_entities.h: the html5 named character references
+# in the same kind of table, for HTMLSTREAM_DECODE.
+#
+#   python3 htmlstream_names.py > htmlstream_names.h   (or make names)
+#   python3 htmlstream_names.py entities > htmlstream_entities.h
+#
+# ids are positions in the lists below, counting from 1. only ever append to them,
+# users keep ids around.
+
+TAGS = """
+a abbr acronym address area article aside audio b base basefont bdi bdo big blockquote
+body br button canvas caption center cite code col colgroup data datalist dd del details
+dfn dialog dir div dl dt em embed fieldset figcaption figure font footer form frame
+frameset h1 h2 h3 h4 h5 h6 head header hgroup hr html i iframe img input ins kbd label
+legend li link main map mark marquee math menu meta meter nav noframes noscript object ol
+optgroup option output p param picture pre progress q rp rt ruby s samp script search
+section select slot small source span strike strong style sub summary sup svg table tbody
+td template textarea tfoot th thead time title tr track tt u ul var video wbr xmp
+""".split()
+
+ATTRS = """
+accept accept-charset accesskey action align allow alt aria-hidden aria-label async
+autocapitalize autocomplete autofocus autoplay background bgcolor border cellpadding
+cellspacing charset checked cite class color cols colspan content contenteditable controls
+coords crossorigin data datetime decoding default defer dir dirname disabled download
+draggable enctype enterkeyhint for form formaction formenctype formmethod formnovalidate
+formtarget headers height hidden high href hreflang http-equiv id inert inputmode
+integrity is itemid itemprop itemref itemscope itemtype kind label lang language list
+loading loop low max maxlength media method min minlength multiple muted name nonce
+novalidate onchange onclick onerror onload onsubmit open optimum pattern ping placeholder
+playsinline popover poster preload property readonly referrerpolicy rel required reversed
+role rows rowspan sandbox scope selected shape size sizes slot span spellcheck src srcdoc
+srclang srcset start step style tabindex target title translate type usemap valign value
+width wrap xmlns
+""".split()
+
+# flags for tags, see htmlstream_names.h. htmlstream.h has VOID too, for HTMLSTREAM_STACK
+VOID    = "area base basefont br col embed frame hr img input link meta param source track wbr".split()
+RAWTEXT = "script style textarea title xmp".split()
+
+
+def hash(name):
+    # fnv-1a
+    h = 2166136261
+    for c in name.encode():
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    return h
+
+
+def mix(h, d, bits):
+    return (((h ^ (d * 0x9e3779b9)) * 0x85ebca6b) & 0xffffffff) >> (32 - bits)
+
+
+# hash and displace: the top bits of the hash pick a bucket, the bucket's
+# displacement d picks where in the slots each of its names goes
+def perfect(names):
+    bits = 1
+    while (1 << bits) < len(names):
+        bits += 1
+    buckets = bits - 2
+    while True:
+        todo = {}
+        for n in names:
+            todo.setdefault(hash(n) >> (32 - buckets), []).append(hash(n))
+        displace = [0] * (1 << buckets)
+        used = set()
+        ok = True
+        for b, hashes in sorted(todo.items(), key=lambda item: -len(item[1])):
+            for d in range(256):
+                slots = set(mix(h, d, bits) for h in hashes)
+                if len(slots) == len(hashes) and not slots & used:
+                    displace[b] = d
+                    used |= slots
+                    break
+            else:
+                ok = False
+                break
+        if ok:
+            return bits, buckets, displace
+        bits += 1
+        buckets += 1
+
+
+def table(prefix, lower, names, flags=None):
+    assert len(set(names)) == len(names)
+    bits, buckets, displace = perfect(names)
+    slots = [0] * (1 << bits)
+    for i, n in enumerate(names):
+        h = hash(n)
+        slots[mix(h, displace[h >> (32 - buckets)], bits)] = i + 1
+    out = []
+    for i, n in enumerate(names):
+        out.append("#define HTMLSTREAM_%s_%-20s %d" % (prefix, n.upper().replace("-", "_"), i + 1))
+    out.append("#define HTMLSTREAM_%s_COUNT %d" % (prefix, len(names) + 1))
+    out.append("#define HTMLSTREAM_%s_BITS  %d" % (prefix, bits))
+    out.append("#define HTMLSTREAM_%s_BUCKET_BITS %d" % (prefix, buckets))
+    out.append("#define HTMLSTREAM_%s_LONGEST %d" % (prefix, max(len(n) for n in names)))
+    out.append("")
+    out.append("static const char *const htmlstream_%s_names[HTMLSTREAM_%s_COUNT] = {" % (lower, prefix))
+    line = "    0,"
+    for n in names:
+        item = ' "%s",' % n
+        if len(line) + len(item) > 100:
+            out.append(line)
+            line = "   "
+        line += item
+    out.append(line)
+    out.append("};")
+    out.append("static const unsigned char htmlstream_%s_lens[HTMLSTREAM_%s_COUNT] = {" % (lower, prefix))
+    out += wrap([0] + [len(n) for n in names])
+    out.append("};")
+    if flags:
+        out.append("static const unsigned char htmlstream_%s_flags[HTMLSTREAM_%s_COUNT] = {" % (lower, prefix))
+        out += wrap([0] + [flags(n) for n in names])
+        out.append("};")
+    out.append("static const unsigned char htmlstream_%s_displace[1 << HTMLSTREAM_%s_BUCKET_BITS] = {" % (lower, prefix))
+    out += wrap(displace)
+    out.append("};")
+    out.append("static const unsigned char htmlstream_%s_slots[1 << HTMLSTREAM_%s_BITS] = {" % (lower, prefix))
+    out += wrap(slots)
+    out.append("};")
+    out.append("")
+    return out
+
+
+def wrap(values, per=20):
+    out = []
+    for i in range(0, len(values), per):
+        out.append("    " + " ".join("%d," % v for v in values[i:i + per]))
+    return out
+
+
+def tag_flags(n):
+    return (1 if n in VOID else 0) | (2 if n in RAWTEXT else 0)
+
+
+def literal(data, indent="    "):
+    # octal escapes, hex ones would run into following digits
+    out = []
+    line = indent + '"'
+    for b in data:
+        item = chr(b) if 0x20 <= b < 0x7f and chr(b) not in '"\\?' else "\\%03o" % b
+        if len(line) + len(item) > 99:
+            out.append(line + '"')
+            line = indent + '"'
+        line += item
+    out.append(line + '"')
+    return out
+
+
+# names are without the &. some old ones also work without the ;
+def entities():
+    from html.entities import html5
+    names = sorted(html5)
+    bits, buckets, displace = perfect(names)
+    slots = [0] * (1 << bits)
+    for i, n in enumerate(names):
+        h = hash(n)
+        slots[mix(h, displace[h >> (32 - buckets)], bits)] = i + 1
+    values = [html5[n].encode() for n in names]
+    text = "".join(names).encode()
+    data = b"".join(values)
+    assert len(text) < 65536 and len(data) < 65536
+    # htmlstream_decode promises len + len / 4 + 1 bytes are enough
+    assert all(len(v) * 4 <= (len(n) + 1) * 5 for n, v in zip(names, values))
+    name_at, value_at = [0], [0]
+    for n, v in zip(names, values):
+        name_at.append(name_at[-1] + len(n))
+        value_at.append(value_at[-1] + len(v))
+    out = [
+        "// generated by htmlstream_names.py entities, do not edit",
+        "#ifndef HTMLSTREAM_ENTITIES_H",
+        "#define HTMLSTREAM_ENTITIES_H",
+        "",
+        "#define HTMLSTREAM_ENTITY_COUNT %d" % (len(names) + 1),
+        "#define HTMLSTREAM_ENTITY_BITS  %d" % bits,
+        "#define HTMLSTREAM_ENTITY_BUCKET_BITS %d" % buckets,
+        "#define HTMLSTREAM_ENTITY_LONGEST %d" % max(len(n) for n in names),
+        "// longest one that works without ;",
+        "#define HTMLSTREAM_ENTITY_LEGACY_LONGEST %d" % max(len(n) for n in names if not n.endswith(";")),
+        "",
+        "// entity id is at htmlstream_entity_names + htmlstream_entity_name_at[id - 1],",
+        "// up to htmlstream_entity_name_at[id], and the same for its utf-8 value",
+        "static const char htmlstream_entity_names[] =",
+    ]
+    out += literal(text)
+    out[-1] += ";"
+    out.append("static const char htmlstream_entity_values[] =")
+    out += literal(data)
+    out[-1] += ";"
+    out.append("static const unsigned short htmlstream_entity_name_at[HTMLSTREAM_ENTITY_COUNT] = {")
+    out += wrap(name_at, 16)
+    out.append("};")
+    out.append("static const unsigned short htmlstream_entity_value_at[HTMLSTREAM_ENTITY_COUNT] = {")
+    out += wrap(value_at, 16)
+    out.append("};")
+    out.append("static const unsigned char htmlstream_entity_displace[1 << HTMLSTREAM_ENTITY_BUCKET_BITS] = {")
+    out += wrap(displace)
+    out.append("};")
+    out.append("static const unsigned short htmlstream_entity_slots[1 << HTMLSTREAM_ENTITY_BITS] = {")
+    out += wrap(slots, 16)
+    out.append("};")
+    out.append("")
+    out.append("#endif")
+    return out
+
+
+LOOKUP = """
+// 0 for names not in the table
+HTMLSTREAM_INLINE int htmlstream_internal_name_id(const char *name, int len, int longest,
+        const unsigned char *displace, int bucket_bits, const unsigned char *slots, int bits,
+        const char *const *names, const unsigned char *lens)
+{
+    if (len < 1 || len > longest) {
+        return 0;
+    }
+    uint32_t h = htmlstream_internal_hash(name, len);
+    int id = slots[htmlstream_internal_slot(h, displace[h >> (32 - bucket_bits)], bits)];
+    return lens[id] == len && memcmp(names[id], name, len) == 0 ? id : 0;
+}
+
+// HTMLSTREAM_TAG_ id of a tag name as open_cb and close_cb get it, or 0
+static inline int htmlstream_tag_id(const char *tag, int len)
+{
+    return htmlstream_internal_name_id(tag, len, HTMLSTREAM_TAG_LONGEST,
+            htmlstream_tag_displace, HTMLSTREAM_TAG_BUCKET_BITS, htmlstream_tag_slots, HTMLSTREAM_TAG_BITS,
+            htmlstream_tag_names, htmlstream_tag_lens);
+}
+
+// HTMLSTREAM_ATTR_ id of an attribute name as attr_cb gets it, or 0
+static inline int htmlstream_attr_id(const char *key, int len)
+{
+    return htmlstream_internal_name_id(key, len, HTMLSTREAM_ATTR_LONGEST,
+            htmlstream_attr_displace, HTMLSTREAM_ATTR_BUCKET_BITS, htmlstream_attr_slots, HTMLSTREAM_ATTR_BITS,
+            htmlstream_attr_names, htmlstream_attr_lens);
+}
+"""
+
+
+def names():
+    out = [
+        "// generated by htmlstream_names.py, do not edit",
+        "// ids for known tag and attribute names: HTMLSTREAM_TAG_DIV, HTMLSTREAM_ATTR_HREF, ...",
+        "#ifndef HTMLSTREAM_NAMES_H",
+        "#define HTMLSTREAM_NAMES_H",
+        "",
+        '#include "htmlstream.h"',
+        "",
+        "// htmlstream_tag_flags[id]",
+        "#define HTMLSTREAM_TAG_VOID    1    // never has content or an end tag",
+        "#define HTMLSTREAM_TAG_RAWTEXT 2    // content is text in html: %s" % ", ".join(RAWTEXT),
+        "",
+    ]
+    out += table("TAG", "tag", TAGS, tag_flags)
+    out += table("ATTR", "attr", ATTRS)
+    out += LOOKUP.strip("\n").split("\n")
+    out.append("")
+    out.append("#endif")
+    return out
+
+
+import sys
+print("\n".join(entities() if sys.argv[1:] == ["entities"] else names()))
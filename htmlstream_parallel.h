@@ -0,0 +1,555 @@
+#ifndef HTMLSTREAM_PARALLEL_H
+#define HTMLSTREAM_PARALLEL_H
+
+// parse on several threads. needs -pthread.
+//
+// htmlstream_feed_parallel parses one big document:
+//
+// the document is cut into segments right before a '<' that follows a '>'.
+// every segment but the first is parsed speculatively on its own thread,
+// from a fresh parser, into an event log. the first segment is parsed on the
+// calling thread with t itself. then, in order, each log is replayed into
+// t's callbacks if t really ended the previous segment in the fresh state
+// the guess assumed, otherwise the segment is parsed again with t.
+// callbacks therefore see exactly what htmlstream_feed would have produced,
+// always on the calling thread.
+//
+// htmlstream_feed_batch parses many independent documents, each on one thread.
+//
+// htmlstream_skip and htmlstream_stop work with both. a replay a callback skipped or
+// stopped in is cut short and the rest of its segment is parsed again with t.
+//
+// htmlstream_feed_parallel parses serially, like htmlstream_feed, with a tape, the element
+// stack, alloc_cb or HTMLSTREAM_ZEROCOPY: segments log events, not tape records; they do
+// not know what is open where they start; tokens replayed from a log would not be cut
+// where alloc_cb had them cut; and what they point to is the log, not data.
+
+#include "htmlstream.h"
+#include <pthread.h>
+
+#ifndef HTMLSTREAM_PARALLEL_MIN_SEGMENT
+#define HTMLSTREAM_PARALLEL_MIN_SEGMENT (1 << 20)
+#endif
+#define HTMLSTREAM_PARALLEL_MAX_THREADS 64
+
+#define HTMLSTREAM_LOG_OPEN  0
+#define HTMLSTREAM_LOG_CLOSE 1
+#define HTMLSTREAM_LOG_ATTR  2
+#define HTMLSTREAM_LOG_TEXT  3
+#define HTMLSTREAM_LOG_PART  4
+#define HTMLSTREAM_LOG_FINAL 5
+#define HTMLSTREAM_LOG_COMMENT       6
+#define HTMLSTREAM_LOG_COMMENT_FINAL 7
+
+typedef struct
+{
+    htmlstream_t t;
+    const char *data;
+    int len;
+
+    // events as [type][len][bytes] ([len][bytes] twice for attributes, with
+    // len -1 and no bytes for an attribute without value)
+    char *log;
+    int log_at;
+    int log_size;
+    bool failed;
+
+    pthread_t thread;
+    bool started;
+} htmlstream_segment_t;
+
+static void htmlstream_log_put(htmlstream_segment_t *s, const void *data, int len)
+{
+    if (s->failed) {
+        return;
+    }
+    if (s->log_size - s->log_at < len) {
+        int nusize = s->log_size ? s->log_size * 2 : 4096;
+        while (nusize - s->log_at < len) {
+            nusize *= 2;
+        }
+        char *nu = (char *)realloc(s->log, nusize);
+        if (!nu) {
+            s->failed = true;
+            return;
+        }
+        s->log = nu;
+        s->log_size = nusize;
+    }
+    if (len) {
+        memcpy(s->log + s->log_at, data, len);
+    }
+    s->log_at += len;
+}
+
+static void htmlstream_log_event(htmlstream_segment_t *s, char type, const char *str, int len)
+{
+    htmlstream_log_put(s, &type, 1);
+    htmlstream_log_put(s, &len, sizeof(len));
+    htmlstream_log_put(s, str, len);
+}
+
+static void htmlstream_log_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_log_event((htmlstream_segment_t *)parg, HTMLSTREAM_LOG_OPEN, tag, len);
+}
+
+static void htmlstream_log_close_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_log_event((htmlstream_segment_t *)parg, HTMLSTREAM_LOG_CLOSE, tag, len);
+}
+
+static void htmlstream_log_attr_cb(void *parg, const char *key, int key_len,
+        const char *val, int val_len)
+{
+    htmlstream_segment_t *s = (htmlstream_segment_t *)parg;
+    htmlstream_log_event(s, HTMLSTREAM_LOG_ATTR, key, key_len);
+    if (!val) {
+        val_len = -1;
+    }
+    htmlstream_log_put(s, &val_len, sizeof(val_len));
+    if (val) {
+        htmlstream_log_put(s, val, val_len);
+    }
+}
+
+static void htmlstream_log_text_cb(void *parg, const char *text, int len)
+{
+    htmlstream_log_event((htmlstream_segment_t *)parg, HTMLSTREAM_LOG_TEXT, text, len);
+}
+
+static void htmlstream_log_text_part_cb(void *parg, const char *text, int len, bool final)
+{
+    htmlstream_log_event((htmlstream_segment_t *)parg,
+            final ? HTMLSTREAM_LOG_FINAL : HTMLSTREAM_LOG_PART, text, len);
+}
+
+static void htmlstream_log_comment_cb(void *parg, const char *text, int len, bool final)
+{
+    htmlstream_log_event((htmlstream_segment_t *)parg,
+            final ? HTMLSTREAM_LOG_COMMENT_FINAL : HTMLSTREAM_LOG_COMMENT, text, len);
+}
+
+// replay s's events into t's callbacks. returns 0 if they all were, else how many were when
+// a callback called htmlstream_skip or htmlstream_stop (t->skip is not 0 then)
+static int htmlstream_log_replay(const htmlstream_segment_t *s, htmlstream_t *t)
+{
+    int at = 0;
+    int events = 0;
+    while (at < s->log_at) {
+        char type = s->log[at++];
+        int len;
+        memcpy(&len, s->log + at, sizeof(len));
+        at += sizeof(len);
+        const char *str = s->log + at;
+        at += len;
+        events++;
+        switch (type) {
+            case HTMLSTREAM_LOG_OPEN: {
+                // where htmlstream_skip looks for the name. not the state htmlstream_feed
+                // would be in, that is left to htmlstream_parallel_redo
+                htmlstream_buffer_reset(&t->tag);
+                t->tag.at = htmlstream_buffer_reserve(t, &t->tag, len);
+                memcpy(htmlstream_buffer_data(&t->tag), str, t->tag.at);
+                t->state = HTMLSTREAM_STATE_OPENING_TAG;
+                t->open_cb(t->parg, str, len);
+                t->state  = HTMLSTREAM_STATE_TEXT;
+                t->tag.at = 0;
+                break;
+            }
+            case HTMLSTREAM_LOG_CLOSE:
+                t->close_cb(t->parg, str, len);
+                break;
+            case HTMLSTREAM_LOG_ATTR: {
+                int val_len;
+                memcpy(&val_len, s->log + at, sizeof(val_len));
+                at += sizeof(val_len);
+                if (val_len < 0) {
+                    t->attr_cb(t->parg, str, len, 0, 0);
+                } else {
+                    t->attr_cb(t->parg, str, len, s->log + at, val_len);
+                    at += val_len;
+                }
+                break;
+            }
+            case HTMLSTREAM_LOG_TEXT:
+                t->text_cb(t->parg, str, len);
+                break;
+            case HTMLSTREAM_LOG_PART:
+            case HTMLSTREAM_LOG_FINAL:
+                t->text_part_cb(t->parg, str, len, type == HTMLSTREAM_LOG_FINAL);
+                break;
+            case HTMLSTREAM_LOG_COMMENT:
+            case HTMLSTREAM_LOG_COMMENT_FINAL:
+                t->comment_cb(t->parg, str, len, type == HTMLSTREAM_LOG_COMMENT_FINAL);
+                break;
+        }
+        if (t->skip != 0) {
+            return events;
+        }
+    }
+    return 0;
+}
+
+// a segment parsed again after a callback skipped or stopped in its replay: the events
+// up to that one are muted, they were replayed already, and there the skip or stop is
+// done again, with t where htmlstream_feed would have had it
+typedef struct
+{
+    htmlstream_t *t;
+    htmlstream_t keep;
+    int left;
+    int skip;
+} htmlstream_redo_t;
+
+static void htmlstream_redo_event(htmlstream_redo_t *r)
+{
+    if (--r->left > 0) {
+        return;
+    }
+    htmlstream_internal_config(r->t, &r->keep);
+    if (r->skip < 0) {
+        htmlstream_stop(r->t);
+    } else {
+        htmlstream_skip(r->t);
+    }
+}
+
+static void htmlstream_redo_open_cb(void *parg, const char *tag, int len)
+{
+    (void)tag;
+    (void)len;
+    htmlstream_redo_event((htmlstream_redo_t *)parg);
+}
+
+static void htmlstream_redo_attr_cb(void *parg, const char *key, int key_len, const char *val, int val_len)
+{
+    (void)key;
+    (void)key_len;
+    (void)val;
+    (void)val_len;
+    htmlstream_redo_event((htmlstream_redo_t *)parg);
+}
+
+static void htmlstream_redo_part_cb(void *parg, const char *text, int len, bool final)
+{
+    (void)text;
+    (void)len;
+    (void)final;
+    htmlstream_redo_event((htmlstream_redo_t *)parg);
+}
+
+// t is where it was before the replay of s, which stopped after events events.
+// returns how much of s was used
+static int htmlstream_parallel_redo(htmlstream_t *t, const htmlstream_segment_t *s, int events)
+{
+    htmlstream_redo_t *r = (htmlstream_redo_t *)malloc(sizeof(htmlstream_redo_t));
+    if (!r) {
+        // the rest of the segment is dropped, like after htmlstream_stop
+        htmlstream_stop(t);
+        return 0;
+    }
+    r->t    = t;
+    r->keep = *t;
+    r->left = events;
+    r->skip = t->skip;
+    t->skip = 0;
+    t->parg = r;
+    t->open_cb      = t->open_cb      ? htmlstream_redo_open_cb : 0;
+    t->close_cb     = t->close_cb     ? htmlstream_redo_open_cb : 0;
+    t->attr_cb      = t->attr_cb      ? htmlstream_redo_attr_cb : 0;
+    t->text_cb      = t->text_cb      ? htmlstream_redo_open_cb : 0;
+    t->text_part_cb = t->text_part_cb ? htmlstream_redo_part_cb : 0;
+    t->comment_cb   = t->comment_cb   ? htmlstream_redo_part_cb : 0;
+    int used = htmlstream_internal_feed_chunk(t, s->data, s->len);
+    if (r->left > 0) {
+        htmlstream_internal_config(t, &r->keep);
+    }
+    free(r);
+    return used;
+}
+
+static void *htmlstream_segment_run(void *arg)
+{
+    htmlstream_segment_t *s = (htmlstream_segment_t *)arg;
+    htmlstream_internal_feed_chunk(&s->t, s->data, s->len);
+    htmlstream_internal_end_chunk(&s->t);
+    if (s->t.flags & HTMLSTREAM_UTF8) {
+        htmlstream_internal_utf8_check(&s->t.utf8, s->data, s->len);
+    }
+    return 0;
+}
+
+// continue t's utf-8 check with a segment's. that started at a '<', so a sequence
+// t had not finished was cut short
+static void htmlstream_parallel_utf8(htmlstream_t *t, const htmlstream_segment_t *s)
+{
+    if (!s->started) {
+        htmlstream_internal_utf8_check(&t->utf8, s->data, s->len);
+        return;
+    }
+    t->utf8.invalid += s->t.utf8.invalid + (t->utf8.need != 0);
+    t->utf8.need = s->t.utf8.need;
+    t->utf8.lo   = s->t.utf8.lo;
+    t->utf8.hi   = s->t.utf8.hi;
+}
+
+// whether t is where a fresh parser would be, so a speculative parse of what
+// follows is valid
+static bool htmlstream_parallel_resync(const htmlstream_t *t)
+{
+    return t->state == HTMLSTREAM_STATE_TEXT && t->rawtext == 0 && t->skip == 0 &&
+        t->tag.at == 0 && t->val.at == 0 && !t->text_parted;
+}
+
+// continue t from the state a segment parser ended in.
+// t keeps its configuration and its own buffer storage.
+static void htmlstream_parallel_adopt(htmlstream_t *t, const htmlstream_t *from)
+{
+    htmlstream_t keep = *t;
+    *t = *from;
+    htmlstream_internal_config(t, &keep);
+    t->utf8 = keep.utf8;
+#ifdef HTMLSTREAM_STATS
+    t->stats = keep.stats;
+    htmlstream_stats_add(&t->stats, &from->stats);
+#endif
+
+    htmlstream_buffer_t *to[]   = {&t->tag, &t->val};
+    htmlstream_buffer_t *kept[] = {&keep.tag, &keep.val};
+    const htmlstream_buffer_t *src[] = {&from->tag, &from->val};
+    for (int i = 0; i < 2; i++) {
+        *to[i] = *kept[i];
+        htmlstream_buffer_reset(to[i]);
+        int len = htmlstream_buffer_reserve(t, to[i], src[i]->at);
+        memcpy(htmlstream_buffer_data(to[i]), htmlstream_buffer_get(src[i]), len);
+        to[i]->at = len;
+    }
+}
+
+// feed data to t like htmlstream_feed, using up to threads threads. returns how many bytes
+// were parsed: len, unless a callback called htmlstream_stop
+static inline int htmlstream_feed_parallel(htmlstream_t *t, const char *data, int len, int threads)
+{
+    if (threads > HTMLSTREAM_PARALLEL_MAX_THREADS) {
+        threads = HTMLSTREAM_PARALLEL_MAX_THREADS;
+    }
+    if (threads > len / HTMLSTREAM_PARALLEL_MIN_SEGMENT) {
+        threads = len / HTMLSTREAM_PARALLEL_MIN_SEGMENT;
+    }
+    // see the top of this file
+    if (threads < 2 || t->tape || HTMLSTREAM_STACKED(t) || t->alloc_cb || (t->flags & HTMLSTREAM_ZEROCOPY)) {
+        return htmlstream_feed(t, data, len);
+    }
+
+    // segment k starts at cut[k], right before a '<' that follows a '>'
+    int cut[HTMLSTREAM_PARALLEL_MAX_THREADS + 1];
+    int segments = 1;
+    cut[0] = 0;
+    for (int k = 1; k < threads; k++) {
+        int from = (int)((long long)len * k / threads);
+        int to   = (int)((long long)len * (k + 1) / threads);
+        if (from <= cut[segments - 1]) {
+            from = cut[segments - 1] + 1;
+        }
+        for (int at = from; at < to; at++) {
+            const char *lt = (const char *)memchr(data + at, '<', to - at);
+            if (!lt) {
+                break;
+            }
+            at = lt - data;
+            if (data[at - 1] == '>') {
+                cut[segments++] = at;
+                break;
+            }
+        }
+    }
+    cut[segments] = len;
+
+    htmlstream_segment_t *segs = (htmlstream_segment_t *)calloc(segments, sizeof(htmlstream_segment_t));
+    if (!segs) {
+        return htmlstream_feed(t, data, len);
+    }
+    for (int k = 1; k < segments; k++) {
+        htmlstream_segment_t *s = &segs[k];
+        htmlstream_init(&s->t);
+        s->t.parg  = s;
+        s->t.flags = t->flags;
+        s->t.rawtext_tags = t->rawtext_tags;
+        s->t.rcdata_tags  = t->rcdata_tags;
+        s->t.open_cb      = t->open_cb      ? htmlstream_log_open_cb : 0;
+        s->t.close_cb     = t->close_cb     ? htmlstream_log_close_cb : 0;
+        s->t.attr_cb      = t->attr_cb      ? htmlstream_log_attr_cb : 0;
+        s->t.text_cb      = t->text_cb      ? htmlstream_log_text_cb : 0;
+        s->t.text_part_cb = t->text_part_cb ? htmlstream_log_text_part_cb : 0;
+        s->t.comment_cb   = t->comment_cb   ? htmlstream_log_comment_cb : 0;
+        s->data = data + cut[k];
+        s->len  = cut[k + 1] - cut[k];
+        s->started = pthread_create(&s->thread, 0, htmlstream_segment_run, s) == 0;
+    }
+
+    // chunks end where htmlstream_feed(t, data, len) would have ended one,
+    // so streamed text comes out in the same pieces too
+    int used = htmlstream_internal_feed_chunk(t, data, cut[1]);
+    if (t->flags & HTMLSTREAM_UTF8) {
+        htmlstream_internal_utf8_check(&t->utf8, data, used);
+    }
+
+    for (int k = 1; k < segments; k++) {
+        htmlstream_segment_t *s = &segs[k];
+        if (s->started) {
+            pthread_join(s->thread, 0);
+        }
+        // after htmlstream_stop the rest is only cleaned up
+        if (t->skip >= 0) {
+            int n = s->len;
+            int events = 0;
+            bool replayed = s->started && !s->failed && htmlstream_parallel_resync(t);
+            if (replayed) {
+                htmlstream_internal_end_chunk(t);
+                events = htmlstream_log_replay(s, t);
+            }
+            if (replayed && !events) {
+                htmlstream_parallel_adopt(t, &s->t);
+            } else if (replayed) {
+                n = htmlstream_parallel_redo(t, s, events);
+            } else {
+                n = htmlstream_internal_feed_chunk(t, s->data, s->len);
+            }
+            used += n;
+            if ((t->flags & HTMLSTREAM_UTF8) && n == s->len) {
+                htmlstream_parallel_utf8(t, s);
+            } else if (t->flags & HTMLSTREAM_UTF8) {
+                htmlstream_internal_utf8_check(&t->utf8, s->data, n);
+            }
+        }
+        htmlstream_free(&s->t);
+        free(s->log);
+    }
+    free(segs);
+    if (t->text_part_cb && t->skip == 0 &&
+            (t->state == HTMLSTREAM_STATE_TEXT || t->state == HTMLSTREAM_STATE_RAWTEXT)) {
+        htmlstream_internal_text_part(t, false);
+    }
+    htmlstream_internal_end_chunk(t);
+    return used;
+}
+
+typedef struct
+{
+    const char *data;
+    int len;
+} htmlstream_doc_t;
+
+// what callbacks get as parg from htmlstream_feed_batch
+typedef struct
+{
+    void *parg;   // parg of the parser given to htmlstream_feed_batch
+    int index;    // which document the event is from
+    int worker;   // which thread, 0 is the calling one
+    htmlstream_t *t;   // the parser of that thread, for htmlstream_skip and htmlstream_stop
+} htmlstream_batch_arg_t;
+
+typedef struct
+{
+    const htmlstream_t *proto;
+    const htmlstream_doc_t *docs;
+    int count;
+    int *next;
+    int worker;
+    pthread_t thread;
+    bool started;
+#ifdef HTMLSTREAM_STATS
+    // what the thread's parser counted, for proto once all are done
+    htmlstream_stats_t stats;
+#endif
+} htmlstream_batch_t;
+
+// documents are handed out a few at a time from a shared counter,
+// so a thread that got cheap documents just takes more
+#define HTMLSTREAM_BATCH_GRAB 8
+
+static void htmlstream_batch_work(htmlstream_batch_t *b)
+{
+    htmlstream_batch_arg_t arg;
+    arg.parg   = b->proto->parg;
+    arg.worker = b->worker;
+
+    htmlstream_t t;
+    htmlstream_init(&t);
+    htmlstream_internal_config(&t, b->proto);
+    t.parg = &arg;
+    arg.t  = &t;
+    for (;;) {
+        int from = __sync_fetch_and_add(b->next, HTMLSTREAM_BATCH_GRAB);
+        if (from >= b->count) {
+            break;
+        }
+        int to = from + HTMLSTREAM_BATCH_GRAB < b->count ? from + HTMLSTREAM_BATCH_GRAB : b->count;
+        for (int i = from; i < to; i++) {
+            arg.index = i;
+            htmlstream_reset(&t);
+            htmlstream_feed(&t, b->docs[i].data, b->docs[i].len);
+        }
+    }
+#ifdef HTMLSTREAM_STATS
+    b->stats = t.stats;
+#endif
+    htmlstream_free(&t);
+}
+
+static void *htmlstream_batch_run(void *arg)
+{
+    htmlstream_batch_t *b = (htmlstream_batch_t *)arg;
+    htmlstream_batch_work(b);
+    return 0;
+}
+
+// parse every document like a fresh copy of proto would, using up to threads
+// threads with one reusable parser each. callbacks are called from all of them
+// with a htmlstream_batch_arg_t as parg, so they must be thread safe,
+// and so must alloc_cb. proto is not changed, but for its stats: with HTMLSTREAM_STATS
+// what the threads counted is added to them at the end
+static inline void htmlstream_feed_batch(htmlstream_t *proto,
+        const htmlstream_doc_t *docs, int count, int threads)
+{
+    if (threads > HTMLSTREAM_PARALLEL_MAX_THREADS) {
+        threads = HTMLSTREAM_PARALLEL_MAX_THREADS;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+    // one tape can only be written by one thread
+    if (threads < 1 || proto->tape) {
+        threads = 1;
+    }
+    htmlstream_batch_t workers[HTMLSTREAM_PARALLEL_MAX_THREADS];
+    int next = 0;
+    for (int w = 0; w < threads; w++) {
+        workers[w].proto   = proto;
+        workers[w].docs    = docs;
+        workers[w].count   = count;
+        workers[w].next    = &next;
+        workers[w].worker  = w;
+        workers[w].started = false;
+    }
+    for (int w = 1; w < threads; w++) {
+        workers[w].started = pthread_create(&workers[w].thread, 0,
+                htmlstream_batch_run, &workers[w]) == 0;
+    }
+    htmlstream_batch_work(&workers[0]);
+    for (int w = 1; w < threads; w++) {
+        if (workers[w].started) {
+            pthread_join(workers[w].thread, 0);
+        }
+    }
+#ifdef HTMLSTREAM_STATS
+    for (int w = 0; w < threads; w++) {
+        if (w == 0 || workers[w].started) {
+            htmlstream_stats_add(&proto->stats, &workers[w].stats);
+        }
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,512 @@
+#ifndef HTMLSTREAM_SELECT_H
+#define HTMLSTREAM_SELECT_H
+
+// match css selectors while parsing, without building a tree.
+//
+// supported: tag, *, .class, #id, [attr], [attr=value], [attr^=prefix],
+// descendant (a b) and child (a > b) combinators, and lists (a, b).
+//
+// every compound (the a, b in "a > b") of every selector is one bit. an open element
+// keeps two sets of them on a stack: the compounds it matched itself (own), and the
+// ones it or any of its ancestors matched (all). a new element can match compound j
+// if j starts a selector, or j - 1 is in its parent's own set (child) or all set
+// (descendant). so one pass over the events matches all selectors at once.
+//
+// elements are matched when their open tag is over, which is only known at the
+// next tag or the end of a htmlstream_select_feed, so matches come a bit late.
+
+#include "htmlstream.h"
+#include "htmlstream_names.h"
+#include <stdint.h>
+
+#define HTMLSTREAM_SELECT_PARTS   64    // compounds over all selectors, one bit each
+#define HTMLSTREAM_SELECT_CONDS   128   // .class, #id and [attr] over all selectors
+#define HTMLSTREAM_SELECT_STRINGS 2048  // their names and values
+// open elements tracked. deeper ones are matched as if they were children of the deepest one
+#ifndef HTMLSTREAM_SELECT_DEPTH
+#define HTMLSTREAM_SELECT_DEPTH   256
+#endif
+// attributes kept for matching and htmlstream_element_attr. the rest is dropped
+#define HTMLSTREAM_SELECT_ATTRS   32
+#define HTMLSTREAM_SELECT_ATTR_BUFFER 4096
+
+#define HTMLSTREAM_SELECT_CLASS  0
+#define HTMLSTREAM_SELECT_ID     1
+#define HTMLSTREAM_SELECT_HAS    2
+#define HTMLSTREAM_SELECT_EQ     3
+#define HTMLSTREAM_SELECT_PREFIX 4
+
+typedef struct
+{
+    // htmlstream_attr_id of the key
+    int id;
+    // offsets into the element's buffer
+    int key;
+    int key_len;
+    int val;
+    int val_len;
+} htmlstream_element_attr_t;
+
+// an element whose open tag is over
+typedef struct
+{
+    char tag[HTMLSTREAM_TAG_BUFFER_SIZE];
+    int tag_len;
+    int tag_id;
+    // open elements around it
+    int depth;
+    htmlstream_element_attr_t attrs[HTMLSTREAM_SELECT_ATTRS];
+    int attrs_count;
+    char buffer[HTMLSTREAM_SELECT_ATTR_BUFFER];
+    int buffer_at;
+} htmlstream_element_t;
+
+// selector is what htmlstream_select_add returned. e is only valid during the callback
+typedef void(*htmlstream_select_cb)(void *parg, int selector, const htmlstream_element_t *e);
+
+typedef struct
+{
+    unsigned char type;
+    // attribute, its id or 0 if it has none
+    int name;
+    int name_len;
+    int name_id;
+    int value;
+    int value_len;
+} htmlstream_select_cond_t;
+
+typedef struct
+{
+    // offset in strings, tag_len 0 for any tag
+    int tag;
+    int tag_len;
+    int tag_id;
+    int conds;
+    int conds_count;
+    int selector;
+} htmlstream_select_part_t;
+
+typedef struct
+{
+    // the parser. set its flags and alloc_cb as usual, its callbacks and parg belong to the select
+    htmlstream_t t;
+    htmlstream_select_cb match_cb;
+    void *parg;
+
+    htmlstream_select_part_t parts[HTMLSTREAM_SELECT_PARTS];
+    int parts_count;
+    htmlstream_select_cond_t conds[HTMLSTREAM_SELECT_CONDS];
+    int conds_count;
+    char strings[HTMLSTREAM_SELECT_STRINGS];
+    int strings_at;
+    int selectors;
+    // compounds that start a selector, follow their previous one with > or with a space,
+    // and end a selector
+    uint64_t first;
+    uint64_t child;
+    uint64_t descendant;
+    uint64_t last;
+
+    // open elements, 0 is the document. names are hashed
+    uint32_t names[HTMLSTREAM_SELECT_DEPTH];
+    uint64_t own[HTMLSTREAM_SELECT_DEPTH];
+    uint64_t all[HTMLSTREAM_SELECT_DEPTH];
+    int depth;
+    // elements opened past HTMLSTREAM_SELECT_DEPTH
+    int over;
+
+    // the element whose open tag is being parsed, if pending
+    htmlstream_element_t element;
+    bool pending;
+} htmlstream_select_t;
+
+// the attribute of e with id (if not 0) or key, or 0
+static const htmlstream_element_attr_t *htmlstream_element_find(const htmlstream_element_t *e,
+        int id, const char *key, int key_len)
+{
+    for (int i = 0; i < e->attrs_count; i++) {
+        const htmlstream_element_attr_t *a = &e->attrs[i];
+        if (id ? a->id == id : a->key_len == key_len && memcmp(e->buffer + a->key, key, key_len) == 0) {
+            return a;
+        }
+    }
+    return 0;
+}
+
+// value of attribute key (lower case) of e, or 0 if it has none. "" for <a key>
+static inline const char *htmlstream_element_attr(const htmlstream_element_t *e, const char *key, int *len)
+{
+    int key_len = strlen(key);
+    const htmlstream_element_attr_t *a = htmlstream_element_find(e, htmlstream_attr_id(key, key_len), key, key_len);
+    *len = a ? a->val_len : 0;
+    return a ? e->buffer + a->val : 0;
+}
+
+// whether e matches compound j
+static bool htmlstream_select_match(const htmlstream_select_t *s, int j, const htmlstream_element_t *e)
+{
+    const htmlstream_select_part_t *part = &s->parts[j];
+    if (part->tag_id ? part->tag_id != e->tag_id : part->tag_len && (part->tag_len != e->tag_len ||
+                memcmp(s->strings + part->tag, e->tag, e->tag_len) != 0)) {
+        return false;
+    }
+    for (int k = part->conds; k < part->conds + part->conds_count; k++) {
+        const htmlstream_select_cond_t *c = &s->conds[k];
+        const htmlstream_element_attr_t *a = htmlstream_element_find(e, c->name_id,
+                s->strings + c->name, c->name_len);
+        if (!a) {
+            return false;
+        }
+        const char *value = s->strings + c->value;
+        const char *val = e->buffer + a->val;
+        int val_len = a->val_len;
+        switch (c->type) {
+            case HTMLSTREAM_SELECT_CLASS: {
+                // one of the space separated words
+                bool found = false;
+                for (int i = 0; i < val_len && !found; ) {
+                    while (i < val_len && HTMLSTREAM_ISSPACE(val[i])) {
+                        i++;
+                    }
+                    int start = i;
+                    while (i < val_len && !HTMLSTREAM_ISSPACE(val[i])) {
+                        i++;
+                    }
+                    found = i - start == c->value_len && memcmp(val + start, value, c->value_len) == 0;
+                }
+                if (!found) {
+                    return false;
+                }
+                break;
+            }
+            case HTMLSTREAM_SELECT_ID:
+            case HTMLSTREAM_SELECT_EQ:
+                if (val_len != c->value_len || memcmp(val, value, val_len) != 0) {
+                    return false;
+                }
+                break;
+            case HTMLSTREAM_SELECT_PREFIX:
+                if (val_len < c->value_len || memcmp(val, value, c->value_len) != 0) {
+                    return false;
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+// the open tag of the pending element is over: match it, push it and report it
+static void htmlstream_select_element_end(htmlstream_select_t *s)
+{
+    if (!s->pending) {
+        return;
+    }
+    s->pending = false;
+    htmlstream_element_t *e = &s->element;
+    int top = s->depth;
+    uint64_t candidates = s->first | ((s->own[top] << 1) & s->child) | ((s->all[top] << 1) & s->descendant);
+    uint64_t own = 0;
+    for (int j = 0; j < s->parts_count; j++) {
+        if ((candidates >> j & 1) && htmlstream_select_match(s, j, e)) {
+            own |= (uint64_t)1 << j;
+        }
+    }
+    e->depth = top;
+
+    // void elements and <x/> never get an end tag
+    bool empty = (e->tag_len && e->tag[e->tag_len - 1] == '/') ||
+        (htmlstream_tag_flags[e->tag_id] & HTMLSTREAM_TAG_VOID);
+    if (!empty && top + 1 < HTMLSTREAM_SELECT_DEPTH) {
+        s->depth++;
+        s->names[s->depth] = htmlstream_internal_hash(e->tag, e->tag_len);
+        s->own[s->depth]   = own;
+        s->all[s->depth]   = s->all[top] | own;
+    } else if (!empty) {
+        s->over++;
+    }
+
+    uint64_t matched = own & s->last;
+    int reported = -1;
+    for (int j = 0; j < s->parts_count; j++) {
+        if ((matched >> j & 1) && s->parts[j].selector != reported && s->match_cb) {
+            reported = s->parts[j].selector;
+            s->match_cb(s->parg, reported, e);
+        }
+    }
+}
+
+static void htmlstream_select_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_select_t *s = (htmlstream_select_t *)parg;
+    htmlstream_select_element_end(s);
+    htmlstream_element_t *e = &s->element;
+    e->tag_len = len < HTMLSTREAM_TAG_BUFFER_SIZE ? len : HTMLSTREAM_TAG_BUFFER_SIZE;
+    memcpy(e->tag, tag, e->tag_len);
+    e->tag_id      = htmlstream_tag_id(tag, len);
+    e->attrs_count = 0;
+    e->buffer_at   = 0;
+    s->pending = true;
+}
+
+static void htmlstream_select_attr_cb(void *parg, const char *key, int key_len, const char *val, int val_len)
+{
+    htmlstream_select_t *s = (htmlstream_select_t *)parg;
+    htmlstream_element_t *e = &s->element;
+    if (!s->pending || e->attrs_count == HTMLSTREAM_SELECT_ATTRS ||
+            e->buffer_at + key_len + val_len > HTMLSTREAM_SELECT_ATTR_BUFFER) {
+        return;
+    }
+    htmlstream_element_attr_t *a = &e->attrs[e->attrs_count++];
+    a->id      = htmlstream_attr_id(key, key_len);
+    a->key     = e->buffer_at;
+    a->key_len = key_len;
+    memcpy(e->buffer + e->buffer_at, key, key_len);
+    e->buffer_at += key_len;
+    a->val     = e->buffer_at;
+    a->val_len = val_len;
+    if (val_len) {
+        memcpy(e->buffer + e->buffer_at, val, val_len);
+    }
+    e->buffer_at += val_len;
+}
+
+static void htmlstream_select_close_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_select_t *s = (htmlstream_select_t *)parg;
+    htmlstream_select_element_end(s);
+    if (s->over) {
+        s->over--;
+        return;
+    }
+    // closes everything opened inside it too. an end tag nothing matches is ignored
+    uint32_t h = htmlstream_internal_hash(tag, len);
+    for (int d = s->depth; d > 0; d--) {
+        if (s->names[d] == h) {
+            s->depth = d - 1;
+            return;
+        }
+    }
+}
+
+// whether attributes of the pending element may still come
+static bool htmlstream_select_in_tag(const htmlstream_t *t)
+{
+    int state = t->state;
+    if (state >= HTMLSTREAM_STATE_MARKUP && state <= HTMLSTREAM_STATE_BOGUS) {
+        state = t->ret;
+    }
+    return state == HTMLSTREAM_STATE_OPENING_TAG_END ||
+        (state >= HTMLSTREAM_STATE_ATTR_KEY && state <= HTMLSTREAM_STATE_ATTR_VAL_QUOTE);
+}
+
+static void htmlstream_select_init(htmlstream_select_t *s)
+{
+    memset(s, 0, sizeof(htmlstream_select_t));
+    htmlstream_init(&s->t);
+    s->t.open_cb  = htmlstream_select_open_cb;
+    s->t.close_cb = htmlstream_select_close_cb;
+    s->t.attr_cb  = htmlstream_select_attr_cb;
+    s->t.parg     = s;
+}
+
+// start over with a new document. keeps the selectors
+static inline void htmlstream_select_reset(htmlstream_select_t *s)
+{
+    htmlstream_reset(&s->t);
+    s->depth   = 0;
+    s->over    = 0;
+    s->pending = false;
+}
+
+static int htmlstream_select_value_len(const char *p)
+{
+    int n = 0;
+    while (p[n] && p[n] != ']' && !HTMLSTREAM_ISSPACE(p[n])) {
+        n++;
+    }
+    return n;
+}
+
+static int htmlstream_select_ident_len(const char *p)
+{
+    int n = 0;
+    while (p[n] && (p[n] == '-' || p[n] == '_' || (unsigned char)p[n] >= 0x80 ||
+                (p[n] >= '0' && p[n] <= '9') || (HTMLSTREAM_ASCII_LOWER(p[n]) >= 'a' &&
+                    HTMLSTREAM_ASCII_LOWER(p[n]) <= 'z'))) {
+        n++;
+    }
+    return n;
+}
+
+// copy in s->strings, lower cased if lower, or -1 if full
+static int htmlstream_select_string(htmlstream_select_t *s, const char *str, int len, bool lower)
+{
+    if (s->strings_at + len > HTMLSTREAM_SELECT_STRINGS) {
+        return -1;
+    }
+    int at = s->strings_at;
+    for (int i = 0; i < len; i++) {
+        s->strings[at + i] = lower ? HTMLSTREAM_ASCII_LOWER(str[i]) : str[i];
+    }
+    s->strings_at += len;
+    return at;
+}
+
+#define HTMLSTREAM_SELECT_SPACES(p) while (HTMLSTREAM_ISSPACE(*(p))) { (p)++; }
+
+// append the compounds of selector. false if it is not understood or does not fit
+static bool htmlstream_select_compile(htmlstream_select_t *s, const char *selector)
+{
+    const char *p = selector;
+    bool start = true;
+    bool child = false;
+    // values are compared as the parser buffers them
+    bool lower = !(s->t.flags & HTMLSTREAM_KEEP_CASE);
+    HTMLSTREAM_SELECT_SPACES(p);
+    for (;;) {
+        if (s->parts_count == HTMLSTREAM_SELECT_PARTS) {
+            return false;
+        }
+        htmlstream_select_part_t *part = &s->parts[s->parts_count];
+        part->tag         = 0;
+        part->tag_len     = 0;
+        part->tag_id      = 0;
+        part->conds       = s->conds_count;
+        part->conds_count = 0;
+        part->selector    = s->selectors;
+        int n = htmlstream_select_ident_len(p);
+        if (n) {
+            if ((part->tag = htmlstream_select_string(s, p, n, true)) < 0) {
+                return false;
+            }
+            part->tag_len = n;
+            part->tag_id  = htmlstream_tag_id(s->strings + part->tag, n);
+            p += n;
+        } else if (*p == '*') {
+            p++;
+        } else if (*p != '.' && *p != '#' && *p != '[') {
+            return false;
+        }
+        while (*p == '.' || *p == '#' || *p == '[') {
+            if (s->conds_count == HTMLSTREAM_SELECT_CONDS) {
+                return false;
+            }
+            htmlstream_select_cond_t *c = &s->conds[s->conds_count++];
+            part->conds_count++;
+            c->name = c->name_len = c->value = c->value_len = 0;
+            if (*p != '[') {
+                c->type    = *p == '.' ? HTMLSTREAM_SELECT_CLASS : HTMLSTREAM_SELECT_ID;
+                c->name_id = *p++ == '.' ? HTMLSTREAM_ATTR_CLASS : HTMLSTREAM_ATTR_ID;
+                n = htmlstream_select_ident_len(p);
+                if (!n || (c->value = htmlstream_select_string(s, p, n, lower)) < 0) {
+                    return false;
+                }
+                c->value_len = n;
+                p += n;
+                continue;
+            }
+            p++;
+            HTMLSTREAM_SELECT_SPACES(p);
+            n = htmlstream_select_ident_len(p);
+            if (!n || (c->name = htmlstream_select_string(s, p, n, true)) < 0) {
+                return false;
+            }
+            c->name_len = n;
+            c->name_id  = htmlstream_attr_id(s->strings + c->name, n);
+            c->type     = HTMLSTREAM_SELECT_HAS;
+            p += n;
+            HTMLSTREAM_SELECT_SPACES(p);
+            if (*p == '=' || (p[0] == '^' && p[1] == '=')) {
+                c->type = *p == '=' ? HTMLSTREAM_SELECT_EQ : HTMLSTREAM_SELECT_PREFIX;
+                p += *p == '=' ? 1 : 2;
+                HTMLSTREAM_SELECT_SPACES(p);
+                const char *value = p;
+                if (*p == '"' || *p == '\'') {
+                    const char *end = strchr(p + 1, *p);
+                    if (!end) {
+                        return false;
+                    }
+                    value = p + 1;
+                    n = end - value;
+                    p = end + 1;
+                } else {
+                    n = htmlstream_select_value_len(p);
+                    p += n;
+                }
+                if ((c->value = htmlstream_select_string(s, value, n, lower)) < 0) {
+                    return false;
+                }
+                c->value_len = n;
+                HTMLSTREAM_SELECT_SPACES(p);
+            }
+            if (*p++ != ']') {
+                return false;
+            }
+        }
+        uint64_t bit = (uint64_t)1 << s->parts_count++;
+        if (start) {
+            s->first |= bit;
+        } else if (child) {
+            s->child |= bit;
+        } else {
+            s->descendant |= bit;
+        }
+
+        // what follows the compound
+        const char *end = p;
+        HTMLSTREAM_SELECT_SPACES(p);
+        start = false;
+        child = false;
+        if (*p == '>') {
+            child = true;
+            p++;
+            HTMLSTREAM_SELECT_SPACES(p);
+        } else if (*p == ',' || !*p) {
+            s->last |= bit;
+            if (!*p) {
+                break;
+            }
+            start = true;
+            p++;
+            HTMLSTREAM_SELECT_SPACES(p);
+        } else if (p == end) {
+            return false;
+        }
+    }
+    return true;
+}
+#undef HTMLSTREAM_SELECT_SPACES
+
+// compile selector. returns the number match_cb gets for it, counting from 0,
+// or -1 if it is not understood or does not fit. set s->t.flags before, values
+// are matched as written with HTMLSTREAM_KEEP_CASE
+static inline int htmlstream_select_add(htmlstream_select_t *s, const char *selector)
+{
+    int parts   = s->parts_count;
+    int conds   = s->conds_count;
+    int strings = s->strings_at;
+    if (htmlstream_select_compile(s, selector)) {
+        return s->selectors++;
+    }
+    uint64_t keep = parts ? ~(uint64_t)0 >> (64 - parts) : 0;
+    s->first       &= keep;
+    s->child       &= keep;
+    s->descendant  &= keep;
+    s->last        &= keep;
+    s->parts_count = parts;
+    s->conds_count = conds;
+    s->strings_at  = strings;
+    return -1;
+}
+
+// htmlstream_feed for s->t, then match the last element if its open tag is over
+static int htmlstream_select_feed(htmlstream_select_t *s, const char *data, int len)
+{
+    int used = htmlstream_feed(&s->t, data, len);
+    if (!htmlstream_select_in_tag(&s->t)) {
+        htmlstream_select_element_end(s);
+    }
+    return used;
+}
+
+#endif
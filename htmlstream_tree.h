@@ -0,0 +1,398 @@
+#ifndef HTMLSTREAM_TREE_H
+#define HTMLSTREAM_TREE_H
+
+// build a tree of the document, for when the events are not enough.
+//
+// nodes and attributes live in two arrays and link to each other by index, so a document
+// is a handful of allocations however many nodes it has, and walking it stays in cache.
+// names, values and text point into the document itself where it has them as they are
+// (htmlstream_tree_parse), or else into blocks of an arena. htmlstream_tree_clear forgets
+// a document in O(1) and keeps all memory for the next one.
+//
+// like the parser, this does not fix html: an end tag also closes everything opened
+// inside its element, one that matches no open element is dropped, and void elements
+// (br, img, ...) and <x/> have no children. comments are not kept.
+
+#include "htmlstream.h"
+#include "htmlstream_names.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// size of the arena blocks. longer strings get a block of their own
+#ifndef HTMLSTREAM_TREE_BLOCK
+#define HTMLSTREAM_TREE_BLOCK (1 << 16)
+#endif
+// open elements are counted by name hash in this many buckets, so an end tag that
+// matches none is dropped without looking through all of them
+#define HTMLSTREAM_TREE_NAMES 1024
+
+#define HTMLSTREAM_NODE_DOCUMENT 0
+#define HTMLSTREAM_NODE_ELEMENT  1
+#define HTMLSTREAM_NODE_TEXT     2
+
+typedef struct
+{
+    // tag name of an element as open_cb gets it, or the text of a text node
+    const char *name;
+    int len;
+    // indices into tree->nodes, 0 for none (node 0 is the document)
+    int parent;
+    int first_child;
+    int next_sibling;
+    // tree->attrs[attrs] .. tree->attrs[attrs + attrs_count - 1]
+    int attrs;
+    int attrs_count;
+    // htmlstream_tag_id of an element
+    unsigned short tag_id;
+    unsigned char type;
+} htmlstream_node_t;
+
+typedef struct
+{
+    const char *key;
+    // "" for <a key>
+    const char *val;
+    int key_len;
+    int val_len;
+    // htmlstream_attr_id of the key
+    int id;
+} htmlstream_node_attr_t;
+
+// its data follows it
+typedef struct htmlstream_tree_block
+{
+    struct htmlstream_tree_block *next;
+    int size;
+    int at;
+} htmlstream_tree_block_t;
+
+typedef struct
+{
+    int node;
+    // its last child so far, the next one goes after it
+    int last;
+    uint32_t hash;
+} htmlstream_tree_open_t;
+
+typedef struct
+{
+    // the parser. set its flags and alloc_cb as usual, its callbacks and parg belong to the tree
+    htmlstream_t t;
+    // nodes[0] is the document
+    htmlstream_node_t *nodes;
+    int nodes_count;
+    htmlstream_node_attr_t *attrs;
+    int attrs_count;
+    // memory ran out and the tree ends where it did
+    bool failed;
+    // the last node is an element whose open tag is not over, attributes are its
+    bool in_tag;
+
+    int nodes_size;
+    int attrs_size;
+    // open elements, open[0] is the document
+    htmlstream_tree_open_t *open;
+    int depth;
+    int open_size;
+    unsigned names[HTMLSTREAM_TREE_NAMES];
+    // arena blocks. strings go into current, the ones after it are free
+    htmlstream_tree_block_t *blocks;
+    htmlstream_tree_block_t *current;
+    // during htmlstream_tree_parse, strings in here are not copied
+    const char *source;
+    int source_len;
+} htmlstream_tree_t;
+
+static void htmlstream_tree_fail(htmlstream_tree_t *tree)
+{
+    tree->failed = true;
+    htmlstream_stop(&tree->t);
+}
+
+// array with room for count + 1 elements of each bytes, or 0 if memory ran out
+static void *htmlstream_tree_grow(htmlstream_tree_t *tree, void *array, int *size, int count, int each)
+{
+    if (count < *size) {
+        return array;
+    }
+    int nusize = *size ? *size * 2 : 64;
+    void *nu = realloc(array, (size_t)nusize * each);
+    if (!nu) {
+        htmlstream_tree_fail(tree);
+        return 0;
+    }
+    *size = nusize;
+    return nu;
+}
+
+// s as it can be kept: where it is if that is in the source, else a copy in the arena
+static const char *htmlstream_tree_string(htmlstream_tree_t *tree, const char *s, int len)
+{
+    if (len == 0) {
+        return "";
+    }
+    if (tree->source && s >= tree->source && s + len <= tree->source + tree->source_len) {
+        return s;
+    }
+    htmlstream_tree_block_t *b = tree->current;
+    if (!b || b->size - b->at < len) {
+        // the next one left by an earlier document, or a new one after current
+        b = b ? b->next : tree->blocks;
+        if (b && b->size >= len) {
+            b->at = 0;
+        } else {
+            int size = len > HTMLSTREAM_TREE_BLOCK ? len : HTMLSTREAM_TREE_BLOCK;
+            b = (htmlstream_tree_block_t *)malloc(sizeof(htmlstream_tree_block_t) + size);
+            if (!b) {
+                htmlstream_tree_fail(tree);
+                return 0;
+            }
+            b->size = size;
+            b->at   = 0;
+            if (tree->current) {
+                b->next = tree->current->next;
+                tree->current->next = b;
+            } else {
+                b->next = tree->blocks;
+                tree->blocks = b;
+            }
+        }
+        tree->current = b;
+    }
+    char *data = (char *)(b + 1) + b->at;
+    memcpy(data, s, len);
+    b->at += len;
+    return data;
+}
+
+// a new node, the last child of the innermost open element. 0 if memory ran out
+static int htmlstream_tree_add(htmlstream_tree_t *tree, int type, const char *name, int len)
+{
+    if (tree->failed || !(name = htmlstream_tree_string(tree, name, len))) {
+        return 0;
+    }
+    htmlstream_node_t *nodes = (htmlstream_node_t *)htmlstream_tree_grow(tree,
+            tree->nodes, &tree->nodes_size, tree->nodes_count, sizeof(htmlstream_node_t));
+    if (!nodes) {
+        return 0;
+    }
+    tree->nodes = nodes;
+    int i = tree->nodes_count++;
+    htmlstream_tree_open_t *o = &tree->open[tree->depth - 1];
+    htmlstream_node_t *n = &nodes[i];
+    n->name         = name;
+    n->len          = len;
+    n->parent       = o->node;
+    n->first_child  = 0;
+    n->next_sibling = 0;
+    n->attrs        = tree->attrs_count;
+    n->attrs_count  = 0;
+    n->tag_id       = 0;
+    n->type         = type;
+    if (o->last) {
+        nodes[o->last].next_sibling = i;
+    } else {
+        nodes[o->node].first_child = i;
+    }
+    o->last = i;
+    return i;
+}
+
+static void htmlstream_tree_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_tree_t *tree = (htmlstream_tree_t *)parg;
+    int i = htmlstream_tree_add(tree, HTMLSTREAM_NODE_ELEMENT, tag, len);
+    tree->in_tag = i != 0;
+    if (!i) {
+        return;
+    }
+    int id = htmlstream_tag_id(tag, len);
+    tree->nodes[i].tag_id = id;
+    if ((htmlstream_tag_flags[id] & HTMLSTREAM_TAG_VOID) || (len && tag[len - 1] == '/')) {
+        return;
+    }
+    htmlstream_tree_open_t *open = (htmlstream_tree_open_t *)htmlstream_tree_grow(tree,
+            tree->open, &tree->open_size, tree->depth, sizeof(htmlstream_tree_open_t));
+    if (!open) {
+        return;
+    }
+    tree->open = open;
+    htmlstream_tree_open_t *o = &open[tree->depth++];
+    o->node = i;
+    o->last = 0;
+    o->hash = htmlstream_internal_hash(tag, len);
+    tree->names[o->hash % HTMLSTREAM_TREE_NAMES]++;
+}
+
+static void htmlstream_tree_attr_cb(void *parg, const char *key, int key_len, const char *val, int val_len)
+{
+    htmlstream_tree_t *tree = (htmlstream_tree_t *)parg;
+    // attributes of an end tag are dropped
+    if (tree->failed || !tree->in_tag) {
+        return;
+    }
+    // they come right after their open tag, nothing else is added in between
+    htmlstream_node_t *n = &tree->nodes[tree->nodes_count - 1];
+    if (!(key = htmlstream_tree_string(tree, key, key_len)) ||
+            !(val = htmlstream_tree_string(tree, val, val_len))) {
+        return;
+    }
+    htmlstream_node_attr_t *attrs = (htmlstream_node_attr_t *)htmlstream_tree_grow(tree,
+            tree->attrs, &tree->attrs_size, tree->attrs_count, sizeof(htmlstream_node_attr_t));
+    if (!attrs) {
+        return;
+    }
+    tree->attrs = attrs;
+    htmlstream_node_attr_t *a = &attrs[tree->attrs_count++];
+    a->key     = key;
+    a->val     = val;
+    a->key_len = key_len;
+    a->val_len = val_len;
+    a->id      = htmlstream_attr_id(key, key_len);
+    n->attrs_count++;
+}
+
+static void htmlstream_tree_close_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_tree_t *tree = (htmlstream_tree_t *)parg;
+    tree->in_tag = false;
+    uint32_t h = htmlstream_internal_hash(tag, len);
+    if (!tree->names[h % HTMLSTREAM_TREE_NAMES]) {
+        return;
+    }
+    // closes everything opened inside it too. an end tag nothing matches is dropped
+    for (int d = tree->depth - 1; d > 0; d--) {
+        const htmlstream_node_t *n = &tree->nodes[tree->open[d].node];
+        if (tree->open[d].hash == h && n->len == len && memcmp(n->name, tag, len) == 0) {
+            while (tree->depth > d) {
+                tree->names[tree->open[--tree->depth].hash % HTMLSTREAM_TREE_NAMES]--;
+            }
+            return;
+        }
+    }
+}
+
+static void htmlstream_tree_text_cb(void *parg, const char *text, int len)
+{
+    htmlstream_tree_t *tree = (htmlstream_tree_t *)parg;
+    tree->in_tag = false;
+    htmlstream_tree_add(tree, HTMLSTREAM_NODE_TEXT, text, len);
+}
+
+// forget the document (and what the parser was in the middle of) to build a new one.
+// keeps all memory, so pointers from before are not valid anymore
+static void htmlstream_tree_clear(htmlstream_tree_t *tree)
+{
+    htmlstream_reset(&tree->t);
+    memset(tree->names, 0, sizeof(tree->names));
+    tree->nodes_count = 0;
+    tree->attrs_count = 0;
+    tree->depth       = 0;
+    tree->current     = 0;
+    tree->failed      = false;
+    tree->in_tag      = false;
+    // on failure the arrays stay as they were, to be freed
+    htmlstream_node_t *nodes = (htmlstream_node_t *)htmlstream_tree_grow(tree,
+            tree->nodes, &tree->nodes_size, 0, sizeof(htmlstream_node_t));
+    if (nodes) {
+        tree->nodes = nodes;
+    }
+    htmlstream_tree_open_t *open = (htmlstream_tree_open_t *)htmlstream_tree_grow(tree,
+            tree->open, &tree->open_size, 0, sizeof(htmlstream_tree_open_t));
+    if (open) {
+        tree->open = open;
+    }
+    if (tree->failed) {
+        return;
+    }
+    htmlstream_node_t *doc = &tree->nodes[tree->nodes_count++];
+    memset(doc, 0, sizeof(htmlstream_node_t));
+    doc->name = "";
+    doc->type = HTMLSTREAM_NODE_DOCUMENT;
+    tree->open[0].node = 0;
+    tree->open[0].last = 0;
+    tree->open[0].hash = 0;
+    tree->depth = 1;
+}
+
+static void htmlstream_tree_init(htmlstream_tree_t *tree)
+{
+    memset(tree, 0, sizeof(htmlstream_tree_t));
+    htmlstream_init(&tree->t);
+    tree->t.open_cb  = htmlstream_tree_open_cb;
+    tree->t.close_cb = htmlstream_tree_close_cb;
+    tree->t.attr_cb  = htmlstream_tree_attr_cb;
+    tree->t.text_cb  = htmlstream_tree_text_cb;
+    tree->t.parg     = tree;
+    htmlstream_tree_clear(tree);
+}
+
+// release all memory. the tree can be used again after htmlstream_tree_init
+static void htmlstream_tree_free(htmlstream_tree_t *tree)
+{
+    htmlstream_free(&tree->t);
+    while (tree->blocks) {
+        htmlstream_tree_block_t *next = tree->blocks->next;
+        free(tree->blocks);
+        tree->blocks = next;
+    }
+    free(tree->nodes);
+    free(tree->attrs);
+    free(tree->open);
+    tree->nodes = 0;
+    tree->attrs = 0;
+    tree->open  = 0;
+}
+
+// add the next piece of the document, like htmlstream_feed. strings are copied, so data
+// can go right after. returns less than len if memory ran out
+static inline int htmlstream_tree_feed(htmlstream_tree_t *tree, const char *data, int len)
+{
+    return tree->failed ? 0 : htmlstream_feed(&tree->t, data, len);
+}
+
+// build the tree of a whole document (or its last piece). strings point into doc where
+// they can (HTMLSTREAM_ZEROCOPY is set while it runs), so doc has to stay as it is while
+// the tree is used. returns less than len if memory ran out
+static int htmlstream_tree_parse(htmlstream_tree_t *tree, const char *doc, int len)
+{
+    int flags = tree->t.flags;
+    tree->t.flags |= HTMLSTREAM_ZEROCOPY;
+    tree->source     = doc;
+    tree->source_len = len;
+    int used = htmlstream_tree_feed(tree, doc, len);
+    tree->source = 0;
+    tree->t.flags = flags;
+    return used;
+}
+
+// value of attribute key (lower case) of node, or 0 if it has none. "" for <a key>
+static inline const char *htmlstream_tree_attr(const htmlstream_tree_t *tree, const htmlstream_node_t *node,
+        const char *key, int *len)
+{
+    int key_len = strlen(key);
+    int id = htmlstream_attr_id(key, key_len);
+    for (int i = node->attrs; i < node->attrs + node->attrs_count; i++) {
+        const htmlstream_node_attr_t *a = &tree->attrs[i];
+        if (id ? a->id == id : a->key_len == key_len && memcmp(a->key, key, key_len) == 0) {
+            *len = a->val_len;
+            return a->val;
+        }
+    }
+    *len = 0;
+    return 0;
+}
+
+// bytes of memory the tree holds, not counting the parser's buffers
+static size_t htmlstream_tree_memory(const htmlstream_tree_t *tree)
+{
+    size_t bytes = (size_t)tree->nodes_size * sizeof(htmlstream_node_t) +
+        (size_t)tree->attrs_size * sizeof(htmlstream_node_attr_t) +
+        (size_t)tree->open_size * sizeof(htmlstream_tree_open_t);
+    for (const htmlstream_tree_block_t *b = tree->blocks; b; b = b->next) {
+        bytes += sizeof(htmlstream_tree_block_t) + b->size;
+    }
+    return bytes;
+}
+
+#endif
@@ -0,0 +1,386 @@
+#ifndef HTMLSTREAM_WRITE_H
+#define HTMLSTREAM_WRITE_H
+
+// write what is parsed back out as html: pretty printed, one node per line and indented,
+// or minified, with runs of whitespace collapsed to one space.
+//
+// output is gathered in a buffer and goes to a file descriptor with writev. runs of
+// HTMLSTREAM_WRITE_DIRECT bytes or more that need no escaping (long text, scripts) are
+// not copied into the buffer, but written from where the parser has them along with it.
+// no printf anywhere.
+//
+// the parser keeps whitespace for the writer (HTMLSTREAM_KEEP_SPACE): pretty printing trims
+// text and drops what is only whitespace, minifying keeps a space where there was any.
+// in pre and textarea text stays as it is, and so do the lines: no indentation inside.
+// comments are not written. text is escaped unless it is raw text (script, style),
+// attribute values always get double quotes. with HTMLSTREAM_DECODE in w->t.flags, & is
+// escaped too. tag and attribute names that can not be written back as they are (quoted
+// ones with spaces or > in them) are dropped.
+
+#include "htmlstream.h"
+#include "htmlstream_names.h"
+#include <errno.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef HTMLSTREAM_WRITE_BUFFER
+#define HTMLSTREAM_WRITE_BUFFER (1 << 16)
+#endif
+#define HTMLSTREAM_WRITE_DIRECT (HTMLSTREAM_WRITE_BUFFER / 4)
+// open elements tracked for indentation, like HTMLSTREAM_SELECT_DEPTH
+#ifndef HTMLSTREAM_WRITE_DEPTH
+#define HTMLSTREAM_WRITE_DEPTH 256
+#endif
+
+#define HTMLSTREAM_WRITE_PRETTY 0
+#define HTMLSTREAM_WRITE_MINIFY 1
+
+typedef struct
+{
+    // the parser. set its flags and alloc_cb as usual, its callbacks and parg belong to the writer
+    htmlstream_t t;
+    int fd;
+    int mode;
+    // spaces per level when pretty printing
+    int indent;
+    // errno of the write that failed, then nothing more is written
+    int error;
+
+    // open elements, 0 is the document. names are hashed
+    uint32_t names[HTMLSTREAM_WRITE_DEPTH];
+    int depth;
+    // elements opened past HTMLSTREAM_WRITE_DEPTH
+    int over;
+    // in a pre or textarea element, whitespace stays as it is
+    int pre;
+    // the > of the last open tag is not written yet, attributes may still come
+    bool pending;
+
+    // last, so init does not have to clear it
+    int at;
+    char buffer[HTMLSTREAM_WRITE_BUFFER];
+} htmlstream_writer_t;
+
+// write out the buffer, then len bytes of data with it
+static void htmlstream_write_flush(htmlstream_writer_t *w, const char *data, int len)
+{
+    struct iovec iov[2];
+    iov[0].iov_base = w->buffer;
+    iov[0].iov_len  = w->at;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len  = len;
+    int i = 0;
+    while (!w->error && i < 2) {
+        if (iov[i].iov_len == 0) {
+            i++;
+            continue;
+        }
+        ssize_t n = writev(w->fd, iov + i, 2 - i);
+        if (n < 0) {
+            if (errno != EINTR) {
+                w->error = errno;
+            }
+            continue;
+        }
+        for (; i < 2 && (size_t)n >= iov[i].iov_len; i++) {
+            n -= iov[i].iov_len;
+        }
+        if (i < 2) {
+            iov[i].iov_base = (char *)iov[i].iov_base + n;
+            iov[i].iov_len -= n;
+        }
+    }
+    w->at = 0;
+}
+
+static void htmlstream_write_bytes(htmlstream_writer_t *w, const char *data, int len)
+{
+    if (len > HTMLSTREAM_WRITE_BUFFER - w->at) {
+        if (len >= HTMLSTREAM_WRITE_DIRECT) {
+            htmlstream_write_flush(w, data, len);
+            return;
+        }
+        htmlstream_write_flush(w, 0, 0);
+    }
+    memcpy(w->buffer + w->at, data, len);
+    w->at += len;
+}
+
+static void htmlstream_write_char(htmlstream_writer_t *w, char c)
+{
+    if (w->at == HTMLSTREAM_WRITE_BUFFER) {
+        htmlstream_write_flush(w, 0, 0);
+    }
+    w->buffer[w->at++] = c;
+}
+
+static void htmlstream_write_escaped(htmlstream_writer_t *w, char c)
+{
+    switch (c) {
+        case '<':
+            htmlstream_write_bytes(w, "&lt;", 4);
+            break;
+        case '>':
+            htmlstream_write_bytes(w, "&gt;", 4);
+            break;
+        case '"':
+            htmlstream_write_bytes(w, "&quot;", 6);
+            break;
+        case '&':
+            htmlstream_write_bytes(w, "&amp;", 5);
+            break;
+        default:
+            htmlstream_write_char(w, c);
+    }
+}
+
+// data, escaped where it would end the text or value (quote is " in values, else 0).
+// & only if it was decoded, references the parser left alone are still references.
+// collapse: runs of whitespace become one space
+static void htmlstream_write_text(htmlstream_writer_t *w, const char *data, int len, char quote, bool collapse)
+{
+    char a = quote ? quote : '<';
+    char b = quote ? quote : '>';
+    char amp = w->t.flags & HTMLSTREAM_DECODE ? '&' : a;
+    if (collapse) {
+        bool space = false;
+        int i = 0;
+        while (i < len) {
+            // room for the longest reference, so plain bytes can go straight in
+            if (HTMLSTREAM_WRITE_BUFFER - w->at < 6) {
+                htmlstream_write_flush(w, 0, 0);
+            }
+            char *to  = w->buffer + w->at;
+            char *end = w->buffer + HTMLSTREAM_WRITE_BUFFER - 6;
+            for (; i < len && to <= end; i++) {
+                char c = data[i];
+                if (HTMLSTREAM_ISSPACE(c)) {
+                    if (!space) {
+                        *to++ = ' ';
+                    }
+                    space = true;
+                    continue;
+                }
+                space = false;
+                if (c == a || c == b || c == amp) {
+                    w->at = to - w->buffer;
+                    htmlstream_write_escaped(w, c);
+                    to = w->buffer + w->at;
+                } else {
+                    *to++ = c;
+                }
+            }
+            w->at = to - w->buffer;
+        }
+        return;
+    }
+    // runs in between go out in one piece
+    int i = 0;
+    while (i < len) {
+        int n = htmlstream_scan(data + i, len - i, a, b, amp, amp);
+        htmlstream_write_bytes(w, data + i, n);
+        i += n;
+        if (i < len) {
+            htmlstream_write_escaped(w, data[i++]);
+        }
+    }
+}
+
+// start a line at the current depth. elements past HTMLSTREAM_WRITE_DEPTH are not indented more
+static void htmlstream_write_line(htmlstream_writer_t *w)
+{
+    if (w->mode != HTMLSTREAM_WRITE_PRETTY || w->pre) {
+        return;
+    }
+    for (int n = w->depth * w->indent; n > 0; ) {
+        if (w->at == HTMLSTREAM_WRITE_BUFFER) {
+            htmlstream_write_flush(w, 0, 0);
+        }
+        int room = HTMLSTREAM_WRITE_BUFFER - w->at < n ? HTMLSTREAM_WRITE_BUFFER - w->at : n;
+        memset(w->buffer + w->at, ' ', room);
+        w->at += room;
+        n -= room;
+    }
+}
+
+static void htmlstream_write_end_line(htmlstream_writer_t *w)
+{
+    if (w->mode == HTMLSTREAM_WRITE_PRETTY && !w->pre) {
+        htmlstream_write_char(w, '\n');
+    }
+}
+
+// the open tag is over
+static void htmlstream_write_tag_end(htmlstream_writer_t *w)
+{
+    if (w->pending) {
+        htmlstream_write_char(w, '>');
+        htmlstream_write_end_line(w);
+        w->pending = false;
+    }
+}
+
+// whether a tag name (attr false) or attribute name can be written as it is: no quotes,
+// whitespace, / or > that would end it early, and a tag name starts with a letter
+static bool htmlstream_write_name(const char *name, int len, bool attr)
+{
+    if (len == 0 || (!attr && !((name[0] | 0x20) >= 'a' && (name[0] | 0x20) <= 'z'))) {
+        return false;
+    }
+    for (int i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (c <= ' ' || c == 0x7f || c == '>' || c == '/' ||
+                (attr && (c == '"' || c == '\'' || c == '=' || c == '<'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void htmlstream_write_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_writer_t *w = (htmlstream_writer_t *)parg;
+    htmlstream_write_tag_end(w);
+    // <x/> is written as <x>, an element with a name that is not is dropped with its attributes
+    int name_len = len > 1 && tag[len - 1] == '/' ? len - 1 : len;
+    if (!htmlstream_write_name(tag, name_len, false)) {
+        return;
+    }
+    htmlstream_write_line(w);
+    htmlstream_write_char(w, '<');
+    htmlstream_write_bytes(w, tag, name_len);
+    w->pending = true;
+    int id = htmlstream_tag_id(tag, len);
+    // void elements and <x/> have no content and no end tag
+    if (htmlstream_tag_flags[id] & HTMLSTREAM_TAG_VOID || (len && tag[len - 1] == '/')) {
+        return;
+    }
+    if (w->depth + 1 < HTMLSTREAM_WRITE_DEPTH) {
+        w->names[++w->depth] = htmlstream_internal_hash(tag, len);
+    } else {
+        w->over++;
+    }
+    w->pre += id == HTMLSTREAM_TAG_PRE || id == HTMLSTREAM_TAG_TEXTAREA;
+}
+
+static void htmlstream_write_attr_cb(void *parg, const char *key, int key_len, const char *val, int val_len)
+{
+    htmlstream_writer_t *w = (htmlstream_writer_t *)parg;
+    if (!w->pending || !htmlstream_write_name(key, key_len, true)) {
+        return;
+    }
+    htmlstream_write_char(w, ' ');
+    htmlstream_write_bytes(w, key, key_len);
+    if (val) {
+        htmlstream_write_bytes(w, "=\"", 2);
+        htmlstream_write_text(w, val, val_len, '"', false);
+        htmlstream_write_char(w, '"');
+    }
+}
+
+static void htmlstream_write_close_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_writer_t *w = (htmlstream_writer_t *)parg;
+    htmlstream_write_tag_end(w);
+    if (!htmlstream_write_name(tag, len, false)) {
+        return;
+    }
+    // closes everything opened inside it too. an end tag nothing matches changes nothing
+    if (w->over) {
+        w->over--;
+    } else {
+        uint32_t h = htmlstream_internal_hash(tag, len);
+        for (int d = w->depth; d > 0; d--) {
+            if (w->names[d] == h) {
+                w->depth = d - 1;
+                break;
+            }
+        }
+    }
+    // the end tag of a pre is still inside it, the line ends after it
+    htmlstream_write_line(w);
+    htmlstream_write_bytes(w, "</", 2);
+    htmlstream_write_bytes(w, tag, len);
+    htmlstream_write_char(w, '>');
+    int id = htmlstream_tag_id(tag, len);
+    if (w->pre && (id == HTMLSTREAM_TAG_PRE || id == HTMLSTREAM_TAG_TEXTAREA)) {
+        w->pre--;
+    }
+    htmlstream_write_end_line(w);
+}
+
+static void htmlstream_write_text_cb(void *parg, const char *text, int len)
+{
+    htmlstream_writer_t *w = (htmlstream_writer_t *)parg;
+    // in raw text nothing is escaped, except in rcdata_tags where references are decoded
+    bool escape = !w->t.rawtext || w->t.rcdata;
+    if (!w->pre && (w->mode == HTMLSTREAM_WRITE_PRETTY || !escape)) {
+        text = htmlstream_trimwhitespace(text, &len);
+        if (len == 0) {
+            return;
+        }
+    }
+    htmlstream_write_tag_end(w);
+    htmlstream_write_line(w);
+    if (!escape) {
+        htmlstream_write_bytes(w, text, len);
+    } else {
+        htmlstream_write_text(w, text, len, 0, w->mode == HTMLSTREAM_WRITE_MINIFY && !w->pre);
+    }
+    htmlstream_write_end_line(w);
+}
+
+// w writes to fd, in mode (HTMLSTREAM_WRITE_PRETTY or HTMLSTREAM_WRITE_MINIFY)
+static void htmlstream_write_init(htmlstream_writer_t *w, int fd, int mode)
+{
+    memset(w, 0, offsetof(htmlstream_writer_t, buffer));
+    htmlstream_init(&w->t);
+    w->t.open_cb  = htmlstream_write_open_cb;
+    w->t.close_cb = htmlstream_write_close_cb;
+    w->t.attr_cb  = htmlstream_write_attr_cb;
+    w->t.text_cb  = htmlstream_write_text_cb;
+    w->t.parg     = w;
+    w->t.flags    = HTMLSTREAM_KEEP_SPACE;
+    w->fd     = fd;
+    w->mode   = mode;
+    w->indent = 2;
+}
+
+// start over with a new document. keeps fd, mode and indent. call htmlstream_write_finish first
+static inline void htmlstream_write_reset(htmlstream_writer_t *w)
+{
+    htmlstream_reset(&w->t);
+    w->error   = 0;
+    w->depth   = 0;
+    w->over    = 0;
+    w->pre     = 0;
+    w->pending = false;
+    w->at      = 0;
+}
+
+// htmlstream_feed for w->t. output is written as the buffer fills up.
+// (htmlstream_feed_file on w->t works too, as long as HTMLSTREAM_KEEP_SPACE stays set)
+static inline int htmlstream_write_feed(htmlstream_writer_t *w, const char *data, int len)
+{
+    w->t.flags |= HTMLSTREAM_KEEP_SPACE;
+    return htmlstream_feed(&w->t, data, len);
+}
+
+// after the last htmlstream_write_feed: finish the last tag and write out what is buffered.
+// returns 0, or -1 (errno tells why) if a write failed
+static int htmlstream_write_finish(htmlstream_writer_t *w)
+{
+    htmlstream_write_tag_end(w);
+    if (w->mode == HTMLSTREAM_WRITE_MINIFY && !w->error) {
+        htmlstream_write_char(w, '\n');
+    }
+    htmlstream_write_flush(w, 0, 0);
+    if (w->error) {
+        errno = w->error;
+        return -1;
+    }
+    return 0;
+}
+
+#endif
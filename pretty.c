@@ -1,57 +1,76 @@
 #include "htmlstream.h"
+#include "htmlstream_file.h"
+#include "htmlstream_write.h"
 #include <stdio.h>
-#include <unistd.h>
+#include <string.h>
 
-static int indent = 0;
-static bool was_open = false;
-void pretty_open_cb(void *parg, const char *tag, int len)
+#ifdef HTMLSTREAM_STATS
+static const char *const pretty_states[HTMLSTREAM_STATES] = {
+    "text", "tag_start", "opening_tag", "opening_tag_end", "tag_start_slash", "closing_tag",
+    "attr_key", "attr_key_quote", "attr_key_end", "attr_eq", "attr_val", "attr_val_quote",
+    "markup", "cdata_start", "comment", "cdata", "bogus", "rawtext", "rawtext_end", "entity",
+};
+
+void pretty_stats(const htmlstream_stats_t *st)
 {
-    if (was_open) {
-        was_open = false;
-        printf(">\n");
+    long long total = 0;
+    for (int i = 0; i < HTMLSTREAM_STATES; i++) {
+        total += st->bytes[i];
     }
-    ++indent;
-    printf("%*s<%.*s", indent, " ", len, tag);
-    was_open = true;
-}
-void pretty_close_cb(void *parg, const char *tag, int len)
-{
-    if (was_open) {
-        was_open = false;
-        printf(">\n");
+    fprintf(stderr, "bytes by state:\n");
+    for (int i = 0; i < HTMLSTREAM_STATES; i++) {
+        if (st->bytes[i]) {
+            fprintf(stderr, "  %-16s %12lld %5.1f%%\n", pretty_states[i], st->bytes[i], 100.0 * st->bytes[i] / total);
+        }
     }
-    --indent;
-    printf("%*s</%.*s>\n", indent, " ", len, tag);
-}
-void pretty_text_cb(void *parg, const char *text, int len)
-{
-    if (was_open) {
-        was_open = false;
-        printf(">\n");
-    }
-    printf("%*s%.*s\n", indent, " ", len, text);
-}
-
-void pretty_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
-{
-    printf(" %.*s='%.*s'", key_l, key, val_l, val);
+    fprintf(stderr, "events: %lld open, %lld close, %lld attr, %lld text, %lld comment\n",
+            st->opens, st->closes, st->attrs, st->texts, st->comments);
+    fprintf(stderr, "replays %lld, truncated bytes %lld, recoveries %lld, skipped bytes %lld\n",
+            st->replays, st->truncated, st->recoveries, st->skipped);
 }
+#endif
 
 int main(int argc, char **argv)
 {
-    htmlstream_t t;
-    htmlstream_init(&t);
-    t.open_cb = pretty_open_cb;
-    t.close_cb = pretty_close_cb;
-    t.text_cb  = pretty_text_cb;
-    t.attr_cb  = pretty_attr_cb;
-
-    for (;;) {
-        char buf[1024];
-        int l = read(fileno(stdin), buf, 1024);
-        if (l < 1)
-            return 0;
-        htmlstream_feed(&t, buf, l);
+    // pretty [-m] [-s] [file], stdin without one. -m: minified instead,
+    // -s: counters to stderr at the end
+    int mode   = HTMLSTREAM_WRITE_PRETTY;
+#ifdef HTMLSTREAM_STATS
+    bool stats = false;
+#endif
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "-m") == 0) {
+            mode = HTMLSTREAM_WRITE_MINIFY;
+        } else if (strcmp(argv[i], "-s") == 0) {
+#ifdef HTMLSTREAM_STATS
+            stats = true;
+#else
+            // counting costs, even when nobody looks
+            fprintf(stderr, "pretty: -s needs pretty_stats, built with HTMLSTREAM_STATS\n");
+            return 1;
+#endif
+        } else {
+            fprintf(stderr, "usage: pretty [-m] [-s] [file]\n");
+            return 1;
+        }
     }
+    const char *path = i < argc ? argv[i] : 0;
 
+    static htmlstream_writer_t w;
+    htmlstream_write_init(&w, fileno(stdout), mode);
+    if ((path ? htmlstream_feed_file(&w.t, path) : htmlstream_feed_fd(&w.t, fileno(stdin))) < 0) {
+        perror(path ? path : "stdin");
+        return 1;
+    }
+    if (htmlstream_write_finish(&w) < 0) {
+        perror("stdout");
+        return 1;
+    }
+#ifdef HTMLSTREAM_STATS
+    if (stats) {
+        pretty_stats(&w.t.stats);
+    }
+#endif
+    return 0;
 }
@@ -1,10 +1,42 @@
+// all of the named character references, not just the xml ones
+#define HTMLSTREAM_ENTITIES
+#define HTMLSTREAM_ELEMENT_STACK
 #include "htmlstream.h"
+#include "htmlstream_names.h"
+#define HTMLSTREAM_PARALLEL_MIN_SEGMENT 64
+#include "htmlstream_parallel.h"
+#include "htmlstream_select.h"
+#include "htmlstream_file.h"
+#include "htmlstream_write.h"
+#include "htmlstream_tree.h"
+#include "htmlstream_links.h"
 #include <stdio.h>
 
 
 static int expected_cb_count = 0;
 static int actual_cb_count   = 0;
 
+// counts a test that is not a callback and prints it, a failure ends the run
+static void test_result(bool ok, const char *what, const char *subject)
+{
+    actual_cb_count++;
+    printf("[%s %d] %s%s%s \n", ok ? "PASS" : "FAIL", actual_cb_count, what, *subject ? " " : "", subject);
+    if (!ok) {
+        exit(2);
+    }
+}
+
+// what a helper made of the document fed whole and byte by byte, both must be expected
+static void test_whole_bytes(const char *what, const char *subject, const char *whole, const char *bytes,
+        const char *expected)
+{
+    bool ok = strcmp(whole, expected) == 0 && strcmp(bytes, expected) == 0;
+    if (!ok) {
+        printf("'%s' '%s' != '%s' \n", whole, bytes, expected);
+    }
+    test_result(ok, what, subject);
+}
+
 const char *expected_open;
 void test_htmlstream_open_cb(void *parg, const char *tag, int len)
 {
@@ -55,9 +87,14 @@ void test_htmlstream_attr_cb(void *parg, const char *key, int key_l, const char
     printf("[PASS %d] %s=%s \n", actual_cb_count, expected_key,expected_val);
 }
 
+const char *expected_span;
 void test_htmlstream_text_cb(void *parg, const char *text, int len)
 {
     actual_cb_count++;
+    if (expected_span && (text < expected_span || text + len > expected_span + strlen(expected_span))) {
+        printf("[FAIL %d] text '%.*s' not in place \n", actual_cb_count, len, text);
+        exit(2);
+    }
     if (len == strlen(expected_val) && strncmp(expected_val, text, len) == 0) {
         printf("[PASS %d] text '%.*s' \n", actual_cb_count, len, text, expected_val);
     } else {
@@ -66,6 +103,417 @@ void test_htmlstream_text_cb(void *parg, const char *text, int len)
     }
 }
 
+static char parts[4096];
+static int  parts_at = 0;
+static int  parts_count = 0;
+void test_htmlstream_text_part_cb(void *parg, const char *text, int len, bool final)
+{
+    memcpy(parts + parts_at, text, len);
+    parts_at += len;
+    parts_count++;
+    if (!final) {
+        return;
+    }
+    test_htmlstream_text_cb(parg, parts, parts_at);
+    printf("[PASS %d] in %d parts \n", actual_cb_count, parts_count);
+    parts_at = 0;
+    parts_count = 0;
+}
+
+static char arena[4096];
+static int  arena_at = 0;
+void *test_arena_alloc(void *parg, void *ptr, int size)
+{
+    if (size < 1 || arena_at + size > sizeof(arena)) {
+        return 0;
+    }
+    arena_at += size;
+    return arena + arena_at - size;
+}
+
+#define LONG_TEXT \
+    "this paragraph is longer than HTMLSTREAM_TAG_BUFFER_SIZE, " \
+    "so it only makes it through in one piece when the buffer can grow. " \
+    "the arena hands out a new block whenever that happens"
+
+#define LONG_VALUE \
+    "some/very/long/path/that/does/not/fit/into/the/buffer/either/" \
+    "but/an/arena/makes/room/for/it"
+
+static unsigned long events_hash;
+void test_hash(char type, const char *str, int len)
+{
+    events_hash = events_hash * 31 + type;
+    for (int i = 0; i < len; i++) {
+        events_hash = events_hash * 31 + str[i];
+    }
+}
+void test_hash_open_cb(void *parg, const char *tag, int len) { test_hash('o', tag, len); }
+void test_hash_close_cb(void *parg, const char *tag, int len) { test_hash('c', tag, len); }
+void test_hash_text_cb(void *parg, const char *text, int len) { test_hash('t', text, len); }
+void test_hash_attr_cb(void *parg, const char *key, int key_l, const char *val, int val_l)
+{
+    test_hash('k', key, key_l);
+    test_hash(val ? 'v' : 'n', val, val_l);
+}
+
+void test_directive_open_cb(void *parg, const char *tag, int len);
+void test_hash_directive_open_cb(void *parg, const char *tag, int len)
+{
+    test_hash('o', tag, len);
+    test_directive_open_cb(parg, tag, len);
+}
+
+static bool parallel_directives;
+
+// parsing on threads must give the same events as parsing in one go. with
+// parallel_directives, open_cb skips and stops like test_directive_open_cb
+unsigned long test_parallel_hash(const char *html, int len, int threads)
+{
+    htmlstream_t p;
+    htmlstream_init(&p);
+    p.open_cb  = parallel_directives ? test_hash_directive_open_cb : test_hash_open_cb;
+    p.close_cb = test_hash_close_cb;
+    p.text_cb  = test_hash_text_cb;
+    p.attr_cb  = test_hash_attr_cb;
+    p.parg     = &p;
+    events_hash = 0;
+    int used = htmlstream_feed_parallel(&p, html, len, threads);
+    htmlstream_feed(&p, "<end>", 5);
+    return events_hash * 31 + used;
+}
+
+// parsing up to split, checkpointing and going on from the checkpoint in another
+// parser must give the same events as parsing in one go
+unsigned long test_checkpoint_hash(const char *html, int split, int flags)
+{
+    htmlstream_t p[2];
+    for (int i = 0; i < 2; i++) {
+        htmlstream_init(&p[i]);
+        p[i].open_cb  = test_hash_open_cb;
+        p[i].close_cb = test_hash_close_cb;
+        p[i].text_cb  = test_hash_text_cb;
+        p[i].attr_cb  = test_hash_attr_cb;
+        p[i].flags    = flags;
+    }
+    events_hash = 0;
+    htmlstream_feed(&p[0], html, split);
+    char blob[256];
+    int n = htmlstream_checkpoint(&p[0], blob, sizeof(blob));
+    if (n > sizeof(blob) || !htmlstream_restore(&p[1], blob, n)) {
+        return 0;
+    }
+    htmlstream_feed(&p[1], html + split, strlen(html) - split);
+    htmlstream_feed(&p[1], "<end>", 5);
+    return events_hash;
+}
+
+#define TEST_CHECKPOINT(HTML, FLAGS) \
+{\
+    ++expected_cb_count; \
+    int len = strlen(HTML); \
+    unsigned long one = test_checkpoint_hash(HTML, len, FLAGS); \
+    int split = 0; \
+    while (split < len && test_checkpoint_hash(HTML, split, FLAGS) == one) { \
+        split++; \
+    } \
+    if (split < len) { \
+        printf("differs at %d \n", split); \
+    } \
+    test_result(split == len, "checkpoint", HTML); \
+}
+
+void *test_heap_alloc(void *parg, void *ptr, int size)
+{
+    if (size < 1) {
+        free(ptr);
+        return 0;
+    }
+    return malloc(size);
+}
+
+// what a writer makes of html, fed whole or byte by byte. 0 terminated, free it
+char *test_write(const char *html, int mode, int flags, bool bytewise)
+{
+    FILE *f = tmpfile();
+    htmlstream_writer_t *w = (htmlstream_writer_t *)malloc(sizeof(htmlstream_writer_t));
+    htmlstream_write_init(w, fileno(f), mode);
+    w->t.flags    = flags;
+    w->t.alloc_cb = test_heap_alloc;
+    int len = strlen(html);
+    for (int at = 0; at < len; at += bytewise ? 1 : len) {
+        htmlstream_write_feed(w, html + at, bytewise ? 1 : len);
+    }
+    htmlstream_write_finish(w);
+    htmlstream_free(&w->t);
+    free(w);
+    off_t size = lseek(fileno(f), 0, SEEK_END);
+    char *out = (char *)malloc(size + 1);
+    out[pread(fileno(f), out, size, 0) == size ? size : 0] = 0;
+    fclose(f);
+    return out;
+}
+
+#define TEST_WRITE(HTML, MODE, FLAGS, EXPECTED) \
+{\
+    ++expected_cb_count; \
+    char *whole = test_write(HTML, MODE, FLAGS, false); \
+    char *bytes = test_write(HTML, MODE, FLAGS, true); \
+    test_whole_bytes("write", HTML, whole, bytes, EXPECTED); \
+    free(whole); \
+    free(bytes); \
+}
+
+// the tree below node as p[k=v,k](child,'text'). ! marks a child with the wrong parent
+static int test_tree_dump(const htmlstream_tree_t *tree, int node, char *out)
+{
+    const htmlstream_node_t *n = &tree->nodes[node];
+    int at = 0;
+    if (n->type == HTMLSTREAM_NODE_TEXT) {
+        return sprintf(out, "'%.*s'", n->len, n->name);
+    }
+    at += sprintf(out + at, "%.*s", n->len, n->name);
+    for (int i = 0; i < n->attrs_count; i++) {
+        const htmlstream_node_attr_t *a = &tree->attrs[n->attrs + i];
+        at += sprintf(out + at, "%c%.*s", i ? ',' : '[', a->key_len, a->key);
+        if (a->val_len) {
+            at += sprintf(out + at, "=%.*s", a->val_len, a->val);
+        }
+    }
+    at += sprintf(out + at, "%s", n->attrs_count ? "]" : "");
+    for (int c = n->first_child; c; c = tree->nodes[c].next_sibling) {
+        out[at++] = c == n->first_child ? '(' : ',';
+        if (tree->nodes[c].parent != node) {
+            out[at++] = '!';
+        }
+        at += test_tree_dump(tree, c, out + at);
+        out[at] = tree->nodes[c].next_sibling ? 0 : ')';
+        at += !tree->nodes[c].next_sibling;
+    }
+    out[at] = 0;
+    return at;
+}
+
+// the tree of html, parsed whole or fed byte by byte
+static void test_tree(htmlstream_tree_t *tree, const char *html, bool bytewise, char *out)
+{
+    htmlstream_tree_clear(tree);
+    int len = strlen(html);
+    if (bytewise) {
+        for (int at = 0; at < len; at++) {
+            htmlstream_tree_feed(tree, html + at, 1);
+        }
+    } else {
+        htmlstream_tree_parse(tree, html, len);
+    }
+    test_tree_dump(tree, 0, out);
+}
+
+#define TEST_TREE(HTML, EXPECTED) \
+{\
+    ++expected_cb_count; \
+    char whole[1024]; \
+    char bytes[1024]; \
+    test_tree(&tree, HTML, false, whole); \
+    test_tree(&tree, HTML, true, bytes); \
+    test_whole_bytes("tree", HTML, whole, bytes, EXPECTED); \
+}
+
+// what links finds in html at url, fed whole or byte by byte, as kind:key=value|...
+static void test_links(const char *url, const char *html, bool bytewise, char *out)
+{
+    htmlstream_links_t *l = (htmlstream_links_t *)malloc(sizeof(htmlstream_links_t));
+    htmlstream_links_init(l, url);
+    int len = strlen(html);
+    for (int at = 0; at < len; at += bytewise ? 1 : len) {
+        htmlstream_links_feed(l, html + at, bytewise ? 1 : len);
+    }
+    htmlstream_links_finish(l);
+    int at = 0;
+    for (int i = 0; i < l->links_count; i++) {
+        const htmlstream_link_t *link = &l->links[i];
+        const char *key = htmlstream_link_key(l, link);
+        at += sprintf(out + at, "%d:%.*s=%.*s|", link->kind, key ? link->key_len : 0, key ? key : "",
+                link->value_len, htmlstream_link_value(l, link));
+    }
+    out[at] = 0;
+    htmlstream_links_free(l);
+    free(l);
+}
+
+#define TEST_LINKS(URL, HTML, EXPECTED) \
+{\
+    ++expected_cb_count; \
+    char whole[1024]; \
+    char bytes[1024]; \
+    test_links(URL, HTML, false, whole); \
+    test_links(URL, HTML, true, bytes); \
+    test_whole_bytes("links", HTML, whole, bytes, EXPECTED); \
+}
+
+// counts text spans that lie inside the document in parg
+static int parallel_spans;
+void test_parallel_span_cb(void *parg, const char *text, int len)
+{
+    const char *doc = (const char *)parg;
+    parallel_spans += text >= doc && text + len <= doc + 40 * 50;
+}
+
+#define TEST_PARALLEL(HTML, REPEAT) \
+{\
+    ++expected_cb_count; \
+    int len = strlen(HTML); \
+    char *doc = malloc(len * REPEAT); \
+    for (int i = 0; i < REPEAT; i++) { \
+        memcpy(doc + i * len, HTML, len); \
+    } \
+    unsigned long one = test_parallel_hash(doc, len * REPEAT, 1); \
+    unsigned long many = test_parallel_hash(doc, len * REPEAT, 4); \
+    test_result(one == many, "parallel", HTML); \
+    free(doc); \
+}
+
+static int batch_seen[8];
+void test_batch_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_batch_arg_t *arg = (htmlstream_batch_arg_t *)parg;
+    if (len == 1 && tag[0] == '0' + arg->index && arg->parg == &batch_seen) {
+        __sync_fetch_and_add(&batch_seen[arg->index], 1);
+    }
+    if (len == 4 && strncmp(tag, "stop", 4) == 0) {
+        htmlstream_stop(arg->t);
+    }
+}
+
+// parg is the parser. skips <nav> and <br>, stops at <stop>
+void test_directive_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_t *t = (htmlstream_t *)parg;
+    if ((len == 3 && strncmp(tag, "nav", 3) == 0) || (len == 2 && strncmp(tag, "br", 2) == 0)) {
+        htmlstream_skip(t);
+    }
+    if (len == 4 && strncmp(tag, "stop", 4) == 0) {
+        htmlstream_stop(t);
+    }
+}
+
+static int  select_matches;
+static char select_found[256];
+void test_select_cb(void *parg, int selector, const htmlstream_element_t *e)
+{
+    int len;
+    const char *id = htmlstream_element_attr(e, "id", &len);
+    select_matches++;
+    snprintf(select_found + strlen(select_found), sizeof(select_found) - strlen(select_found),
+            "%d:%.*s ", selector, id ? len : 0, id ? id : "");
+}
+
+static int select_flags;
+
+// matches of selectors, separated by ;, fed in step sized pieces
+const char *test_select(const char *selectors, const char *html, int step)
+{
+    static htmlstream_select_t s;
+    htmlstream_select_init(&s);
+    s.match_cb = test_select_cb;
+    s.t.flags  = select_flags;
+    char list[256];
+    snprintf(list, sizeof(list), "%s", selectors);
+    for (char *sel = strtok(list, ";"); sel; sel = strtok(0, ";")) {
+        if (htmlstream_select_add(&s, sel) < 0) {
+            return "invalid";
+        }
+    }
+    select_found[0] = 0;
+    int len = strlen(html);
+    for (int at = 0; at < len; at += step) {
+        htmlstream_select_feed(&s, html + at, len - at < step ? len - at : step);
+    }
+    return select_found;
+}
+
+#define TEST_SELECT(FOUND, SELECTORS, HTML) \
+{\
+    ++expected_cb_count; \
+    char whole[256]; \
+    snprintf(whole, sizeof(whole), "%s", test_select(SELECTORS, HTML, strlen(HTML))); \
+    const char *bytes = test_select(SELECTORS, HTML, 1); \
+    test_whole_bytes("select", SELECTORS, whole, bytes, FOUND); \
+}
+
+// opens as the path and depth the parser has for them, closes as the name. parg is the
+// parser, <nav> is skipped
+static char stack_log[16384];
+void test_stack_open_cb(void *parg, const char *tag, int len)
+{
+    htmlstream_t *t = (htmlstream_t *)parg;
+    int path_len;
+    const char *path = htmlstream_path(t, &path_len);
+    snprintf(stack_log + strlen(stack_log), sizeof(stack_log) - strlen(stack_log),
+            "%.*s:%d ", path_len, path, htmlstream_depth(t));
+    if (len == 3 && strncmp(tag, "nav", 3) == 0) {
+        htmlstream_skip(t);
+    }
+}
+void test_stack_close_cb(void *parg, const char *tag, int len)
+{
+    snprintf(stack_log + strlen(stack_log), sizeof(stack_log) - strlen(stack_log), "/%.*s ", len, tag);
+}
+
+// the events of a document with HTMLSTREAM_STACK, fed in step sized pieces
+const char *test_stack(const char *html, int step)
+{
+    static htmlstream_t p;
+    htmlstream_init(&p);
+    p.open_cb  = test_stack_open_cb;
+    p.close_cb = test_stack_close_cb;
+    p.parg     = &p;
+    p.flags    = HTMLSTREAM_STACK;
+    stack_log[0] = 0;
+    int len = strlen(html);
+    for (int at = 0; at < len; at += step) {
+        htmlstream_feed(&p, html + at, len - at < step ? len - at : step);
+    }
+    htmlstream_close_all(&p);
+    return stack_log;
+}
+
+#define TEST_STACK(EVENTS, HTML) \
+{\
+    ++expected_cb_count; \
+    char whole[512]; \
+    snprintf(whole, sizeof(whole), "%s", test_stack(HTML, strlen(HTML))); \
+    const char *bytes = test_stack(HTML, 1); \
+    test_whole_bytes("stack", HTML, whole, bytes, EVENTS); \
+}
+
+HTMLSTREAM_SPECIALIZE(test_feed_attrs, 0, 0, test_htmlstream_attr_cb, 0)
+HTMLSTREAM_SPECIALIZE(test_feed_text, 0, 0, 0, test_htmlstream_text_cb)
+HTMLSTREAM_SPECIALIZE(test_feed_noattr, test_hash_open_cb, test_hash_close_cb, 0, test_hash_text_cb)
+
+// a specialized parser without attr_cb skips attributes in bulk, which must not
+// change any other event
+int test_noattr_same(const char *html, int bytewise)
+{
+    int len = strlen(html);
+    htmlstream_t p;
+    htmlstream_init(&p);
+    p.open_cb  = test_hash_open_cb;
+    p.close_cb = test_hash_close_cb;
+    p.text_cb  = test_hash_text_cb;
+    events_hash = 0;
+    htmlstream_feed(&p, html, len);
+    htmlstream_feed(&p, "<end>", 5);
+    unsigned long general = events_hash;
+    htmlstream_init(&p);
+    events_hash = 0;
+    for (int i = 0; i < len; i += bytewise ? 1 : len) {
+        test_feed_noattr(&p, html + i, bytewise ? 1 : len);
+    }
+    test_feed_noattr(&p, "<end>", 5);
+    return general == events_hash;
+}
+
 #define TEST_OPEN(NAME, HTML) \
 {\
     ++expected_cb_count; \
@@ -100,6 +548,28 @@ void test_htmlstream_text_cb(void *parg, const char *text, int len)
     htmlstream_feed(&t, HTML, strlen(HTML));\
     t.text_cb = 0; \
 }
+#define TEST_TEXT_PARTS(TEXT, HTML) \
+{\
+    ++expected_cb_count; \
+    expected_val = TEXT; \
+    t.text_part_cb = test_htmlstream_text_part_cb; \
+    htmlstream_feed(&t, HTML, strlen(HTML));\
+    t.text_part_cb = 0; \
+}
+#define TEST_COMMENT(TEXT, HTML) \
+{\
+    ++expected_cb_count; \
+    expected_val = TEXT; \
+    t.comment_cb = test_htmlstream_text_part_cb; \
+    htmlstream_feed(&t, HTML, strlen(HTML));\
+    t.comment_cb = 0; \
+}
+#define TEST_SPAN(TEXT, HTML) \
+{\
+    expected_span = HTML; \
+    TEST_TEXT(TEXT, expected_span); \
+    expected_span = 0; \
+}
 
 
 int main(int argc, char**argv)
@@ -142,10 +612,624 @@ int main(int argc, char**argv)
     TEST_TEXT("yolo", "<yoo lo>yo<!--yo -->lo< / lo >");
     TEST_TEXT("turbo 'swag", "<ok >    turbo 'swag  </d>");
 
+    t.flags = HTMLSTREAM_ZEROCOPY; //30
+    TEST_SPAN("zero copy", "<p> zero copy </p>");
+    htmlstream_feed(&t, "<Strad", 6);
+    TEST_OPEN("straddles", "dles>");
+    TEST_ATTR("href", "/case", "<a href='/Case'>");
+    htmlstream_feed(&t, "<p>spl", 6);
+    TEST_TEXT("split", "it</p>");
+    t.flags = 0;
 
+    t.alloc_cb = test_arena_alloc; //34
+    TEST_TEXT(LONG_TEXT, "<p>" LONG_TEXT "</p>");
+    TEST_ATTR("href", "/" LONG_VALUE, "<a href='/" LONG_VALUE "'>");
+    htmlstream_feed(&t, "<p>" LONG_TEXT, strlen(LONG_TEXT) + 3);
+    TEST_TEXT(LONG_TEXT " and more", " and more</p>");
+    htmlstream_free(&t);
+    t.alloc_cb = 0;
 
+    t.text_part_cb = test_htmlstream_text_part_cb; //37
+    htmlstream_feed(&t, "<pre>  " LONG_TEXT, strlen(LONG_TEXT) + 7);
+    htmlstream_feed(&t, " and  ", 6);
+    TEST_TEXT_PARTS(LONG_TEXT " and   more", " more  </pre>");
+    TEST_TEXT_PARTS("short", "<p> short </p>");
+    {
+        // whitespace goes out with what comes after it, however much of it there is
+        char spaces[256], expect[300];
+        memset(spaces, ' ', sizeof(spaces));
+        t.text_part_cb = test_htmlstream_text_part_cb;
+        htmlstream_feed(&t, "<p>" LONG_TEXT, strlen(LONG_TEXT) + 3);
+        htmlstream_feed(&t, spaces, sizeof(spaces));
+        TEST_TEXT_PARTS(LONG_TEXT, "\n</p>");
+        // and is cut to the buffer without an allocator
+        sprintf(expect, "x%.*sy", HTMLSTREAM_TAG_BUFFER_SIZE, spaces);
+        t.text_part_cb = test_htmlstream_text_part_cb;
+        htmlstream_feed(&t, "<p>x", 4);
+        htmlstream_feed(&t, spaces, sizeof(spaces));
+        TEST_TEXT_PARTS(expect, "y</p>");
+        sprintf(expect, "x%.*sy", (int)sizeof(spaces), spaces);
+        t.alloc_cb = test_arena_alloc;
+        t.text_part_cb = test_htmlstream_text_part_cb;
+        htmlstream_feed(&t, "<p>x", 4);
+        htmlstream_feed(&t, spaces, sizeof(spaces));
+        TEST_TEXT_PARTS(expect, "y</p>");
+        htmlstream_free(&t);
+        t.alloc_cb = 0;
+    }
 
+    TEST_PARALLEL("<li class=x>item <b>one</b></li>", 50); //42
+    TEST_PARALLEL("<a title='x><y'>a > b</a><!-- <p>x</p> -->", 50);
+    TEST_PARALLEL("<input disabled value=''><br>", 50);
+    parallel_directives = true;
+    TEST_PARALLEL("<nav><li>in <nav>deep</nav></li></nav><p class=x>out</p><br>", 50);
+    {
+        ++expected_cb_count;
+        // zero copy spans point into the document, not into a segment's log
+        static char doc[40 * 50 + 1];
+        for (int i = 0; i < 50; i++) {
+            memcpy(doc + i * 40, "<p title='a long enough titles'>text</p>", 40);
+        }
+        htmlstream_t p;
+        htmlstream_init(&p);
+        p.flags   = HTMLSTREAM_ZEROCOPY;
+        p.text_cb = test_parallel_span_cb;
+        p.parg    = doc;
+        parallel_spans = 0;
+        htmlstream_feed_parallel(&p, doc, 40 * 50, 4);
+        bool passed = parallel_spans == 50;
+        if (!passed) {
+            printf("%d \n", parallel_spans);
+        }
+        test_result(passed, "parallel zero copy", "");
+    }
+    {
+        // a stop in a later segment ends it there, and the rest is not parsed
+        ++expected_cb_count;
+        const char *item = "<li>item <b>one</b></li>";
+        int len = strlen(item);
+        char *doc = malloc(50 * len + 32);
+        for (int i = 0; i < 50; i++) {
+            memcpy(doc + i * len, item, len);
+        }
+        strcpy(doc + 50 * len, "<stop><li>after</li>");
+        unsigned long one  = test_parallel_hash(doc, strlen(doc), 1);
+        unsigned long many = test_parallel_hash(doc, strlen(doc), 4);
+        test_result(one == many, "parallel stop", "");
+        free(doc);
+    }
+    parallel_directives = false;
 
+    { //48
+        ++expected_cb_count;
+        htmlstream_doc_t docs[8];
+        const char *html[] = {"<0><0>", "<1", "<2><2", "<3>", "<4>", "<5><5><stop><5>", "<6>", "<7>"};
+        int want[] = {2, 0, 1, 1, 1, 2, 1, 1};
+        for (int i = 0; i < 8; i++) {
+            docs[i].data = html[i];
+            docs[i].len  = strlen(html[i]);
+        }
+        htmlstream_t proto;
+        htmlstream_init(&proto);
+        proto.open_cb = test_batch_open_cb;
+        proto.parg = &batch_seen;
+        htmlstream_feed_batch(&proto, docs, 8, 3);
+        test_result(memcmp(batch_seen, want, sizeof(want)) == 0, "batch", "");
+    }
+
+    { //49
+        ++expected_cb_count;
+        htmlstream_event_t events[8];
+        char strings[64];
+        htmlstream_tape_t tape = {events, 8, 0, strings, sizeof(strings), 0, false};
+        t.tape = &tape;
+        htmlstream_feed(&t, "<a Href=x checked> link </a>", 28);
+        t.tape = 0;
+        int want[] = {HTMLSTREAM_EVENT_OPEN, HTMLSTREAM_EVENT_ATTR, HTMLSTREAM_EVENT_VALUE,
+            HTMLSTREAM_EVENT_ATTR, HTMLSTREAM_EVENT_VALUE, HTMLSTREAM_EVENT_TEXT, HTMLSTREAM_EVENT_CLOSE};
+        bool ok = tape.count == 7 && !tape.overflow &&
+            events[4].flags == HTMLSTREAM_EVENT_NOVALUE &&
+            events[1].len == 4 && strncmp(strings + events[1].offset, "href", 4) == 0;
+        for (int i = 0; ok && i < 7; i++) {
+            ok = events[i].type == want[i];
+        }
+        test_result(ok, "tape", "");
+
+        ++expected_cb_count; //50
+        expected_key = "checked";
+        expected_val = 0;
+        htmlstream_tape_clear(&tape);
+        t.tape = &tape;
+        htmlstream_feed(&t, "<b checked>", 11);
+        t.tape = 0;
+        t.attr_cb = test_htmlstream_attr_cb;
+        htmlstream_tape_replay(&tape, &t);
+        t.attr_cb = 0;
+    }
+
+    ++expected_cb_count; //51
+    expected_key = "href";
+    expected_val = "/x";
+    test_feed_attrs(&t, "<a href=/X>some text</a>", 24);
+    ++expected_cb_count;
+    expected_val = "some text";
+    test_feed_text(&t, "<a href=/X> some text</a>", 25);
+
+    TEST_COMMENT(" hi -- there- ", "<p><!-- hi -- there- --></p>"); //53
+    TEST_COMMENT("a-", "<!--a--->");
+    TEST_COMMENT("?xml version='1.0'?", "<?xml version='1.0'?>");
+    TEST_TEXT("a<b> ]] c", "<p>a<![CDATA[<b> ]] ]]>c</p>");
+
+    TEST_TEXT("if (a<b) x = '</p>';", "<script>if (a<b) x = '</p>';</script>"); //57
+    TEST_TEXT("<!-- not a comment -->", "<style type=text/css><!-- not a comment --></STYLE>");
+    TEST_CLOSE("title", "<title>a</titles></TITLE >");
+    {
+        static const char *const xmp[] = {"xmp", 0};
+        t.rawtext_tags = xmp;
+        TEST_TEXT("<b>", "<xmp><b></xmp>");
+        t.rawtext_tags = 0;
+        TEST_TEXT("x", "<script><b>x</b></script>");
+        t.rawtext_tags = htmlstream_rawtext_default;
+    }
+
+    t.parg    = &t;
+    t.open_cb = test_directive_open_cb;
+    TEST_TEXT("after", "<nav a='>'><nav>in</nav><script>'</nav>'</script><p>x</p></nav>after</b>"); //62
+    TEST_TEXT("y", "<NAV />y</b>");
+    TEST_TEXT("z", "<br>z</b>");
+    {
+        ++expected_cb_count;
+        const char *html = "<a>x</a><stop>y</b>";
+        int used  = htmlstream_feed(&t, html, strlen(html));
+        int again = htmlstream_feed(&t, "<a>", 3);
+        htmlstream_reset(&t);
+        bool passed = used == 14 && again == 0 && htmlstream_feed(&t, "<a>", 3) == 3;
+        if (!passed) {
+            printf("after %d, %d \n", used, again);
+        }
+        test_result(passed, "stop", "");
+    }
+    t.open_cb = 0;
+    t.parg    = 0;
+
+    TEST_SELECT("0:a 0:c ", "a[href]", "<a id=a href=x><a id=b name=y><br><A Id=c hRef>"); //66
+    TEST_SELECT("0:b ", "div.article p",
+            "<p id=a><div class='main article'><section><p id=b></section></div><p id=c>");
+    TEST_SELECT("0:b ", "ul > li", "<ul><li id=b><ol><li id=c></li></ol></li></ul><li id=d>");
+    TEST_SELECT("1:og 0:n ", "#n, b;meta[property^=og:]",
+            "<meta id=og property=og:title><meta property=description><b id=n/>");
+    TEST_SELECT("0:x ", "[data-v='a b'] *", "<i data-v=\"a b\"><img id=x></i><s id=y>");
+    TEST_SELECT("invalid", "a >", "<a>");
+
+    { //72
+        ++expected_cb_count;
+        bool ok = htmlstream_tag_id("a", 1) == HTMLSTREAM_TAG_A &&
+            htmlstream_tag_id("blockquote", 10) == HTMLSTREAM_TAG_BLOCKQUOTE &&
+            htmlstream_attr_id("http-equiv", 10) == HTMLSTREAM_ATTR_HTTP_EQUIV &&
+            htmlstream_tag_id("derp", 4) == 0 && htmlstream_tag_id("DIV", 3) == 0 &&
+            htmlstream_tag_id("", 0) == 0 && htmlstream_attr_id("hrefs", 5) == 0 &&
+            htmlstream_tag_flags[HTMLSTREAM_TAG_IMG] == HTMLSTREAM_TAG_VOID;
+        for (int id = 1; ok && id < HTMLSTREAM_TAG_COUNT; id++) {
+            ok = htmlstream_tag_id(htmlstream_tag_names[id], strlen(htmlstream_tag_names[id])) == id;
+        }
+        for (int id = 1; ok && id < HTMLSTREAM_ATTR_COUNT; id++) {
+            ok = htmlstream_attr_id(htmlstream_attr_names[id], strlen(htmlstream_attr_names[id])) == id;
+        }
+        // the core's own list of void elements has to agree with the table
+        int voids = 0;
+        for (int id = 1; id < HTMLSTREAM_TAG_COUNT; id++) {
+            voids += (htmlstream_tag_flags[id] & HTMLSTREAM_TAG_VOID) != 0;
+        }
+        for (int k = 0; ok && htmlstream_void_tags[k]; k++, voids--) {
+            const char *name = htmlstream_void_tags[k];
+            ok = htmlstream_tag_flags[htmlstream_tag_id(name, strlen(name))] & HTMLSTREAM_TAG_VOID;
+        }
+        ok = ok && voids == 0;
+        test_result(ok, "name ids", "");
+    }
+
+    t.flags = HTMLSTREAM_DECODE; //73
+    TEST_TEXT("a & b < c ' \xc3\xa9 \xe2\x82\xac", "<p>a &amp; b &lt c &#x27; &eacute; &#128;</p>");
+    TEST_TEXT("&fake; AT&T &# \xef\xbf\xbd \xe2\x89\xaa\xe2\x83\x92", "<p>&fake; AT&T &# &#0; &nLt;</p>");
+    TEST_ATTR("href", "?a=1&copy=2&b=\xc2\xa9", "<a href='?a=1&copy=2&b=&copy;'>");
+    TEST_ATTR("title", "x&y", "<a title=x&amp;y>");
+    htmlstream_feed(&t, "<p>fish &am", 11); //77
+    TEST_TEXT("fish & chips", "p; chips</p>");
+    TEST_TEXT("&amp;", "<script>&amp;</script>");
+    TEST_TEXT("&", "<title>&amp;</title>");
+    {
+        static const char *const raw[] = {"title", "xmp", 0};
+        static const char *const rcdata[] = {"xmp", 0};
+        t.rawtext_tags = raw;
+        t.rcdata_tags  = rcdata;
+        TEST_TEXT("<&>", "<xmp><&amp;></xmp>");
+        TEST_TEXT("&amp;", "<title>&amp;</title>");
+        t.rawtext_tags = htmlstream_rawtext_default;
+        t.rcdata_tags  = htmlstream_rcdata_default;
+    }
+    TEST_TEXT("&amp;", "<p><![CDATA[&amp;]]></p>");
+    t.flags = 0;
+    TEST_TEXT("&amp;", "<p>&amp;</p>");
+    {
+        ++expected_cb_count;
+        const char *in = "&lt;p&gt; &notin &#X1F600; &am";
+        char out[64];
+        int len = htmlstream_decode(out, in, strlen(in));
+        bool passed = len == 17 && memcmp(out, "<p> \xc2\xacin \xf0\x9f\x98\x80 &am", len) == 0;
+        if (!passed) {
+            printf("'%.*s' \n", len, out);
+        }
+        test_result(passed, "decode", "");
+    }
+
+    t.flags = HTMLSTREAM_KEEP_CASE; //85
+    TEST_ATTR("href", "/Case?Q=1", "<A HREF='/Case?Q=1'>");
+    TEST_ATTR("class", "Big", "<p Class=Big>");
+    t.flags = HTMLSTREAM_KEEP_CASE | HTMLSTREAM_DECODE;
+    TEST_ATTR("title", "A&B", "<a title='A&amp;B'>");
+    t.flags = 0;
+    TEST_TEXT("\vx", "<p> \vx </p>");
+    t.flags = HTMLSTREAM_KEEP_SPACE;
+    TEST_TEXT(" \n", "</p> \n<p>");
+    t.flags = 0;
+    select_flags = HTMLSTREAM_KEEP_CASE;
+    TEST_SELECT("0:B ", ".Main", "<p id=a class=main><p id=B class='x Main'>");
+    select_flags = 0;
+    { //91
+        ++expected_cb_count;
+        t.flags = HTMLSTREAM_UTF8;
+        htmlstream_feed(&t, "<p>\xc3\xa9 \xf0\x9f", 8);
+        bool ok = t.utf8.invalid == 0 && t.utf8.need == 2;
+        htmlstream_feed(&t, "\x98\x80</p>", 6);
+        ok = ok && t.utf8.invalid == 0 && t.utf8.need == 0;
+        // surrogate, overlong, cut short, past U+10FFFF
+        const char *bad = "<p>\xed\xa0\x80 \xc0\xaf \xe2\x82< \xf4\x90\x80\x80</p>";
+        htmlstream_feed(&t, bad, strlen(bad));
+        ok = ok && t.utf8.invalid == 10;
+        htmlstream_reset(&t);
+        ok = ok && t.utf8.invalid == 0;
+        const char *rep = "<p>\xc3\xa9 \xe2\x82</p>\xff";
+        int len = strlen(rep);
+        char *doc = malloc(50 * len);
+        for (int i = 0; i < 50; i++) {
+            memcpy(doc + i * len, rep, len);
+        }
+        htmlstream_feed_parallel(&t, doc, 50 * len, 4);
+        ok = ok && t.utf8.invalid == 100;
+        free(doc);
+        htmlstream_reset(&t);
+        t.flags = 0;
+        if (!ok) {
+            printf("%d \n", t.utf8.invalid);
+        }
+        test_result(ok, "utf-8", "");
+    }
+    { //92
+        // mapped, from where the fd is
+        const char *html = "<p>skipped</p><p>from a file</p>";
+        FILE *f = tmpfile();
+        fputs(html, f);
+        fflush(f);
+        lseek(fileno(f), 14, SEEK_SET);
+        expected_cb_count += 2;
+        expected_val = "from a file";
+        t.text_cb = test_htmlstream_text_cb;
+        int mapped = htmlstream_feed_fd(&t, fileno(f));
+        fclose(f);
+        // read
+        int fds[2];
+        int piped = pipe(fds);
+        if (!piped && write(fds[1], "<p>from a pipe</p>", 18) == 18) {
+            close(fds[1]);
+            expected_val = "from a pipe";
+            piped = htmlstream_feed_fd(&t, fds[0]);
+            close(fds[0]);
+        }
+        t.text_cb = 0;
+        if (mapped || piped || htmlstream_feed_file(&t, "/nonexistent") != -1) {
+            printf("[FAIL] feed fd %d %d \n", mapped, piped);
+            exit(2);
+        }
+    }
+    {
+        ++expected_cb_count;
+        // a stop leaves a file right after what was parsed
+        const char *html = "<a>x</a><stop>after";
+        htmlstream_t p;
+        htmlstream_init(&p);
+        p.open_cb = test_directive_open_cb;
+        p.parg    = &p;
+        FILE *f = tmpfile();
+        fputs(html, f);
+        fflush(f);
+        lseek(fileno(f), 0, SEEK_SET);
+        int mapped = htmlstream_feed_fd(&p, fileno(f));
+        off_t at   = lseek(fileno(f), 0, SEEK_CUR);
+        fclose(f);
+        htmlstream_reset(&p);
+        int fds[2];
+        int piped = pipe(fds);
+        if (!piped && write(fds[1], html, strlen(html)) == (ssize_t)strlen(html)) {
+            close(fds[1]);
+            piped = htmlstream_feed_fd(&p, fds[0]);
+            close(fds[0]);
+        }
+        bool passed = mapped == 1 && at == 14 && piped == 1;
+        if (!passed) {
+            printf("%d %d %d \n", mapped, (int)at, piped);
+        }
+        test_result(passed, "feed fd stop", "");
+    }
+
+    TEST_CHECKPOINT("<a Href='/x?a=1' b=\"c\\\"d\" e>text <!-- x -> -->more<br/></a>", 0); //95
+    TEST_CHECKPOINT("<p>a &amp b &#x41; &notin; c</p><textarea>&lt;</TEXTAREA ><![CDATA[x]]>", HTMLSTREAM_DECODE);
+    TEST_CHECKPOINT("<script>if (a</b) x = '</p>';</script><?php x ?><p title='\xe2\x82\xac'>", HTMLSTREAM_UTF8);
+    {
+        ++expected_cb_count;
+        char blob[64];
+        htmlstream_reset(&t);
+        int idle = htmlstream_checkpoint(&t, blob, sizeof(blob));
+        bool ok = idle <= 17 && htmlstream_restore(&t, blob, idle) &&
+            !htmlstream_restore(&t, blob, idle - 1) && !htmlstream_restore(&t, "\x7f", 1);
+        // half a tag keeps its name
+        htmlstream_feed(&t, "<p", 2);
+        ok = ok && htmlstream_checkpoint(&t, blob, 0) == idle + 1;
+        htmlstream_reset(&t);
+        char size[16];
+        snprintf(size, sizeof(size), "%d bytes", idle);
+        test_result(ok, "checkpoint of", size);
+    }
+    {
+        // a checkpoint with a number out of range does not restore. the first ones are
+        // version, state, ret, markup, rawtext, skip and quote
+        ++expected_cb_count;
+        char blob[64], bad[80];
+        htmlstream_reset(&t);
+        htmlstream_feed(&t, "<script>x</", 11);
+        int n = htmlstream_checkpoint(&t, blob, sizeof(blob));
+        static const int field[] = {4, 4, 3, 6, 5, 1};
+        static const int value[] = {100000, 0, 50, 'x', -2, HTMLSTREAM_STATE_CDATA_START};
+        bool ok = htmlstream_restore(&t, blob, n);
+        for (int i = 0; i < 6; i++) {
+            int at = 0, out = 0;
+            for (int f = 0; f < 7; f++) {
+                int v = htmlstream_internal_get(blob, n, &at);
+                htmlstream_internal_put(bad, sizeof(bad), &out, f == field[i] ? value[i] : v);
+            }
+            memcpy(bad + out, blob + at, n - at);
+            ok = ok && !htmlstream_restore(&t, bad, out + n - at);
+        }
+        htmlstream_reset(&t);
+        test_result(ok, "checkpoint out of range", "");
+    }
+
+    TEST_WRITE("<div id=A><p>Hi <b>there</b></p><br><img src=\"x.png\"/><ul><li>a<li>b</ul></div>", //100
+            HTMLSTREAM_WRITE_PRETTY, 0,
+            "<div id=\"a\">\n  <p>\n    Hi\n    <b>\n      there\n    </b>\n  </p>\n  <br>\n  <img src=\"x.png\">\n"
+            "  <ul>\n    <li>\n      a\n      <li>\n        b\n  </ul>\n</div>\n");
+    TEST_WRITE("<p title='a \"q\" &amp; b' hidden>x  &lt;\n y &copy;</p><script>a<b &amp;</script><pre> 1  2 </pre>",
+            HTMLSTREAM_WRITE_MINIFY, HTMLSTREAM_DECODE,
+            "<p title=\"a &quot;q&quot; &amp; b\" hidden>x &lt; y \xc2\xa9</p><script>a<b &amp;</script><pre> 1  2 </pre>\n");
+    TEST_WRITE("<p>a &lt; b <!-- gone --><textarea> x  y </textarea>",
+            HTMLSTREAM_WRITE_MINIFY, 0, "<p>a &lt; b <textarea> x  y </textarea>\n");
+    TEST_WRITE("<p>\n  a <b>b</b>\n <i>c</i>  d\n</p>", HTMLSTREAM_WRITE_MINIFY, 0, "<p> a <b>b</b> <i>c</i> d </p>\n");
+    TEST_WRITE("<p \"oh god\" \"x>y\"=1 k=v>t<1x a=b>u</1x><x/></p>", HTMLSTREAM_WRITE_MINIFY, 0, "<p k=\"v\">tu<x></p>\n");
+    TEST_WRITE("<div><pre>\n a\n<b> b </b>\n</pre><textarea> t </textarea></div>", HTMLSTREAM_WRITE_PRETTY, 0,
+            "<div>\n  <pre>\n a\n<b> b </b>\n</pre>\n  <textarea> t </textarea>\n</div>\n");
+    {
+        // long runs go out straight from the parser's buffer
+        ++expected_cb_count;
+        int n = 3 * HTMLSTREAM_WRITE_DIRECT;
+        char *html = (char *)malloc(n + 32);
+        memcpy(html, "<pre>", 5);
+        memset(html + 5, 'x', n);
+        strcpy(html + 5 + n, "</pre><p>y</p>");
+        char *out = test_write(html, HTMLSTREAM_WRITE_PRETTY, HTMLSTREAM_ZEROCOPY, false);
+        bool ok = strlen(out) == n + 25 && memcmp(out, "<pre>xxx", 8) == 0 &&
+            strcmp(out + n + 5, "</pre>\n<p>\n  y\n</p>\n") == 0;
+        free(out);
+        free(html);
+        // and a write that fails says why
+        htmlstream_writer_t *w = (htmlstream_writer_t *)malloc(sizeof(htmlstream_writer_t));
+        htmlstream_write_init(w, -1, HTMLSTREAM_WRITE_PRETTY);
+        htmlstream_write_feed(w, "<p>x</p>", 8);
+        ok = ok && htmlstream_write_finish(w) == -1 && errno == EBADF;
+        free(w);
+        test_result(ok, "write long text", "");
+    }
+
+    {
+        // the examples of rfc 3986 5.4
+        ++expected_cb_count;
+        static const char *refs[][2] = {
+            {"g:h", "g:h"}, {"g", "http://a/b/c/g"}, {"./g", "http://a/b/c/g"}, {"g/", "http://a/b/c/g/"},
+            {"/g", "http://a/g"}, {"//g", "http://g"}, {"?y", "http://a/b/c/d;p?y"},
+            {"g?y", "http://a/b/c/g?y"}, {"#s", "http://a/b/c/d;p?q#s"}, {"g#s", "http://a/b/c/g#s"},
+            {"", "http://a/b/c/d;p?q"}, {".", "http://a/b/c/"}, {"./", "http://a/b/c/"},
+            {"..", "http://a/b/"}, {"../g", "http://a/b/g"}, {"../..", "http://a/"},
+            {"../../g", "http://a/g"}, {"../../../g", "http://a/g"}, {"/./g", "http://a/g"},
+            {"g.", "http://a/b/c/g."}, {"..g", "http://a/b/c/..g"}, {"./../g", "http://a/b/g"},
+            {"g/./h", "http://a/b/c/g/h"}, {"g/../h", "http://a/b/c/h"}, {"g;x=1/../y", "http://a/b/c/y"},
+            {"g?y/./x", "http://a/b/c/g?y/./x"}, {"//g/a/../b", "http://g/b"},
+            {"//g/./a/.?x/../y#.", "http://g/a/?x/../y#."}, {"//g?/..", "http://g?/.."},
+        };
+        const char *base = "http://a/b/c/d;p?q";
+        int failed = -1;
+        for (int i = 0; i < sizeof(refs) / sizeof(refs[0]) && failed < 0; i++) {
+            char out[64];
+            int len = htmlstream_links_resolve(base, strlen(base), refs[i][0], strlen(refs[i][0]), out);
+            if (len != strlen(refs[i][1]) || memcmp(out, refs[i][1], len) != 0) {
+                failed = i;
+            }
+        }
+        bool passed = failed < 0;
+        if (!passed) {
+            printf("%s \n", refs[failed][0]);
+        }
+        test_result(passed, "resolve", "");
+    }
+    TEST_LINKS("https://example.com/docs/index.html",
+            "<html><head><TITLE>A &amp; B</TITLE><meta charset=utf-8><META NAME=Description content=\"Hi there\">"
+            "<link rel=stylesheet href=\"../css/Site.css\"><base href=\"/v2/\"></head>"
+            "<body><p class=x>text <a href=\"Page?a=1&amp;b=2\" rel=nofollow>x</a> <a name=top>no</a>"
+            "<img src=x.png><a href=' //cdn.example.org/x '>y</a><title>svg</title><a href=#f></body>",
+            "5:=A & B|4:charset=utf-8|4:Description=Hi there|2:stylesheet=https://example.com/css/Site.css|"
+            "3:=https://example.com/v2/|1:nofollow=https://example.com/v2/Page?a=1&b=2|"
+            "1:=https://cdn.example.org/x|1:=https://example.com/v2/#f|");
+    TEST_LINKS(0, "<title></title>after<a href=\"x/../y\">", "1:=x/../y|");
+    {
+        const char *html = "<p a='>' b=\"x>y\" c=d/>t1<b \"q>\" x=y'z>t2</b><a href=x <i>t3</i>"
+            "<script type=\"a>b\">x<y</script><img/ src=1 /><p x=<!-- c -->t4</p><svg a=b/>t5<p\n\tx>";
+        ++expected_cb_count;
+        test_result(test_noattr_same(html, 0) && test_noattr_same(html, 1), "attributes skipped in bulk", "");
+    }
+
+    TEST_STACK("div:1 div/p:2 /p /div ", "<div><p></p></div>"); //111
+    TEST_STACK("p:1 p/br:2 /br p/img:2 /img p/x:2 /x /p ", "<p><br><img src=x><x/></p>");
+    TEST_STACK("a:1 a/b:2 a/b/i:3 /i /b /a ", "<a><b><i></a></b>");
+    TEST_STACK("ul:1 ul/li:2 /li /ul ", "</x><ul><li></span></ul></li>");
+    TEST_STACK("html:1 html/body:2 html/body/img:3 /img /body /html ", "<html><body><img ");
+    TEST_STACK("main:1 main/nav:2 /nav main/p:2 /p /main ", "<main><nav><a>x</a></nav><p></p></main>");
+    TEST_STACK("script:1 /script p:1 /p ", "<script>if (a<b) '</p>'</script><p></p>");
+    {
+        // elements past HTMLSTREAM_STACK_DEPTH are counted and closed without a name
+        ++expected_cb_count;
+        static char html[(HTMLSTREAM_STACK_DEPTH + 2) * 3 + 8], path[HTMLSTREAM_STACK_DEPTH * 2];
+        for (int i = 0; i < HTMLSTREAM_STACK_DEPTH + 2; i++) {
+            memcpy(html + i * 3, "<a>", 3);
+        }
+        for (int i = 0; i < HTMLSTREAM_STACK_DEPTH; i++) {
+            memcpy(path + i * 2, "a/", 2);
+        }
+        strcpy(html + (HTMLSTREAM_STACK_DEPTH + 2) * 3, "</x><b>");
+        path[HTMLSTREAM_STACK_DEPTH * 2 - 1] = 0;
+        // the </x> may close the innermost one, whose name is not known
+        char tail[HTMLSTREAM_STACK_DEPTH * 10 + 64];
+        snprintf(tail, sizeof(tail), "%s:%d %s:%d /x %s:%d / / ", path, HTMLSTREAM_STACK_DEPTH + 1, path,
+                HTMLSTREAM_STACK_DEPTH + 2, path, HTMLSTREAM_STACK_DEPTH + 2);
+        for (int i = 0; i < HTMLSTREAM_STACK_DEPTH; i++) {
+            strcat(tail, "/a ");
+        }
+        const char *events = test_stack(html, strlen(html));
+        bool passed = strlen(events) > strlen(tail) && strcmp(events + strlen(events) - strlen(tail), tail) == 0;
+        if (!passed) {
+            printf("%s \n", events);
+        }
+        char depth[16];
+        snprintf(depth, sizeof(depth), "%d", HTMLSTREAM_STACK_DEPTH);
+        test_result(passed, "stack deeper than", depth);
+    }
+    TEST_CHECKPOINT("<div><p>a<br>b<img src=x><ul><li>one</div><x/></p>", HTMLSTREAM_STACK);
+
+    htmlstream_tree_t tree;
+    htmlstream_tree_init(&tree);
+    TEST_TREE("<div id=A class=\"x y\"><p>Hi <b>there</b></p><br><img src=\"x.png\"/>tail<hr></div>", //120
+            "(div[id=a,class=x y](p('Hi',b('there')),br,img[src=x.png],'tail',hr))");
+    TEST_TREE("<ul><li>a<li>b</ul><p>c</span>d</p><x/>y<p hidden>",
+            "(ul(li('a',li('b'))),p('c','d'),x/,'y',p[hidden])");
+    TEST_TREE("<p>x</p y=1><a></a z><b></b>",
+            "(p('x'),a,b)");
+    {
+        // strings stay in the document where they can, and memory is kept for the next one
+        ++expected_cb_count;
+        static char html[64 * 38 + 1];
+        for (int i = 0; i < 64; i++) {
+            sprintf(html + i * 38, "<a href=\"/%02d\">Item &amp; %02d</a><P>%04d", i, i, i);
+        }
+        int len = strlen(html);
+        htmlstream_tree_clear(&tree);
+        htmlstream_tree_parse(&tree, html, len);
+        const htmlstream_node_t *a = &tree.nodes[tree.nodes[0].first_child];
+        const htmlstream_node_t *p = &tree.nodes[a->next_sibling];
+        int href_len = 0;
+        const char *href = htmlstream_tree_attr(&tree, a, "href", &href_len);
+        bool ok = tree.nodes_count == 64 * 4 && a->name == html + 1 && href == html + 9 && href_len == 3 &&
+            tree.nodes[a->first_child].name == html + 14 && p->tag_id == HTMLSTREAM_TAG_P &&
+            (p->name < html || p->name >= html + len) && !htmlstream_tree_attr(&tree, a, "title", &href_len);
+        size_t memory = htmlstream_tree_memory(&tree);
+        static char dump[2][16384];
+        test_tree_dump(&tree, 0, dump[0]);
+        test_tree(&tree, html, true, dump[1]);
+        ok = ok && strcmp(dump[0], dump[1]) == 0 && htmlstream_tree_memory(&tree) == memory;
+        if (!ok) {
+            printf("%d \n%s\n%s \n", tree.nodes_count, dump[0], dump[1]);
+        }
+        test_result(ok, "tree spans", "");
+    }
+    htmlstream_tree_free(&tree);
+
+#ifdef HTMLSTREAM_STATS
+    {
+        ++expected_cb_count;
+        // a long tag name, a recovery (<>), a replay (<!x is no comment) and its byte again
+        char html[200];
+        snprintf(html, sizeof(html), "<p a=1 b>x <> y</p><!x><%0120d>", 0);
+        htmlstream_t st;
+        htmlstream_init(&st);
+        st.open_cb  = test_hash_open_cb;
+        st.close_cb = test_hash_close_cb;
+        st.text_cb  = test_hash_text_cb;
+        st.attr_cb  = test_hash_attr_cb;
+        htmlstream_feed(&st, html, strlen(html));
+        htmlstream_reset(&st);
+        htmlstream_stats_t *c = &st.stats;
+        long long bytes = 0;
+        for (int i = 0; i < HTMLSTREAM_STATES; i++) {
+            bytes += c->bytes[i];
+        }
+        bool passed = bytes == strlen(html) + 1 && c->bytes[HTMLSTREAM_STATE_MARKUP] == 2 && c->opens == 3 && c->closes == 1 && c->attrs == 2 && c->texts == 2 && c->replays == 1 && c->truncated == 20 && c->recoveries == 1 && c->skipped == 0;
+        if (!passed) {
+            printf("%lld %lld %lld %lld %lld %lld %lld %lld %lld \n", bytes, c->bytes[HTMLSTREAM_STATE_MARKUP], c->opens, c->closes, c->attrs, c->texts, c->replays, c->truncated, c->recoveries);
+        }
+        test_result(passed, "stats", "");
+    }
+    {
+        ++expected_cb_count;
+        // a parser without attr_cb runs over attributes in one go, and still counts what is in them
+        const char *html = "<p a=1 b/c>x <> y</p><a href=x/ y data-x = 'q' z=\"/\">z</a><br/ >";
+        htmlstream_t one, run;
+        htmlstream_init(&one);
+        htmlstream_init(&run);
+        one.open_cb  = run.open_cb  = test_hash_open_cb;
+        one.close_cb = run.close_cb = test_hash_close_cb;
+        one.text_cb  = run.text_cb  = test_hash_text_cb;
+        htmlstream_feed(&one, html, strlen(html));
+        test_feed_noattr(&run, html, strlen(html));
+        long long one_bytes = 0, run_bytes = 0;
+        for (int i = 0; i < HTMLSTREAM_STATES; i++) {
+            one_bytes += one.stats.bytes[i];
+            run_bytes += run.stats.bytes[i];
+        }
+        bool passed = one_bytes == (long long)strlen(html) && run_bytes == one_bytes && one.stats.recoveries == 2 && run.stats.recoveries == one.stats.recoveries;
+        if (!passed) {
+            printf("%lld %lld %lld %lld \n", one_bytes, run_bytes, one.stats.recoveries, run.stats.recoveries);
+        }
+        test_result(passed, "stats of a run over attributes", "");
+    }
+    {
+        ++expected_cb_count;
+        // a batch counts into the parser it was given, whichever thread parsed what
+        htmlstream_doc_t docs[20];
+        long long want = 0;
+        for (int i = 0; i < 20; i++) {
+            docs[i].data = i % 2 ? "<p>one</p>" : "<a href=x>two</a> <> ";
+            docs[i].len  = strlen(docs[i].data);
+            want += docs[i].len;
+        }
+        htmlstream_t proto;
+        htmlstream_init(&proto);
+        htmlstream_feed_batch(&proto, docs, 20, 3);
+        long long bytes = 0;
+        for (int i = 0; i < HTMLSTREAM_STATES; i++) {
+            bytes += proto.stats.bytes[i];
+        }
+        bool passed = bytes == want && proto.stats.recoveries == 10;
+        if (!passed) {
+            printf("%lld %lld \n", bytes, proto.stats.recoveries);
+        }
+        test_result(passed, "batch stats", "");
+    }
+#endif
 
     if (expected_cb_count == actual_cb_count) {
         printf("[PASS] %d/%d passed\n", actual_cb_count, expected_cb_count);